@@ -29,7 +29,7 @@ struct hxt_metrics {
 #define HXT_IOC_WAIT_IRQ        _IOW(HXT_IOC_MAGIC, 5, uint32_t)
 #define HXT_IOC_METRICS         _IOW(HXT_IOC_MAGIC, 6, struct hxt_metrics)
 
-#define MAX_DATA_CHUNK          16384
+#define MAX_DATA_CHUNK          MTFW_BLOCK
 
 #define MT_CMD_LAST             0xE1
 #define MT_DEV_INFO             0xE2
@@ -47,9 +47,11 @@ static unsigned mt_type;
 
 static int bootload(int fd)
 {
-    int i, sz;
-    unsigned char buf[16], rdbuf[MAX_DATA_CHUNK];
+    int sz;
+    unsigned char buf[16], rdbuf[MAX_DATA_CHUNK], blkbuf[MTFW_BLOCK];
+    const unsigned char *data;
     mtfw_item_t *iter;
+    mtfw_cursor_t cur;
 
     if(ioctl(fd, HXT_IOC_RESET)) {
         perror("failed resetting controller");
@@ -117,12 +119,9 @@ static int bootload(int fd)
                 return 1;
             }
             usleep(1000);
-            for(i=0; i<iter->size; i+=MAX_DATA_CHUNK) {
-                sz = iter->size - i;
-                if(sz > MAX_DATA_CHUNK)
-                    sz = MAX_DATA_CHUNK;
-
-                if(write(fd, iter->data + i, sz) != sz) {
+            mtfw_cursor_init(&cur, iter);
+            while((sz = mtfw_cursor_next(&cur, blkbuf, &data)) > 0) {
+                if(write(fd, data, sz) != sz) {
                     perror("failed writing data block");
                     return 1;
                 }
@@ -131,6 +130,10 @@ static int bootload(int fd)
                     return 1;
                 }
             }
+            if(sz < 0) {
+                fprintf(stderr, "failed unpacking firmware data\n");
+                return 1;
+            }
             if(ioctl(fd, HXT_IOC_SET_CS, 0)) {
                 perror("failed deasserting CS#");
                 return 1;
@@ -340,14 +343,33 @@ int main(int argc, char *argv[])
     FILE *flist;
     char llist[256], *sep;
     struct stat statbuf;
+    unsigned long budget = 0;
+    mtfw_stats_t stats;
+    int i;
+
+    if(argc > 2 && !strcmp(argv[1], "-i")) {
+        for(i=2; i<argc; i++)
+            if(mtfw_index_firmware(argv[i]))
+                return 1;
+        return 0;
+    }
+
+    if(argc > 2 && !strcmp(argv[1], "-m")) {
+        budget = strtoul(argv[2], NULL, 0) * 1024;
+        argc -= 2;
+        argv += 2;
+    }
 
     if(argc != 3 && argc != 4) {
-        fprintf(stderr, "usage: hx-touchd <personality> <fwimage> <syscfg>\n"
+        fprintf(stderr, "usage: hx-touchd [-m <budget>] <personality> <fwimage> <syscfg>\n"
+                        "       <budget> = resident firmware limit in KiB (default: pack everything)\n"
                         "       <personality> = C1F5D,2\n"
                         "       <fwimage> = D10.mtprops\n"
                         "       <syscfg> = /dev/block/nvme0n3\n"
-                        "   or: hx-touchd <fwlist> <syscfg>\n"
-                        "       <fwlist> = file with <personality> <fwimage> pairs\n");
+                        "   or: hx-touchd [-m <budget>] <fwlist> <syscfg>\n"
+                        "       <fwlist> = file with <personality> <fwimage> pairs\n"
+                        "   or: hx-touchd -i <fwimage>...\n"
+                        "       writes <fwimage>.idx so later loads parse one personality\n");
         return 1;
     }
 
@@ -394,6 +416,9 @@ retry:
     if(bootload(fd))
         return 1;
 
+    mtfw_pack_firmware(mt_firmware, budget, &stats);
+    fprintf(stderr, "resident firmware: %lu bytes (%lu raw)\n", stats.resident, stats.raw);
+
     send_wake(fd);
 
     len = 16;
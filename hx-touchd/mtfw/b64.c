@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Streaming base64 decoder. Characters outside the alphabet (line breaks,
+ * indentation) are skipped, '=' may only be followed by more padding, and
+ * the total of data and padding characters must be a multiple of four.
+ *
+ * Whenever the decoder sits on a quad boundary, runs of pure alphabet
+ * characters are translated and packed a vector at a time (NEON on arm64,
+ * AVX2 or SSSE3 on x86 when the compiler targets them); the first vector
+ * holding anything else, and any short tail, goes through the table.
+ */
+
+#include <stdint.h>
+
+#include "b64.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define B64_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define B64_AVX2
+#define B64_SSSE3
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define B64_SSSE3
+#endif
+
+#if defined(B64_NEON) || defined(B64_SSSE3)
+#define B64_VEC
+#endif
+
+static const uint8_t b64_table[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+#ifdef B64_VEC
+/*
+ * Vector translation: the high and low nibble lookups have a common bit
+ * set only for characters outside the alphabet, and the high nibble
+ * (bumped down by one for '/') selects the offset to the 6-bit value.
+ */
+static const int8_t b64_lut_lo[16] = {
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a };
+static const int8_t b64_lut_hi[16] = {
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 };
+static const int8_t b64_lut_roll[16] = {
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 };
+#endif
+
+#ifdef B64_SSSE3
+static inline __m128i b64_load_lut(const int8_t *lut)
+{
+    return _mm_loadu_si128((const __m128i *)lut);
+}
+
+static inline int b64_vec16(const uint8_t *src, uint8_t *dst)
+{
+    const __m128i mask = _mm_set1_epi8(0x2f);
+    __m128i str, hin, lo, hi;
+
+    str = _mm_loadu_si128((const __m128i *)src);
+    hin = _mm_and_si128(_mm_srli_epi32(str, 4), mask);
+    lo = _mm_shuffle_epi8(b64_load_lut(b64_lut_lo), _mm_and_si128(str, mask));
+    hi = _mm_shuffle_epi8(b64_load_lut(b64_lut_hi), hin);
+    if(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+        return 0;
+    str = _mm_add_epi8(str, _mm_shuffle_epi8(b64_load_lut(b64_lut_roll), _mm_add_epi8(_mm_cmpeq_epi8(str, mask), hin)));
+
+    str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+    str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+    str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i *)dst, str);
+    return 1;
+}
+#endif
+
+#ifdef B64_AVX2
+static inline int b64_vec32(const uint8_t *src, uint8_t *dst)
+{
+    const __m256i mask = _mm256_set1_epi8(0x2f);
+    __m256i str, hin, lo, hi;
+
+    str = _mm256_loadu_si256((const __m256i *)src);
+    hin = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask);
+    lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(b64_load_lut(b64_lut_lo)), _mm256_and_si256(str, mask));
+    hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(b64_load_lut(b64_lut_hi)), hin);
+    if(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())))
+        return 0;
+    str = _mm256_add_epi8(str, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(b64_load_lut(b64_lut_roll)),
+                                                   _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask), hin)));
+
+    str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+    str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+    str = _mm256_shuffle_epi8(str, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    str = _mm256_permutevar8x32_epi32(str, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256((__m256i *)dst, str);
+    return 1;
+}
+#endif
+
+#ifdef B64_NEON
+static inline uint8x16_t b64_neon_xlat(uint8x16_t str, uint8x16_t *bad)
+{
+    uint8x16_t hin, lo, hi;
+
+    hin = vshrq_n_u8(str, 4);
+    lo = vqtbl1q_u8(vreinterpretq_u8_s8(vld1q_s8(b64_lut_lo)), vandq_u8(str, vdupq_n_u8(0x0f)));
+    hi = vqtbl1q_u8(vreinterpretq_u8_s8(vld1q_s8(b64_lut_hi)), hin);
+    *bad = vorrq_u8(*bad, vandq_u8(lo, hi));
+    hin = vaddq_u8(vceqq_u8(str, vdupq_n_u8(0x2f)), hin);
+    return vaddq_u8(str, vqtbl1q_u8(vreinterpretq_u8_s8(vld1q_s8(b64_lut_roll)), hin));
+}
+
+static inline int b64_vec64(const uint8_t *src, uint8_t *dst)
+{
+    uint8x16x4_t in = vld4q_u8(src);
+    uint8x16x3_t out;
+    uint8x16_t bad = vdupq_n_u8(0), a, b, c, d;
+
+    a = b64_neon_xlat(in.val[0], &bad);
+    b = b64_neon_xlat(in.val[1], &bad);
+    c = b64_neon_xlat(in.val[2], &bad);
+    d = b64_neon_xlat(in.val[3], &bad);
+    if(vmaxvq_u8(bad))
+        return 0;
+
+    out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+    out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+    vst3q_u8(dst, out);
+    return 1;
+}
+#endif
+
+#ifdef B64_VEC
+/* decodes whole vectors of alphabet characters; returns characters consumed */
+static unsigned long b64_vec(const uint8_t *src, unsigned long len, uint8_t *dst, unsigned long *pout)
+{
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst;
+
+#ifdef B64_NEON
+    while(iend - ip >= 64 && b64_vec64(ip, op)) {
+        ip += 64;
+        op += 48;
+    }
+#endif
+#ifdef B64_AVX2
+    while(iend - ip >= 32 && b64_vec32(ip, op)) {
+        ip += 32;
+        op += 24;
+    }
+#endif
+#ifdef B64_SSSE3
+    while(iend - ip >= 16 && b64_vec16(ip, op)) {
+        ip += 16;
+        op += 12;
+    }
+#endif
+    *pout = op - dst;
+    return ip - src;
+}
+#endif
+
+static inline void b64_step(b64_state_t *st, unsigned v, uint8_t **pop)
+{
+    if(v >= 64) {
+        if(v == 64)
+            st->np ++;
+        return;
+    }
+    if(st->np) {
+        st->bad = 1;
+        return;
+    }
+    st->nc ++;
+    st->bits = (st->bits << 6) | v;
+    st->nbits += 6;
+    if(st->nbits >= 8) {
+        st->nbits -= 8;
+        *(*pop) ++ = st->bits >> st->nbits;
+    }
+}
+
+void b64_init(b64_state_t *st)
+{
+    st->bits = st->nbits = 0;
+    st->nc = st->np = 0;
+    st->bad = 0;
+}
+
+unsigned long b64_decode_scalar(b64_state_t *st, const void *src, unsigned long len, void *dst)
+{
+    const uint8_t *ip = src, *iend = ip + len;
+    uint8_t *op = dst;
+
+    while(ip < iend)
+        b64_step(st, b64_table[*ip ++], &op);
+    return op - (uint8_t *)dst;
+}
+
+unsigned long b64_decode(b64_state_t *st, const void *src, unsigned long len, void *dst)
+{
+#ifdef B64_VEC
+    const uint8_t *ip = src, *iend = ip + len;
+    uint8_t *op = dst;
+    unsigned long n, out;
+    unsigned v;
+    int skipped;
+
+    while(ip < iend) {
+        if(!st->nbits && !st->np) {
+            n = b64_vec(ip, iend - ip, op, &out);
+            ip += n;
+            op += out;
+            st->nc += n;
+        }
+
+        /* get past whatever stopped the vector loop and back onto a quad boundary */
+        skipped = 0;
+        while(ip < iend) {
+            v = b64_table[*ip];
+            if(skipped && !st->nbits && v < 64)
+                break;
+            if(v >= 64)
+                skipped = 1;
+            b64_step(st, v, &op);
+            ip ++;
+        }
+    }
+    return op - (uint8_t *)dst;
+#else
+    /* without a vector loop there is no quad boundary to get back to */
+    return b64_decode_scalar(st, src, len, dst);
+#endif
+}
+
+int b64_finish(b64_state_t *st)
+{
+    if((st->nc + st->np) & 3)
+        st->bad = 1;
+    return st->bad ? -1 : 0;
+}
+
+const char *b64_impl(void)
+{
+#if defined(B64_NEON)
+    return "neon";
+#elif defined(B64_AVX2)
+    return "avx2";
+#elif defined(B64_SSSE3)
+    return "ssse3";
+#else
+    return "scalar";
+#endif
+}
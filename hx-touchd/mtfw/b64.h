@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+#ifndef _B64_H
+#define _B64_H
+
+typedef struct b64_state {
+    unsigned bits, nbits;
+    unsigned long nc, np;
+    int bad;
+} b64_state_t;
+
+/* output space b64_decode needs for len characters (vector stores overrun) */
+#define B64_DECODE_MAX(len)     ((len) / 4 * 3 + 16)
+
+void b64_init(b64_state_t *st);
+unsigned long b64_decode(b64_state_t *st, const void *src, unsigned long len, void *dst);
+unsigned long b64_decode_scalar(b64_state_t *st, const void *src, unsigned long len, void *dst);
+int b64_finish(b64_state_t *st);
+const char *b64_impl(void);
+
+#endif
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "b64.h"
+
+static const char b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static unsigned long long rng_state = 0x2545f4914f6cdd1dull;
+
+static unsigned rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state >> 32;
+}
+
+/* the table decoder eplist_get_data() used before the streaming decoder */
+static const unsigned char ref_b64[] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static void *ref_decode(const unsigned char *text, unsigned long *psize)
+{
+    unsigned i, ch, b;
+    unsigned long size, nc = 0, np = 0;
+    unsigned char *out;
+    for(i=0; text[i]; i++) {
+        ch = ref_b64[text[i]];
+        if(ch < 64) {
+            if(np)
+                return NULL;
+            nc ++;
+        }
+        if(ch == 64)
+            np ++;
+    }
+    if((nc + np) & 3)
+        return NULL;
+    size = (nc * 6) >> 3;
+    out = malloc(size + 1);
+    if(!out)
+        return NULL;
+    nc = np = 0;
+    b = 0;
+    for(i=0; text[i]; i++) {
+        ch = ref_b64[text[i]];
+        if(ch < 64) {
+            nc += 6;
+            b |= ch << (32 - nc);
+            if(nc >= 8) {
+                out[np ++] = b >> 24;
+                b <<= 8;
+                nc -= 8;
+            }
+        }
+    }
+    out[np] = 0;
+    *psize = size;
+    return out;
+}
+
+/* wrap styles: none, 76 + LF, 64 + LF and two tabs of indent, 68 + CRLF, random blanks */
+#define NWRAP 5
+
+static char *encode(const unsigned char *data, unsigned long len, int wrap, unsigned long *ptlen)
+{
+    char *text = malloc(len * 3 + 16), *tp = text;
+    unsigned long i, col = 0;
+    unsigned v, j, n;
+    char quad[4];
+
+    if(!text)
+        return NULL;
+    for(i=0; i<len; i+=3) {
+        v = data[i] << 16;
+        if(i + 1 < len)
+            v |= data[i + 1] << 8;
+        if(i + 2 < len)
+            v |= data[i + 2];
+        quad[0] = b64_chars[(v >> 18) & 63];
+        quad[1] = b64_chars[(v >> 12) & 63];
+        quad[2] = i + 1 < len ? b64_chars[(v >> 6) & 63] : '=';
+        quad[3] = i + 2 < len ? b64_chars[v & 63] : '=';
+        for(j=0; j<4; j++) {
+            if(wrap == 4 && !(rng() & 15)) {
+                n = 1 + rng() % 3;
+                while(n --)
+                    *tp ++ = " \t\r\n"[rng() & 3];
+            }
+            *tp ++ = quad[j];
+            col ++;
+            if((wrap == 1 && col == 76) || (wrap == 2 && col == 64)) {
+                *tp ++ = '\n';
+                if(wrap == 2) {
+                    *tp ++ = '\t';
+                    *tp ++ = '\t';
+                }
+                col = 0;
+            } else if(wrap == 3 && col == 68) {
+                *tp ++ = '\r';
+                *tp ++ = '\n';
+                col = 0;
+            }
+        }
+    }
+    *tp = 0;
+    *ptlen = tp - text;
+    return text;
+}
+
+/* clobber the encoding in a way the decoder must notice (or ignore) */
+static void corrupt(char *text, unsigned long *ptlen)
+{
+    unsigned long tlen = *ptlen, pos;
+    if(!tlen)
+        return;
+    pos = rng() % tlen;
+    switch(rng() % 4) {
+    case 0: text[pos] = '='; break;
+    case 1: memmove(text + pos, text + pos + 1, tlen - pos); tlen --; break;
+    case 2: text[pos] = "!-_*"[rng() & 3]; break;
+    case 3: text[tlen ++] = '='; text[tlen] = 0; break;
+    }
+    *ptlen = tlen;
+}
+
+static int check_one(unsigned long len, int wrap, int bad, int scalar)
+{
+    unsigned char *data, *ref, *out;
+    unsigned long tlen, rsize, osize = 0, pos, chunk;
+    b64_state_t st;
+    char *text;
+    int ret = 0, ok;
+
+    data = malloc(len + 1);
+    for(pos=0; pos<len; pos++)
+        data[pos] = rng();
+    text = encode(data, len, wrap, &tlen);
+    if(bad)
+        corrupt(text, &tlen);
+
+    ref = ref_decode((unsigned char *)text, &rsize);
+    out = malloc(tlen + 64);
+
+    b64_init(&st);
+    for(pos=0; pos<tlen; pos+=chunk) {
+        chunk = (rng() & 1) ? tlen - pos : 1 + rng() % (tlen - pos);
+        if(scalar)
+            osize += b64_decode_scalar(&st, text + pos, chunk, out + osize);
+        else
+            osize += b64_decode(&st, text + pos, chunk, out + osize);
+    }
+    ok = !b64_finish(&st);
+
+    if(ok != !!ref)
+        ret = -1;
+    else if(ref && (osize != rsize || memcmp(ref, out, rsize)))
+        ret = -1;
+    else if(ref && !bad && (rsize != len || memcmp(ref, data, len)))
+        ret = -1;
+    if(ret)
+        fprintf(stderr, "mismatch: len %lu wrap %d bad %d: ref %s %lu, %s %s %lu\n", len, wrap, bad,
+                ref ? "ok" : "invalid", ref ? rsize : 0, scalar ? "scalar" : b64_impl(), ok ? "ok" : "invalid", osize);
+
+    free(data);
+    free(text);
+    free(ref);
+    free(out);
+    return ret;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: b64bench [-n checks] [-s size-KiB] [-r reps] [-w wrap 0..%d] [-S seed]\n", NWRAP - 1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned checks = 20000, reps = 20, i, fails = 0;
+    unsigned long size = 16384, tlen, rsize, osize;
+    unsigned char *data, *out;
+    b64_state_t st;
+    double t, t_ref, t_scalar, t_vec;
+    int wrap = 1, opt;
+    char *text;
+
+    while((opt = getopt(argc, argv, "n:s:r:w:S:")) != -1) {
+        switch(opt) {
+        case 'n': checks = strtoul(optarg, NULL, 0); break;
+        case 's': size = strtoul(optarg, NULL, 0); break;
+        case 'r': reps = strtoul(optarg, NULL, 0); break;
+        case 'w': wrap = strtoul(optarg, NULL, 0); break;
+        case 'S': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(optind != argc || wrap < 0 || wrap >= NWRAP || !reps) {
+        usage();
+        return 1;
+    }
+
+    for(i=0; i<checks; i++) {
+        if(check_one(rng() % 1024, rng() % NWRAP, !(rng() % 3), 0))
+            fails ++;
+        if(check_one(rng() % 1024, rng() % NWRAP, !(rng() % 3), 1))
+            fails ++;
+    }
+    printf("differential: %u checks, %u mismatches (%s)\n", 2 * checks, fails, b64_impl());
+
+    size *= 1024;
+    data = malloc(size);
+    if(!data)
+        return 1;
+    for(i=0; i<size; i++)
+        data[i] = rng();
+    text = encode(data, size, wrap, &tlen);
+    out = malloc(B64_DECODE_MAX(tlen));
+    if(!text || !out)
+        return 1;
+
+    t = now();
+    for(i=0; i<reps; i++)
+        free(ref_decode((unsigned char *)text, &rsize));
+    t_ref = now() - t;
+
+    t = now();
+    for(i=0; i<reps; i++) {
+        b64_init(&st);
+        osize = b64_decode_scalar(&st, text, tlen, out);
+    }
+    t_scalar = now() - t;
+
+    t = now();
+    for(i=0; i<reps; i++) {
+        b64_init(&st);
+        osize = b64_decode(&st, text, tlen, out);
+    }
+    t_vec = now() - t;
+
+    if(b64_finish(&st) || osize != size || memcmp(out, data, size)) {
+        fprintf(stderr, "benchmark decode mismatch\n");
+        fails ++;
+    }
+
+    printf("%lu bytes of text, wrap %d, %u reps\n", tlen, wrap, reps);
+    printf("%-10s %8.1f MB/s\n", "reference", tlen * (double)reps / t_ref / 1e6);
+    printf("%-10s %8.1f MB/s\n", "scalar", tlen * (double)reps / t_scalar / 1e6);
+    printf("%-10s %8.1f MB/s\n", b64_impl(), tlen * (double)reps / t_vec / 1e6);
+
+    free(data);
+    free(text);
+    free(out);
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Parse and lookup benchmark for eplist and mtfw_load_firmware. Each phase
+ * runs in its own child process so its peak RSS can be reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "eplist.h"
+#include "mtfw.h"
+
+struct bench_s {
+    const char *fname, *syscfg;
+    unsigned long size;
+    char **keys;
+    unsigned nkeys, akeys;
+    unsigned reps, lookups;
+    int threads, index;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int key_add(void *param, const char *key, unsigned long offs, unsigned long len)
+{
+    struct bench_s *b = param;
+    char **nkeys;
+
+    if(!key)
+        return 0;
+    if(b->nkeys == b->akeys) {
+        b->akeys = b->akeys ? b->akeys * 2 : 16;
+        nkeys = realloc(b->keys, b->akeys * sizeof(char *));
+        if(!nkeys)
+            return -1;
+        b->keys = nkeys;
+    }
+    b->keys[b->nkeys] = strdup(key);
+    return b->keys[b->nkeys ++] ? 0 : -1;
+}
+
+static int list_keys(struct bench_s *b)
+{
+    static const eplist_scan_ops_t ops = { key_add, NULL, NULL };
+    struct stat st;
+    void *map;
+    FILE *f;
+    int ret;
+
+    f = fopen(b->fname, "r");
+    if(!f)
+        return -1;
+    if(fstat(fileno(f), &st) || !st.st_size) {
+        fclose(f);
+        return -1;
+    }
+    b->size = st.st_size;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if(map == MAP_FAILED)
+        return -1;
+    ret = eplist_scan(map, st.st_size, &ops, b);
+    munmap(map, st.st_size);
+    return ret;
+}
+
+static eplist_t load_file(const char *fname, int mode, const char *key, int threads)
+{
+    FILE *f = fopen(fname, "r");
+    eplist_t epl = NULL;
+
+    if(!f)
+        return NULL;
+    switch(mode) {
+    case 0: epl = eplist_load(EPLIST_LOAD_FILE, f); break;
+    case 1: epl = eplist_load_key(EPLIST_LOAD_FILE, f, key); break;
+    case 2: epl = eplist_load_parallel(EPLIST_LOAD_FILE, f, threads); break;
+    }
+    fclose(f);
+    return epl;
+}
+
+static void bench_load(struct bench_s *b, int mode)
+{
+    double t, best = 1e30;
+    unsigned i, nodes = 0;
+    eplist_t epl;
+
+    for(i=0; i<b->reps; i++) {
+        t = now();
+        epl = load_file(b->fname, mode, NULL, b->threads);
+        t = now() - t;
+        if(!epl) {
+            printf("load failed");
+            return;
+        }
+        nodes = eplist_count(epl);
+        eplist_free(epl);
+        if(t < best)
+            best = t;
+    }
+    printf("%9.1f MB/s %12.0f nodes/s %9.2f ms", b->size / best / 1e6, nodes / best, best * 1e3);
+}
+
+static void bench_load_key(struct bench_s *b)
+{
+    double t, total = 0, worst = 0;
+    eplist_t epl;
+    unsigned i;
+
+    for(i=0; i<b->nkeys; i++) {
+        t = now();
+        epl = load_file(b->fname, 1, b->keys[i], 0);
+        t = now() - t;
+        if(!epl) {
+            printf("load of %s failed", b->keys[i]);
+            return;
+        }
+        eplist_free(epl);
+        total += t;
+        if(t > worst)
+            worst = t;
+    }
+    printf("%9.1f MB/s %9.2f ms avg %9.2f ms max", b->size * b->nkeys / total / 1e6,
+           total * 1e3 / b->nkeys, worst * 1e3);
+}
+
+static void bench_lookup(struct bench_s *b)
+{
+    eplist_query_t *q;
+    double t, t_find, t_query;
+    epelem_t root;
+    char path[512];
+    unsigned i, j, hits = 0;
+    eplist_t epl;
+
+    epl = load_file(b->fname, 0, NULL, 0);
+    q = calloc(b->nkeys, sizeof(eplist_query_t));
+    if(!epl || !q) {
+        printf("load failed");
+        return;
+    }
+    root = eplist_root(epl);
+    for(i=0; i<b->nkeys; i++) {
+        snprintf(path, sizeof(path), "%s/Firmware Config#/Boot Sequence[0]/Address", b->keys[i]);
+        q[i] = eplist_query_compile(path);
+        /* first use decodes and parses the nested document */
+        eplist_query_first(root, q[i]);
+    }
+
+    t = now();
+    for(j=0; j<b->lookups; j++)
+        for(i=0; i<b->nkeys; i++)
+            hits += !!eplist_dict_find(root, b->keys[i], EPLIST_DICT);
+    t_find = now() - t;
+
+    t = now();
+    for(j=0; j<b->lookups; j++)
+        for(i=0; i<b->nkeys; i++)
+            hits += !!eplist_query_first(root, q[i]);
+    t_query = now() - t;
+
+    printf("%9.1f ns dict_find %9.1f ns nested query (%u hits)", t_find * 1e9 / b->lookups / b->nkeys,
+           t_query * 1e9 / b->lookups / b->nkeys, hits);
+    for(i=0; i<b->nkeys; i++)
+        eplist_query_free(q[i]);
+    free(q);
+    eplist_free(epl);
+}
+
+static void bench_mtfw(struct bench_s *b)
+{
+    double t, pass[2] = { 0, 0 };
+    mtfw_item_t *mtfw;
+    unsigned i, p, fails = 0;
+
+    for(p=0; p<2; p++)
+        for(i=0; i<b->nkeys; i++) {
+            t = now();
+            mtfw = mtfw_load_firmware(b->keys[i], b->fname, b->syscfg);
+            pass[p] += now() - t;
+            if(!mtfw)
+                fails ++;
+            mtfw_free_firmware(mtfw);
+        }
+    printf("%9.2f ms first %9.2f ms again (%u failed)", pass[0] * 1e3 / b->nkeys, pass[1] * 1e3 / b->nkeys, fails);
+}
+
+static void run(struct bench_s *b, const char *name, int phase)
+{
+    struct rusage ru;
+    int status;
+    pid_t pid;
+
+    printf("%-14s", name);
+    fflush(stdout);
+    pid = fork();
+    if(!pid) {
+        switch(phase) {
+        case 0: bench_load(b, 0); break;
+        case 1: bench_load(b, 2); break;
+        case 2: bench_load_key(b); break;
+        case 3: bench_lookup(b); break;
+        case 4: bench_mtfw(b); break;
+        }
+        fflush(stdout);
+        _exit(0);
+    }
+    if(pid < 0 || wait4(pid, &status, 0, &ru) < 0) {
+        printf("failed to run\n");
+        return;
+    }
+    printf("  %8ld KiB peak\n", ru.ru_maxrss);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: eplbench [-r reps] [-l lookups] [-j threads] [-i] <mtprops> <syscfg>\n"
+                    "       -i = write <mtprops>.idx before the mtfw phase\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_s b;
+    int opt;
+
+    memset(&b, 0, sizeof(b));
+    b.reps = 3;
+    b.lookups = 10000;
+    while((opt = getopt(argc, argv, "r:l:j:i")) != -1) {
+        switch(opt) {
+        case 'r': b.reps = strtoul(optarg, NULL, 0); break;
+        case 'l': b.lookups = strtoul(optarg, NULL, 0); break;
+        case 'j': b.threads = strtol(optarg, NULL, 0); break;
+        case 'i': b.index = 1; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(optind + 2 != argc || !b.reps || !b.lookups) {
+        usage();
+        return 1;
+    }
+    b.fname = argv[optind];
+    b.syscfg = argv[optind + 1];
+
+    if(list_keys(&b) || !b.nkeys) {
+        fprintf(stderr, "Failed to scan %s.\n", b.fname);
+        return 1;
+    }
+    printf("%s: %lu bytes, %u personalities\n", b.fname, b.size, b.nkeys);
+
+    run(&b, "load", 0);
+    run(&b, "load-parallel", 1);
+    run(&b, "load-key", 2);
+    run(&b, "lookup", 3);
+    if(b.index && mtfw_index_firmware(b.fname))
+        return 1;
+    run(&b, "mtfw", 4);
+    return 0;
+}
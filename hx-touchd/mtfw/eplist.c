@@ -3,288 +3,1855 @@
  * Copyright (C) 2020 Corellium LLC
  */
 
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <mxml.h>
-#include "qdict.h"
+#include "b64.h"
 #include "eplist.h"
 
+/*
+ * Once loaded, the element tree is flattened into an array in document
+ * order and freed. child and next are forward offsets in entries (0 for
+ * none); dict members carry their key. IDREFs are resolved by copying the
+ * target's value. Dicts with at least EPLIST_DICT_INDEX_MIN members get a
+ * key hash table on their first lookup; smaller ones are scanned.
+ */
+#ifndef EPLIST_DICT_INDEX_MIN
+#define EPLIST_DICT_INDEX_MIN   8
+#endif
+
+#define EPLIST_NODE_INDEX       1
+
+/* element names are interned per document, so their types are cached by pointer while flattening */
+#define EPLIST_NAME_CACHE       64
+#define EPLIST_NAME_KEY         (-1)
+
+struct eplist_dindex_s {
+    unsigned mask;
+    unsigned slot[];
+};
+
+struct eplist_node_s {
+    unsigned char type, flags;
+    unsigned child, next;
+    unsigned keyhash;
+    const char *key;
+    union {
+        long long ival;
+        const char *str;
+        struct eplist_data_s *data;
+        struct eplist_dindex_s *index;
+    } v;
+};
+
 struct eplist_s {
     mxml_node_t *xml;
-    qdict *ids;
+    struct eplist_ref_s *refs;
+    unsigned nrefs;
+    void *map;
+    unsigned long maplen;
+    struct eplist_node_s *nodes;
+    unsigned nnodes;
+    char *pool;
+    struct eplist_data_s **datas;
+    unsigned ndatas, nlazy;
+    const char *names[EPLIST_NAME_CACHE];
+    signed char ntypes[EPLIST_NAME_CACHE];
+};
+
+/*
+ * <data> is decoded as it is parsed; the base64 text is never stored.
+ * Binary plist data points into the file mapping (alloc == 0). Long <data>
+ * in a mapped XML file is decoded from the mapping on first use (src set).
+ */
+struct eplist_data_s {
+    unsigned char *data;
+    unsigned long size, alloc;
+    const char *src;
+    unsigned long srclen;
+    b64_state_t b64;
+    unsigned long long hash[2];
+    int hashed;
+    eplist_t inner;
+    int nested;
+};
+
+static void eplist_data_free(void *ptr)
+{
+    struct eplist_data_s *ed = ptr;
+    if(ed->alloc)
+        free(ed->data);
+    if(ed->inner)
+        eplist_free(ed->inner);
+    free(ed);
+}
+
+static int eplist_data_add(struct eplist_data_s *ed, const char *text, unsigned long len)
+{
+    unsigned char *data;
+    unsigned long need;
+
+    if(!len) {
+        b64_finish(&ed->b64);
+        data = realloc(ed->data, ed->size + 1);
+        if(!data)
+            return -1;
+        data[ed->size] = 0;
+        ed->data = data;
+        ed->alloc = ed->size + 1;
+        return 0;
+    }
+
+    need = ed->size + B64_DECODE_MAX(len);
+    if(need > ed->alloc) {
+        if(need < ed->alloc * 2)
+            need = ed->alloc * 2;
+        data = realloc(ed->data, need);
+        if(!data)
+            return -1;
+        ed->data = data;
+        ed->alloc = need;
+    }
+    ed->size += b64_decode(&ed->b64, text, len, ed->data + ed->size);
+    return 0;
+}
+
+static int eplist_data_feed(mxml_node_t *xn, const char *text, int len)
+{
+    struct eplist_data_s *ed = (struct eplist_data_s *)mxmlGetCustom(xn);
+
+    if(!ed) {
+        ed = calloc(1, sizeof(struct eplist_data_s));
+        if(!ed)
+            return -1;
+        b64_init(&ed->b64);
+        mxmlSetCustom(xn, ed, eplist_data_free);
+    }
+    return eplist_data_add(ed, text, len);
+}
+
+static mxml_type_t eplist_load_type(mxml_node_t *xn)
+{
+    const char *name = mxmlGetElement(xn);
+    return (name && !strcmp(name, "data")) ? MXML_CUSTOM : MXML_OPAQUE;
+}
+
+/* mapped files keep <data> as text so that long values can stay in the mapping */
+static mxml_type_t eplist_map_type(mxml_node_t *xn)
+{
+    return MXML_OPAQUE;
+}
+
+/* per-load options leave the calling thread's mxml settings alone */
+static mxml_options_t *eplist_options(int flags)
+{
+    mxml_options_t *opts = mxmlOptionsNew();
+
+    if(opts) {
+        mxmlOptionsSetCustomFeedHandler(opts, eplist_data_feed);
+        mxmlOptionsSetLoadFlags(opts, flags);
+    }
+    return opts;
+}
+
+struct eplist_ref_s {
+    const char *str;
+    mxml_node_t *xn, *target;
+};
+
+struct eplist_refs_s {
+    struct eplist_ref_s *refs;
+    unsigned nrefs, arefs;
+};
+
+static int eplist_ref_add(struct eplist_refs_s *rl, const char *str, mxml_node_t *xn)
+{
+    struct eplist_ref_s *nrefs;
+
+    if(rl->nrefs == rl->arefs) {
+        rl->arefs = rl->arefs ? rl->arefs * 2 : 16;
+        nrefs = realloc(rl->refs, rl->arefs * sizeof(struct eplist_ref_s));
+        if(!nrefs)
+            return -1;
+        rl->refs = nrefs;
+    }
+    rl->refs[rl->nrefs].str = str;
+    rl->refs[rl->nrefs].xn = xn;
+    rl->nrefs ++;
+    return 0;
+}
+
+static int eplist_ref_node_cmp(const void *a, const void *b)
+{
+    unsigned long na = (unsigned long)((const struct eplist_ref_s *)a)->xn;
+    unsigned long nb = (unsigned long)((const struct eplist_ref_s *)b)->xn;
+    return (na < nb) ? -1 : (na > nb);
+}
+
+static int eplist_link(eplist_t epl)
+{
+    struct eplist_refs_s refs;
+    mxml_index_t *ids;
+    const char *id;
+    mxml_node_t *xn;
+    unsigned i;
+    int ret = -1;
+
+    /* hashed ID index; finds return repeated IDs in document order, so the first wins */
+    ids = mxmlIndexNewHash(NULL, NULL, "ID");
+    if(!ids)
+        return -1;
+    memset(&refs, 0, sizeof(refs));
+    for(xn=epl->xml; xn; xn=mxmlWalkNext(xn, epl->xml, MXML_DESCEND)) {
+        if(mxmlGetType(xn) != MXML_ELEMENT)
+            continue;
+        if(mxmlElementGetAttr(xn, "ID") && mxmlIndexAdd(ids, xn))
+            goto out;
+        id = mxmlElementGetAttr(xn, "IDREF");
+        if(id && eplist_ref_add(&refs, id, xn))
+            goto out;
+    }
+
+    /* compact nodes have no user data; keep the targets sorted by IDREF node */
+    for(i=0; i<refs.nrefs; i++) {
+        mxmlIndexReset(ids);
+        refs.refs[i].target = mxmlIndexFind(ids, NULL, refs.refs[i].str);
+    }
+    if(refs.nrefs)
+        qsort(refs.refs, refs.nrefs, sizeof(struct eplist_ref_s), eplist_ref_node_cmp);
+    epl->refs = refs.refs;
+    epl->nrefs = refs.nrefs;
+    refs.refs = NULL;
+    ret = 0;
+
+out:
+    mxmlIndexDelete(ids);
+    free(refs.refs);
+    return ret;
+}
+
+/*
+ * Binary plists (bplist00) are mapped and turned straight into the same
+ * element tree the XML loader produces; data objects are not copied.
+ */
+
+#define EPLIST_BP_MAGIC         "bplist00"
+#define EPLIST_BP_TRAILER       32
+#define EPLIST_BP_DEPTH         256
+/*
+ * Writers share leaf objects but not containers, so a real file builds at
+ * most one node per object reference it holds; reusing containers to build
+ * far more than that is an expansion attack.
+ */
+#define EPLIST_BP_EXPAND        4
+
+struct eplist_bp_s {
+    const uint8_t *base;
+    unsigned long len;
+    const uint8_t *offtab;
+    unsigned offsize, refsize;
+    unsigned long long nobj, built, maxbuilt;
+};
+
+static unsigned long long eplist_bp_uint(const uint8_t *p, unsigned n)
+{
+    unsigned long long v = 0;
+    while(n --)
+        v = (v << 8) | *(p ++);
+    return v;
+}
+
+static const uint8_t *eplist_bp_object(struct eplist_bp_s *bp, unsigned long long ref)
+{
+    unsigned long long offs;
+    if(ref >= bp->nobj)
+        return NULL;
+    offs = eplist_bp_uint(bp->offtab + ref * bp->offsize, bp->offsize);
+    if(offs >= bp->len - EPLIST_BP_TRAILER)
+        return NULL;
+    return bp->base + offs;
+}
+
+/* object length from the marker's low nibble or the integer that follows it */
+static const uint8_t *eplist_bp_count(struct eplist_bp_s *bp, const uint8_t *p, unsigned long long *pcount, unsigned unit)
+{
+    const uint8_t *end = bp->base + bp->len - EPLIST_BP_TRAILER;
+    unsigned n;
+
+    *pcount = *p & 15;
+    p ++;
+    if(*pcount == 15) {
+        if(p >= end || (*p >> 4) != 1)
+            return NULL;
+        n = 1 << (*p & 15);
+        if(n > 8 || p + 1 + n > end)
+            return NULL;
+        *pcount = eplist_bp_uint(p + 1, n);
+        p += 1 + n;
+    }
+    if(*pcount > (unsigned long long)(end - p) / unit)
+        return NULL;
+    return p;
+}
+
+static char *eplist_bp_string(struct eplist_bp_s *bp, const uint8_t *p)
+{
+    unsigned long long count, i;
+    unsigned ch, lo;
+    char *str, *sp;
+
+    switch(*p >> 4) {
+    case 5:
+        p = eplist_bp_count(bp, p, &count, 1);
+        if(!p)
+            return NULL;
+        str = malloc(count + 1);
+        if(!str)
+            return NULL;
+        memcpy(str, p, count);
+        str[count] = 0;
+        return str;
+    case 6:
+        p = eplist_bp_count(bp, p, &count, 2);
+        if(!p)
+            return NULL;
+        str = sp = malloc(count * 3 + 1);
+        if(!str)
+            return NULL;
+        for(i=0; i<count; i++) {
+            ch = eplist_bp_uint(p + i * 2, 2);
+            if(ch >= 0xd800 && ch < 0xdc00 && i + 1 < count) {
+                lo = eplist_bp_uint(p + i * 2 + 2, 2);
+                if(lo >= 0xdc00 && lo < 0xe000) {
+                    ch = 0x10000 + ((ch - 0xd800) << 10) + (lo - 0xdc00);
+                    i ++;
+                }
+            }
+            if(ch < 0x80)
+                *(sp ++) = ch;
+            else if(ch < 0x800) {
+                *(sp ++) = 0xc0 | (ch >> 6);
+                *(sp ++) = 0x80 | (ch & 0x3f);
+            } else if(ch < 0x10000) {
+                *(sp ++) = 0xe0 | (ch >> 12);
+                *(sp ++) = 0x80 | ((ch >> 6) & 0x3f);
+                *(sp ++) = 0x80 | (ch & 0x3f);
+            } else {
+                *(sp ++) = 0xf0 | (ch >> 18);
+                *(sp ++) = 0x80 | ((ch >> 12) & 0x3f);
+                *(sp ++) = 0x80 | ((ch >> 6) & 0x3f);
+                *(sp ++) = 0x80 | (ch & 0x3f);
+            }
+        }
+        *sp = 0;
+        return str;
+    }
+    return NULL;
+}
+
+static mxml_node_t *eplist_bp_build(struct eplist_bp_s *bp, mxml_node_t *parent, unsigned long long ref, int depth, const char *key)
+{
+    const uint8_t *p = eplist_bp_object(bp, ref), *end = bp->base + bp->len - EPLIST_BP_TRAILER, *kp;
+    struct eplist_data_s *ed;
+    unsigned long long count, i, kref;
+    mxml_node_t *xn;
+    unsigned n;
+    long long ival;
+    double dval;
+    char *str;
+
+    if(!p || depth > EPLIST_BP_DEPTH || ++ bp->built > bp->maxbuilt)
+        return NULL;
+
+    switch(*p >> 4) {
+    case 0:
+        return mxmlNewElement(parent, *p == 0x09 ? "true" : *p == 0x08 ? "false" : "null");
+    case 1:
+        n = 1 << (*p & 15);
+        if(n > 16 || p + 1 + n > end)
+            return NULL;
+        if(n == 16) {
+            p += 8;
+            n = 8;
+        }
+        ival = eplist_bp_uint(p + 1, n);
+        xn = mxmlNewElement(parent, "integer");
+        if(xn)
+            mxmlNewOpaquef(xn, "%lld", ival);
+        return xn;
+    case 2:
+    case 3:
+        n = 1 << (*p & 7);
+        if((n != 4 && n != 8) || p + 1 + n > end)
+            return NULL;
+        if(n == 4) {
+            float fval;
+            uint32_t bits = eplist_bp_uint(p + 1, 4);
+            memcpy(&fval, &bits, 4);
+            dval = fval;
+        } else {
+            uint64_t bits = eplist_bp_uint(p + 1, 8);
+            memcpy(&dval, &bits, 8);
+        }
+        xn = mxmlNewElement(parent, (*p >> 4) == 2 ? "real" : "date");
+        if(xn)
+            mxmlNewOpaquef(xn, "%.17g", dval);
+        return xn;
+    case 4:
+        p = eplist_bp_count(bp, p, &count, 1);
+        if(!p)
+            return NULL;
+        xn = mxmlNewElement(parent, "data");
+        ed = calloc(1, sizeof(struct eplist_data_s));
+        if(!xn || !ed || !mxmlNewCustom(xn, ed, eplist_data_free)) {
+            free(ed);
+            return NULL;
+        }
+        ed->data = (unsigned char *)p;
+        ed->size = count;
+        return xn;
+    case 5:
+    case 6:
+        str = eplist_bp_string(bp, p);
+        if(!str)
+            return NULL;
+        xn = mxmlNewElement(parent, "string");
+        if(xn && !mxmlNewOpaque(xn, str))
+            xn = NULL;
+        free(str);
+        return xn;
+    case 8:
+        return mxmlNewElement(parent, "uid");
+    case 10:
+    case 12:
+        p = eplist_bp_count(bp, p, &count, bp->refsize);
+        if(!p)
+            return NULL;
+        xn = mxmlNewElement(parent, "array");
+        if(!xn)
+            return NULL;
+        for(i=0; i<count; i++)
+            if(!eplist_bp_build(bp, xn, eplist_bp_uint(p + i * bp->refsize, bp->refsize), depth + 1, NULL))
+                return NULL;
+        return xn;
+    case 13:
+        p = eplist_bp_count(bp, p, &count, 2 * bp->refsize);
+        if(!p)
+            return NULL;
+        xn = mxmlNewElement(parent, "dict");
+        if(!xn)
+            return NULL;
+        for(i=0; i<count; i++) {
+            kref = eplist_bp_uint(p + i * bp->refsize, bp->refsize);
+            kp = eplist_bp_object(bp, kref);
+            str = kp ? eplist_bp_string(bp, kp) : NULL;
+            if(!str)
+                return NULL;
+            if(key && strcmp(str, key)) {
+                free(str);
+                continue;
+            }
+            if(!mxmlNewOpaque(mxmlNewElement(xn, "key"), str)) {
+                free(str);
+                return NULL;
+            }
+            free(str);
+            if(!eplist_bp_build(bp, xn, eplist_bp_uint(p + (count + i) * bp->refsize, bp->refsize), depth + 1, NULL))
+                return NULL;
+        }
+        return xn;
+    }
+    return NULL;
+}
+
+static int eplist_is_bplist(FILE *f)
+{
+    char magic[8];
+    long pos = ftell(f);
+    int ret;
+
+    if(pos < 0)
+        return 0;
+    ret = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, EPLIST_BP_MAGIC, sizeof(magic));
+    fseek(f, pos, SEEK_SET);
+    return ret;
+}
+
+static mxml_node_t *eplist_bp_parse(const void *base, unsigned long len, const char *key)
+{
+    struct eplist_bp_s bp;
+    const uint8_t *trailer;
+    unsigned long long top, offs;
+    mxml_node_t *xml;
+
+    if(len < sizeof(EPLIST_BP_MAGIC) - 1 + EPLIST_BP_TRAILER)
+        return NULL;
+    bp.base = base;
+    bp.len = len;
+    trailer = bp.base + bp.len - EPLIST_BP_TRAILER;
+    bp.offsize = trailer[6];
+    bp.refsize = trailer[7];
+    bp.nobj = eplist_bp_uint(trailer + 8, 8);
+    top = eplist_bp_uint(trailer + 16, 8);
+    offs = eplist_bp_uint(trailer + 24, 8);
+    if(memcmp(bp.base, EPLIST_BP_MAGIC, sizeof(EPLIST_BP_MAGIC) - 1) ||
+       bp.offsize < 1 || bp.offsize > 8 || bp.refsize < 1 || bp.refsize > 8 ||
+       offs > bp.len - EPLIST_BP_TRAILER || bp.nobj > (bp.len - EPLIST_BP_TRAILER - offs) / bp.offsize)
+        return NULL;
+    bp.offtab = bp.base + offs;
+    bp.built = 0;
+    bp.maxbuilt = EPLIST_BP_EXPAND * (bp.len / bp.refsize + 1);
+
+    xml = mxmlNewElement(MXML_NO_PARENT, "plist");
+    if(!xml || !eplist_bp_build(&bp, xml, top, 0, key)) {
+        mxmlDelete(xml);
+        return NULL;
+    }
+    return xml;
+}
+
+/* XML text that needs no decoding is left in the mapping until the tree is flattened */
+static void *eplist_map(FILE *f, unsigned long *plen)
+{
+    struct stat st;
+    void *map;
+
+    if(ftell(f) != 0 || fstat(fileno(f), &st) || !st.st_size)
+        return NULL;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if(map == MAP_FAILED)
+        return NULL;
+    *plen = st.st_size;
+    return map;
+}
+
+static void eplist_unmap(eplist_t epl)
+{
+    if(epl->map)
+        munmap(epl->map, epl->maplen);
+    epl->map = NULL;
+}
+
+static mxml_node_t *eplist_bp_load(eplist_t epl, FILE *f, const char *key)
+{
+    mxml_node_t *xml;
+    struct stat st;
+    void *map;
+
+    if(fstat(fileno(f), &st) || st.st_size < (off_t)(sizeof(EPLIST_BP_MAGIC) - 1 + EPLIST_BP_TRAILER))
+        return NULL;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if(map == MAP_FAILED)
+        return NULL;
+
+    xml = eplist_bp_parse(map, st.st_size, key);
+    if(!xml) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    epl->map = map;
+    epl->maplen = st.st_size;
+    return xml;
+}
+
+static unsigned eplist_keyhash(const char *key)
+{
+    unsigned hash = 0x811c9dc5;
+    while(*key)
+        hash = (hash ^ (unsigned char)*(key ++)) * 0x01000193;
+    return hash;
+}
+
+static int eplist_elem_type(const char *type)
+{
+    if(!type)
+        return 0;
+    if(!strcmp(type, "array"))
+        return EPLIST_ARRAY;
+    if(!strcmp(type, "dict"))
+        return EPLIST_DICT;
+    if(!strcmp(type, "integer"))
+        return EPLIST_INTEGER;
+    if(!strcmp(type, "string"))
+        return EPLIST_STRING;
+    if(!strcmp(type, "true") || !strcmp(type, "false"))
+        return EPLIST_BOOL;
+    if(!strcmp(type, "data"))
+        return EPLIST_DATA;
+    return 0;
+}
+
+static mxml_node_t *eplist_deref(eplist_t epl, mxml_node_t *xn)
+{
+    struct eplist_ref_s key, *ref;
+
+    if(!epl->nrefs)
+        return xn;
+    key.xn = xn;
+    ref = bsearch(&key, epl->refs, epl->nrefs, sizeof(struct eplist_ref_s), eplist_ref_node_cmp);
+    return (ref && ref->target) ? ref->target : xn;
+}
+
+static int eplist_name_type(eplist_t epl, mxml_node_t *xn)
+{
+    const char *name = mxmlGetElement(xn);
+    unsigned slot = ((unsigned long)name >> 3) % EPLIST_NAME_CACHE;
+
+    if(epl->names[slot] != name) {
+        epl->names[slot] = name;
+        epl->ntypes[slot] = (name && !strcmp(name, "key")) ? EPLIST_NAME_KEY : eplist_elem_type(name);
+    }
+    return epl->ntypes[slot];
+}
+
+static unsigned eplist_flat_count(eplist_t epl, mxml_node_t *xn, unsigned long *ppool)
+{
+    mxml_node_t *cn;
+    const char *text;
+    unsigned count = 1;
+    size_t len;
+
+    if(eplist_name_type(epl, xn) == EPLIST_STRING) {
+        text = mxmlGetOpaqueView(eplist_deref(epl, xn), &len);
+        if(text)
+            *ppool += len + 1;
+    }
+    for(cn=mxmlGetFirstChild(xn); cn; cn=mxmlGetNextSibling(cn)) {
+        if(!mxmlGetElement(cn))
+            continue;
+        if(eplist_name_type(epl, cn) == EPLIST_NAME_KEY) {
+            text = mxmlGetOpaqueView(cn, &len);
+            *ppool += (text ? len : 0) + 1;
+            continue;
+        }
+        count += eplist_flat_count(epl, cn, ppool);
+    }
+    return count;
+}
+
+static const char *eplist_flat_str(char **ppool, const char *str, size_t len)
+{
+    char *res = *ppool;
+    memcpy(res, str, len);
+    res[len] = 0;
+    *ppool += len + 1;
+    return res;
+}
+
+static unsigned eplist_flat_fill(eplist_t epl, mxml_node_t *xn, unsigned *pidx, char **ppool, const char *key)
+{
+    unsigned idx = (*pidx) ++, prev = 0, cidx, nmemb = 0;
+    struct eplist_node_s *en = &epl->nodes[idx];
+    mxml_node_t *cn, *vn = eplist_deref(epl, xn);
+    const char *name = mxmlGetElement(xn), *text;
+    size_t len;
+
+    en->type = eplist_name_type(epl, xn);
+    if(key) {
+        en->key = key;
+        en->keyhash = eplist_keyhash(key);
+    }
+    switch(en->type) {
+    case EPLIST_INTEGER:
+        /* mapped text is not terminated, but the next tag's '<' ends the number */
+        text = mxmlGetOpaqueView(vn, &len);
+        en->v.ival = text ? (long long)strtoull(text, NULL, 0) : -1ll;
+        break;
+    case EPLIST_BOOL:
+        en->v.ival = !strcmp(name, "true");
+        break;
+    case EPLIST_STRING:
+        text = mxmlGetOpaqueView(vn, &len);
+        en->v.str = text ? eplist_flat_str(ppool, text, len) : NULL;
+        break;
+    case EPLIST_DATA:
+        en->v.data = (struct eplist_data_s *)mxmlGetCustom(vn);
+        break;
+    }
+
+    key = NULL;
+    for(cn=mxmlGetFirstChild(xn); cn; cn=mxmlGetNextSibling(cn)) {
+        if(!mxmlGetElement(cn))
+            continue;
+        if(eplist_name_type(epl, cn) == EPLIST_NAME_KEY) {
+            text = mxmlGetOpaqueView(cn, &len);
+            key = eplist_flat_str(ppool, text ? text : "", text ? len : 0);
+            continue;
+        }
+        cidx = eplist_flat_fill(epl, cn, pidx, ppool, key);
+        key = NULL;
+        if(prev)
+            epl->nodes[prev].next = cidx - prev;
+        else
+            en->child = cidx - idx;
+        prev = cidx;
+        nmemb ++;
+    }
+    if(en->type == EPLIST_DICT && nmemb >= EPLIST_DICT_INDEX_MIN)
+        en->flags |= EPLIST_NODE_INDEX;
+    return idx;
+}
+
+/*
+ * Replaces the text of a <data> element with its eplist_data_s. Text that
+ * mxml left in the file mapping is decoded on first use, anything else now.
+ */
+static mxml_node_t *eplist_data_text(eplist_t epl, mxml_node_t *xn)
+{
+    struct eplist_data_s *ed = calloc(1, sizeof(struct eplist_data_s));
+    const char *text;
+    mxml_node_t *cn;
+    size_t len;
+
+    text = mxmlGetOpaqueView(xn, &len);
+    if(!ed || !text || !(cn = mxmlNewCustom(mxmlGetParent(xn), ed, eplist_data_free))) {
+        free(ed);
+        return NULL;
+    }
+    b64_init(&ed->b64);
+    if(epl->map && text >= (char *)epl->map && text < (char *)epl->map + epl->maplen) {
+        ed->src = text;
+        ed->srclen = len;
+        epl->nlazy ++;
+    } else if(eplist_data_add(ed, text, len) || eplist_data_add(ed, NULL, 0))
+        return NULL;
+    mxmlDelete(xn);
+    return cn;
+}
+
+/* flattens the tree below the first plist object and releases the DOM */
+static int eplist_flatten(eplist_t epl)
+{
+    mxml_node_t *xn, *root = NULL;
+    struct eplist_data_s *ed;
+    unsigned long pool = 0;
+    unsigned idx = 0;
+    char *pp;
+
+    memset(epl->names, 0, sizeof(epl->names));
+    memset(epl->ntypes, 0, sizeof(epl->ntypes));
+    for(xn=epl->xml; xn; xn=mxmlWalkNext(xn, epl->xml, MXML_DESCEND)) {
+        if(!root && eplist_name_type(epl, xn) > 0)
+            root = xn;
+        if(mxmlGetType(xn) == MXML_OPAQUE && eplist_name_type(epl, mxmlGetParent(xn)) == EPLIST_DATA &&
+           !(xn = eplist_data_text(epl, xn)))
+            return -1;
+        if(mxmlGetType(xn) == MXML_CUSTOM && mxmlGetCustom(xn))
+            epl->ndatas ++;
+    }
+
+    if(root)
+        epl->nnodes = eplist_flat_count(epl, root, &pool);
+    epl->nodes = calloc(epl->nnodes + 1, sizeof(struct eplist_node_s));
+    epl->pool = pp = malloc(pool + 1);
+    epl->datas = calloc(epl->ndatas + 1, sizeof(struct eplist_data_s *));
+    if(!epl->nodes || !epl->pool || !epl->datas) {
+        epl->ndatas = 0;
+        return -1;
+    }
+
+    if(root)
+        eplist_flat_fill(epl, root, &idx, &pp, NULL);
+
+    /* data buffers now belong to the flat table */
+    epl->ndatas = 0;
+    for(xn=epl->xml; xn; xn=mxmlWalkNext(xn, epl->xml, MXML_DESCEND)) {
+        if(mxmlGetType(xn) != MXML_CUSTOM)
+            continue;
+        ed = (struct eplist_data_s *)mxmlGetCustom(xn);
+        if(ed) {
+            mxmlSetCustom(xn, ed, NULL);
+            epl->datas[epl->ndatas ++] = ed;
+        }
+    }
+
+    mxmlDelete(epl->xml);
+    epl->xml = NULL;
+    free(epl->refs);
+    epl->refs = NULL;
+    epl->nrefs = 0;
+    return 0;
+}
+
+eplist_t eplist_load(int srctype, void *src)
+{
+    eplist_t epl = calloc(1, sizeof(struct eplist_s));
+    mxml_options_t *opts;
+
+    if(!epl)
+        return NULL;
+
+    if(srctype == EPLIST_LOAD_FILE && eplist_is_bplist(src))
+        srctype = EPLIST_LOAD_BPLIST;
+
+    opts = eplist_options(MXML_COMPACT_DOM | MXML_DEFER_TEXT);
+    if(!opts) {
+        free(epl);
+        return NULL;
+    }
+    switch(srctype) {
+    case EPLIST_LOAD_FILE:
+        epl->map = eplist_map(src, &epl->maplen);
+        if(epl->map)
+            epl->xml = mxmlLoadMappedEx(NULL, epl->map, epl->maplen, eplist_map_type, MXML_NO_CALLBACK, NULL, opts);
+        else
+            epl->xml = mxmlLoadFileEx(NULL, src, eplist_load_type, MXML_NO_CALLBACK, NULL, opts);
+        break;
+    case EPLIST_LOAD_STRING:
+        epl->xml = mxmlLoadStringEx(NULL, src, eplist_load_type, MXML_NO_CALLBACK, NULL, opts);
+        break;
+    case EPLIST_LOAD_BPLIST:
+        epl->xml = eplist_bp_load(epl, src, NULL);
+        break;
+    }
+    mxmlOptionsDelete(opts);
+
+    if(!epl->xml || eplist_link(epl) || eplist_flatten(epl)) {
+        eplist_free(epl);
+        return NULL;
+    }
+    if(srctype != EPLIST_LOAD_BPLIST && !epl->nlazy)
+        eplist_unmap(epl);
+
+    return epl;
+}
+
+/*
+ * Streaming load of a single top-level key. Nodes are only retained for
+ * the document skeleton, the matching key/value pair, and anything that
+ * carries an ID (an IDREF in the kept value may point at it); everything
+ * else is released by mxml as soon as its element closes.
+ */
+
+#define EPLIST_TOP_DEPTH        3
+
+struct eplist_sax_s {
+    const char *key;
+    mxml_node_t *stash;
+    int depth, keep, stash_keep, match, found;
+    char *lastkey;
+};
+
+static mxml_type_t eplist_sax_type(mxml_node_t *xn)
+{
+    return mxmlGetRefCount(xn) > 1 ? eplist_load_type(xn) : MXML_IGNORE;
+}
+
+static mxml_type_t eplist_sax_map_type(mxml_node_t *xn)
+{
+    return mxmlGetRefCount(xn) > 1 ? eplist_map_type(xn) : MXML_IGNORE;
+}
+
+static void eplist_sax_cb(mxml_node_t *xn, mxml_sax_event_t event, void *param)
+{
+    struct eplist_sax_s *st = param;
+    const char *text;
+
+    switch(event) {
+    case MXML_SAX_ELEMENT_OPEN:
+        st->depth ++;
+        if(st->keep) {
+            mxmlRetain(xn);
+            break;
+        }
+        if(st->depth < EPLIST_TOP_DEPTH) {
+            mxmlRetain(xn);
+            break;
+        }
+        if(st->depth == EPLIST_TOP_DEPTH) {
+            if(!strcmp(mxmlGetElement(xn), "key")) {
+                free(st->lastkey);
+                st->lastkey = NULL;
+                mxmlRetain(xn);
+                break;
+            }
+            if(st->match) {
+                st->match = 0;
+                st->found = 1;
+                st->keep = st->depth;
+                mxmlRetain(xn);
+                break;
+            }
+        }
+        if(mxmlElementGetAttr(xn, "ID")) {
+            st->keep = st->depth;
+            st->stash_keep = 1;
+            mxmlRetain(xn);
+        }
+        break;
+
+    case MXML_SAX_ELEMENT_CLOSE:
+        if(st->keep == st->depth) {
+            st->keep = 0;
+            if(st->stash_keep) {
+                st->stash_keep = 0;
+                mxmlAdd(st->stash, MXML_ADD_AFTER, MXML_ADD_TO_PARENT, xn);
+            }
+        } else if(!st->keep && st->depth == EPLIST_TOP_DEPTH && !strcmp(mxmlGetElement(xn), "key")) {
+            if(!st->found && st->lastkey && !strcmp(st->lastkey, st->key))
+                st->match = 1;
+            else
+                mxmlRelease(xn);
+        }
+        st->depth --;
+        break;
+
+    case MXML_SAX_DATA:
+        if(!xn || mxmlGetRefCount(mxmlGetParent(xn)) < 2)
+            break;
+        if(!st->keep && st->depth == EPLIST_TOP_DEPTH) {
+            text = mxmlGetOpaque(xn);
+            if(text && !st->lastkey)
+                st->lastkey = strdup(text);
+        }
+        mxmlRetain(xn);
+        break;
+
+    default:
+        break;
+    }
+}
+
+eplist_t eplist_load_key(int srctype, void *src, const char *key)
+{
+    eplist_t epl = calloc(1, sizeof(struct eplist_s));
+    struct eplist_sax_s st;
+    mxml_options_t *opts;
+
+    if(!epl)
+        return NULL;
+
+    if(srctype == EPLIST_LOAD_FILE && eplist_is_bplist(src))
+        srctype = EPLIST_LOAD_BPLIST;
+    if(srctype == EPLIST_LOAD_BPLIST) {
+        epl->xml = eplist_bp_load(epl, src, key);
+        if(!epl->xml || eplist_flatten(epl)) {
+            eplist_free(epl);
+            return NULL;
+        }
+        return epl;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.key = key;
+    st.stash = mxmlNewElement(MXML_NO_PARENT, "stash");
+    opts = eplist_options(MXML_DEFER_TEXT);
+    if(!st.stash || !opts) {
+        mxmlDelete(st.stash);
+        mxmlOptionsDelete(opts);
+        free(epl);
+        return NULL;
+    }
+
+    switch(srctype) {
+    case EPLIST_LOAD_FILE:
+        epl->map = eplist_map(src, &epl->maplen);
+        if(epl->map)
+            epl->xml = mxmlLoadMappedEx(NULL, epl->map, epl->maplen, eplist_sax_map_type, eplist_sax_cb, &st, opts);
+        else
+            epl->xml = mxmlLoadFileEx(NULL, src, eplist_sax_type, eplist_sax_cb, &st, opts);
+        break;
+    case EPLIST_LOAD_STRING:
+        epl->xml = mxmlLoadStringEx(NULL, src, eplist_sax_type, eplist_sax_cb, &st, opts);
+        break;
+    }
+    mxmlOptionsDelete(opts);
+    free(st.lastkey);
+
+    if(!epl->xml) {
+        mxmlDelete(st.stash);
+        eplist_free(epl);
+        return NULL;
+    }
+
+    mxmlAdd(epl->xml, MXML_ADD_AFTER, MXML_ADD_TO_PARENT, st.stash);
+    if(eplist_link(epl) || eplist_flatten(epl)) {
+        eplist_free(epl);
+        return NULL;
+    }
+    if(!epl->nlazy)
+        eplist_unmap(epl);
+
+    return epl;
+}
+
+/*
+ * Structural scanner: tracks element depth and the root dict's members
+ * without building nodes. Only what eplist_scan() reports is decoded.
+ */
+
+struct eplist_scan_s {
+    const char *base, *end;
+    const eplist_scan_ops_t *ops;
+    void *param;
+    int depth;
+    const char *keystart, *valstart;
+    char *keyname;
 };
 
-eplist_t eplist_load(int srctype, void *src)
+static const char *eplist_scan_skip(const char *p, const char *end, const char *pat)
 {
-    eplist_t epl = calloc(1, sizeof(struct eplist_s));
-    mxml_node_t *xn, **pxn;
-    const char *id;
+    unsigned long len = strlen(pat);
+    while(p + len <= end) {
+        p = memchr(p, pat[0], end - p - len + 1);
+        if(!p)
+            return NULL;
+        if(!memcmp(p, pat, len))
+            return p + len;
+        p ++;
+    }
+    return NULL;
+}
 
-    if(!epl)
-        return NULL;
-    epl->ids = qdict_new(sizeof(mxml_node_t *));
-    if(!epl->ids) {
-        free(epl);
+static int eplist_scan_space(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+/* element or attribute text with entities expanded the way mxml does */
+static char *eplist_scan_text(const char *p, const char *end)
+{
+    char *str = malloc(end - p + 1), *o = str;
+    const char *semi;
+    unsigned long ch;
+
+    if(!str)
         return NULL;
+    while(p < end) {
+        if(*p != '&') {
+            *(o ++) = *(p ++);
+            continue;
+        }
+        semi = memchr(p, ';', end - p);
+        if(!semi)
+            goto fail;
+        p ++;
+        if(p[0] == '#') {
+            ch = (p[1] == 'x' || p[1] == 'X') ? strtoul(p + 2, NULL, 16) : strtoul(p + 1, NULL, 10);
+            if(!ch || ch > 0x10ffff)
+                goto fail;
+            if(ch < 0x80)
+                *(o ++) = ch;
+            else if(ch < 0x800) {
+                *(o ++) = 0xc0 | (ch >> 6);
+                *(o ++) = 0x80 | (ch & 0x3f);
+            } else if(ch < 0x10000) {
+                *(o ++) = 0xe0 | (ch >> 12);
+                *(o ++) = 0x80 | ((ch >> 6) & 0x3f);
+                *(o ++) = 0x80 | (ch & 0x3f);
+            } else {
+                *(o ++) = 0xf0 | (ch >> 18);
+                *(o ++) = 0x80 | ((ch >> 12) & 0x3f);
+                *(o ++) = 0x80 | ((ch >> 6) & 0x3f);
+                *(o ++) = 0x80 | (ch & 0x3f);
+            }
+        } else if(semi - p == 3 && !memcmp(p, "amp", 3))
+            *(o ++) = '&';
+        else if(semi - p == 2 && !memcmp(p, "lt", 2))
+            *(o ++) = '<';
+        else if(semi - p == 2 && !memcmp(p, "gt", 2))
+            *(o ++) = '>';
+        else if(semi - p == 4 && !memcmp(p, "quot", 4))
+            *(o ++) = '"';
+        else if(semi - p == 4 && !memcmp(p, "apos", 4))
+            *(o ++) = '\'';
+        else
+            goto fail;
+        p = semi + 1;
+    }
+    *o = 0;
+    return str;
+
+fail:
+    free(str);
+    return NULL;
+}
+
+/* returns 1 when the root object is closed */
+static int eplist_scan_close(struct eplist_scan_s *sc, const char *p)
+{
+    int ret = 0;
+
+    if(sc->depth > 2 && sc->ops->close)
+        ret = sc->ops->close(sc->param, sc->depth, p - sc->base);
+    if(!ret && sc->depth == 3 && sc->valstart) {
+        if(sc->ops->entry)
+            ret = sc->ops->entry(sc->param, sc->keystart ? sc->keyname : NULL,
+                                 (sc->keystart ? sc->keystart : sc->valstart) - sc->base,
+                                 p - (sc->keystart ? sc->keystart : sc->valstart));
+        free(sc->keyname);
+        sc->keyname = NULL;
+        sc->keystart = sc->valstart = NULL;
+    }
+    if(ret)
+        return -1;
+    sc->depth --;
+    return sc->depth < 2 ? 1 : 0;
+}
+
+static int eplist_scan_open(struct eplist_scan_s *sc, const char *tag, const char **pp)
+{
+    const char *p = tag + 1, *name = p, *an, *v, *lt;
+    char *id = NULL, *idref = NULL, **pstr, q;
+    unsigned long nlen, anlen;
+    int selfclose = 0, ret = -1;
+
+    while(p < sc->end && !eplist_scan_space(*p) && *p != '/' && *p != '>')
+        p ++;
+    nlen = p - name;
+
+    for(;;) {
+        while(p < sc->end && eplist_scan_space(*p))
+            p ++;
+        if(p >= sc->end)
+            goto out;
+        if(*p == '>') {
+            p ++;
+            break;
+        }
+        if(*p == '/') {
+            selfclose = 1;
+            p ++;
+            continue;
+        }
+        an = p;
+        while(p < sc->end && *p != '=' && !eplist_scan_space(*p) && *p != '>' && *p != '/')
+            p ++;
+        anlen = p - an;
+        while(p < sc->end && eplist_scan_space(*p))
+            p ++;
+        if(p >= sc->end || *p != '=')
+            continue;
+        p ++;
+        while(p < sc->end && eplist_scan_space(*p))
+            p ++;
+        if(p >= sc->end || (*p != '"' && *p != '\''))
+            goto out;
+        q = *(p ++);
+        v = p;
+        p = memchr(p, q, sc->end - p);
+        if(!p)
+            goto out;
+        p ++;
+
+        if(anlen == 2 && !memcmp(an, "ID", 2))
+            pstr = &id;
+        else if(anlen == 5 && !memcmp(an, "IDREF", 5))
+            pstr = &idref;
+        else
+            continue;
+        free(*pstr);
+        *pstr = eplist_scan_text(v, p - 1);
+        if(!*pstr)
+            goto out;
+    }
+    *pp = p;
+
+    sc->depth ++;
+    if(sc->depth == 2 && (nlen != 4 || memcmp(name, "dict", 4)))
+        goto out;
+
+    if(sc->depth == 3 && nlen == 3 && !memcmp(name, "key", 3)) {
+        free(sc->keyname);
+        sc->keyname = NULL;
+        sc->keystart = tag;
+        ret = 0;
+        if(selfclose) {
+            sc->keyname = strdup("");
+            sc->depth --;
+            goto out;
+        }
+        lt = memchr(p, '<', sc->end - p);
+        if(lt && sc->end - lt >= 6 && !memcmp(lt, "</key>", 6)) {
+            sc->keyname = eplist_scan_text(p, lt);
+            *pp = lt + 6;
+            sc->depth --;
+        }
+        goto out;
+    }
+    if(sc->depth == 3)
+        sc->valstart = tag;
+
+    if(sc->depth > 2 && (id || idref) && sc->ops->element &&
+       sc->ops->element(sc->param, sc->depth, tag - sc->base, id, idref))
+        goto out;
+    ret = selfclose ? eplist_scan_close(sc, p) : 0;
+out:
+    free(id);
+    free(idref);
+    return ret;
+}
+
+int eplist_scan(const void *base, unsigned long len, const eplist_scan_ops_t *ops, void *param)
+{
+    struct eplist_scan_s sc;
+    const char *p, *lt;
+    int ret = -1;
+
+    memset(&sc, 0, sizeof(sc));
+    sc.base = p = base;
+    sc.end = sc.base + len;
+    sc.ops = ops;
+    sc.param = param;
+
+    for(;;) {
+        lt = memchr(p, '<', sc.end - p);
+        if(!lt || sc.end - lt < 2)
+            break;
+        if(sc.end - lt >= 4 && !memcmp(lt, "<!--", 4))
+            p = eplist_scan_skip(lt + 4, sc.end, "-->");
+        else if(sc.end - lt >= 9 && !memcmp(lt, "<![CDATA[", 9))
+            p = eplist_scan_skip(lt + 9, sc.end, "]]>");
+        else if(lt[1] == '?')
+            p = eplist_scan_skip(lt + 2, sc.end, "?>");
+        else if(lt[1] == '!') {
+            p = lt + 2;
+            while(p < sc.end && *p != '>' && *p != '[')
+                p ++;
+            if(p < sc.end && *p == '[')
+                p = eplist_scan_skip(p, sc.end, "]");
+            if(p)
+                p = eplist_scan_skip(p, sc.end, ">");
+        } else if(lt[1] == '/') {
+            p = eplist_scan_skip(lt + 2, sc.end, ">");
+            if(p && sc.depth > 0) {
+                ret = eplist_scan_close(&sc, p);
+                if(ret)
+                    break;
+            }
+        } else {
+            ret = eplist_scan_open(&sc, lt, &p);
+            if(ret)
+                break;
+        }
+        if(!p) {
+            ret = -1;
+            break;
+        }
+    }
+
+    free(sc.keyname);
+    return ret > 0 ? 0 : -1;
+}
+
+/*
+ * Parallel load: the root dict's members are split into byte-balanced runs
+ * that are parsed on separate threads with one set of options shared by the
+ * load, then spliced under one root before IDs are linked across all of them.
+ * Each run is parsed in place, so <data> stays in the mapping as in
+ * eplist_load.
+ */
+
+#define EPLIST_PART_MIN         (256 * 1024)
+
+struct eplist_part_s {
+    const char *src;
+    unsigned long len;
+    mxml_node_t *xml;
+    mxml_options_t *opts;
+    pthread_t thread;
+    int started;
+};
+
+struct eplist_entries_s {
+    unsigned long *offs;
+    unsigned count, alloc;
+    unsigned long end;
+};
+
+static int eplist_entry_add(void *param, const char *key, unsigned long offs, unsigned long len)
+{
+    struct eplist_entries_s *ents = param;
+    unsigned long *noffs;
+
+    if(ents->count == ents->alloc) {
+        ents->alloc = ents->alloc ? ents->alloc * 2 : 64;
+        noffs = realloc(ents->offs, ents->alloc * sizeof(unsigned long));
+        if(!noffs)
+            return -1;
+        ents->offs = noffs;
+    }
+    ents->offs[ents->count ++] = offs;
+    ents->end = offs + len;
+    return 0;
+}
+
+static void *eplist_part_load(void *param)
+{
+    struct eplist_part_s *part = param;
+
+    /* an empty dict load gives the run an arena-backed top node to parse into */
+    part->xml = mxmlLoadStringEx(NULL, "<dict/>", eplist_load_type, MXML_NO_CALLBACK, NULL, part->opts);
+    if(part->xml && !mxmlLoadMappedEx(part->xml, part->src, part->len, eplist_map_type, MXML_NO_CALLBACK, NULL, part->opts)) {
+        mxmlDelete(part->xml);
+        part->xml = NULL;
     }
+    return NULL;
+}
+
+eplist_t eplist_load_parallel(int srctype, void *src, int nthreads)
+{
+    static const eplist_scan_ops_t ops = { eplist_entry_add, NULL, NULL };
+    struct eplist_entries_s ents = { 0 };
+    struct eplist_part_s *parts = NULL;
+    mxml_options_t *opts;
+    mxml_node_t *cn;
+    eplist_t epl = NULL;
+    unsigned long len, total, next;
+    const char *base;
+    void *map = NULL;
+    struct stat st;
+    unsigned i, n, nparts = 0;
+    int ok;
+
+    if(nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
 
     switch(srctype) {
     case EPLIST_LOAD_FILE:
-        epl->xml = mxmlLoadFile(NULL, src, MXML_OPAQUE_CALLBACK);
+        if(eplist_is_bplist(src) || fstat(fileno(src), &st) || !st.st_size)
+            return eplist_load(srctype, src);
+        len = st.st_size;
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(src), 0);
+        if(map == MAP_FAILED)
+            return eplist_load(srctype, src);
+        base = map;
         break;
     case EPLIST_LOAD_STRING:
-        epl->xml = mxmlLoadString(NULL, src, MXML_OPAQUE_CALLBACK);
+        base = src;
+        len = strlen(base);
         break;
     default:
-        qdict_free(epl->ids);
-        free(epl);
-        return NULL;
+        return eplist_load(srctype, src);
     }
 
-    if(!epl->xml) {
-        qdict_free(epl->ids);
-        free(epl);
-        return NULL;
+    if(nthreads < 2 || len < 2 * EPLIST_PART_MIN || eplist_scan(base, len, &ops, &ents) || ents.count < 2)
+        goto serial;
+
+    total = ents.end - ents.offs[0];
+    if((unsigned long)nthreads > total / EPLIST_PART_MIN)
+        nthreads = total / EPLIST_PART_MIN;
+    if((unsigned)nthreads > ents.count)
+        nthreads = ents.count;
+    if(nthreads < 2)
+        goto serial;
+    parts = calloc(nthreads, sizeof(struct eplist_part_s));
+    if(!parts)
+        goto serial;
+    /* one set of options serves every part's thread */
+    opts = eplist_options(MXML_COMPACT_DOM | MXML_DEFER_TEXT);
+    if(!opts) {
+        free(parts);
+        goto serial;
     }
 
-    for(xn=epl->xml; xn; xn=mxmlWalkNext(xn, epl->xml, MXML_DESCEND)) {
-        id = mxmlElementGetAttr(xn, "ID");
-        if(id) {
-            pxn = qdict_find(epl->ids, id, QDICT_ADD);
-            if(pxn)
-                *pxn = xn;
-        }
+    for(i=0; i<ents.count; i=n) {
+        next = ents.offs[0] + total / nthreads * (nparts + 1);
+        for(n=i+1; n<ents.count && (ents.offs[n] < next || nparts == (unsigned)nthreads - 1); n++)
+            ;
+        parts[nparts].src = base + ents.offs[i];
+        parts[nparts].opts = opts;
+        parts[nparts].len = (n < ents.count ? ents.offs[n] : ents.end) - ents.offs[i];
+        nparts ++;
     }
 
-    for(xn=epl->xml; xn; xn=mxmlWalkNext(xn, epl->xml, MXML_DESCEND)) {
-        id = mxmlElementGetAttr(xn, "IDREF");
-        if(id) {
-            pxn = qdict_find(epl->ids, id, QDICT_FIND);
-            if(pxn)
-                mxmlSetUserData(xn, *pxn);
+    for(i=1; i<nparts; i++)
+        parts[i].started = !pthread_create(&parts[i].thread, NULL, eplist_part_load, &parts[i]);
+    for(i=0; i<nparts; i++) {
+        if(parts[i].started)
+            pthread_join(parts[i].thread, NULL);
+        else
+            eplist_part_load(&parts[i]);
+    }
+    mxmlOptionsDelete(opts);
+
+    ok = 1;
+    for(i=0; i<nparts; i++)
+        if(!parts[i].xml)
+            ok = 0;
+    if(ok)
+        epl = calloc(1, sizeof(struct eplist_s));
+    if(epl) {
+        epl->xml = mxmlNewElement(MXML_NO_PARENT, "plist");
+        if(!epl->xml) {
+            eplist_free(epl);
+            epl = NULL;
+        }
+    }
+    /* members gather in the first part's dict; emptied parts still own their arenas */
+    for(i=0; i<nparts; i++) {
+        while(epl && i && (cn = mxmlGetFirstChild(parts[i].xml))) {
+            mxmlRemove(cn);
+            mxmlAdd(parts[0].xml, MXML_ADD_AFTER, MXML_ADD_TO_PARENT, cn);
         }
+        if(epl)
+            mxmlAdd(epl->xml, MXML_ADD_AFTER, MXML_ADD_TO_PARENT, parts[i].xml);
+        else
+            mxmlDelete(parts[i].xml);
     }
+    free(parts);
+    free(ents.offs);
 
+    if(!epl) {
+        if(map)
+            munmap(map, len);
+        return NULL;
+    }
+    epl->map = map;
+    epl->maplen = len;
+    if(eplist_link(epl) || eplist_flatten(epl)) {
+        eplist_free(epl);
+        return NULL;
+    }
+    if(!epl->nlazy)
+        eplist_unmap(epl);
     return epl;
+
+serial:
+    free(ents.offs);
+    if(map)
+        munmap(map, len);
+    return eplist_load(srctype, src);
 }
 
 void eplist_free(eplist_t epl)
 {
+    unsigned i;
     if(!epl)
         return;
-    qdict_free(epl->ids);
+    free(epl->refs);
     mxmlDelete(epl->xml);
+    for(i=0; i<epl->ndatas; i++)
+        eplist_data_free(epl->datas[i]);
+    free(epl->datas);
+    for(i=0; i<epl->nnodes && epl->nodes; i++)
+        if(epl->nodes[i].type == EPLIST_DICT && (epl->nodes[i].flags & EPLIST_NODE_INDEX))
+            free(epl->nodes[i].v.index);
+    free(epl->nodes);
+    free(epl->pool);
+    if(epl->map)
+        munmap(epl->map, epl->maplen);
     free(epl);
 }
 
 int eplist_type(epelem_t ee)
 {
-    mxml_node_t *xn = ee;
-    const char *type;
-    if(!ee)
-        return 0;
-    type = mxmlGetElement(xn);
-    if(!type)
+    struct eplist_node_s *en = ee;
+    if(!en)
         return 0;
-    if(!strcmp(type, "array"))
-        return EPLIST_ARRAY;
-    if(!strcmp(type, "dict"))
-        return EPLIST_DICT;
-    if(!strcmp(type, "integer"))
-        return EPLIST_INTEGER;
-    if(!strcmp(type, "string"))
-        return EPLIST_STRING;
-    if(!strcmp(type, "true") || !strcmp(type, "false"))
-        return EPLIST_BOOL;
-    if(!strcmp(type, "data"))
-        return EPLIST_DATA;
-    return 0;
+    return en->type;
+}
+
+unsigned eplist_count(eplist_t epl)
+{
+    return epl->nnodes;
 }
 
 epelem_t eplist_root(eplist_t epl)
 {
-    int type;
-    mxml_node_t *xn = epl->xml;
-    while(xn) {
-        type = eplist_type(xn);
-        if(type)
-            return xn;
-        xn = mxmlWalkNext(xn, epl->xml, MXML_DESCEND);
-    }
-    return NULL;
+    if(!epl->nnodes)
+        return NULL;
+    return epl->nodes;
 }
 
 epelem_t eplist_next(epelem_t ee)
 {
-    mxml_node_t *xn = ee;
-    const char *type;
-    while(xn) {
-        xn = mxmlGetNextSibling(xn);
-        if(!xn)
-            break;
-        type = mxmlGetElement(xn);
-        if(type && strcmp(type, "key"))
-            return xn;
-    }
-    return xn;
+    struct eplist_node_s *en = ee;
+    if(!en || !en->next)
+        return NULL;
+    return en + en->next;
 }
 
-epelem_t eplist_dict_find(epelem_t ee, const char *key, int expect_type)
+static struct eplist_dindex_s *eplist_dict_index(struct eplist_node_s *dict)
 {
-    int et = eplist_type(ee);
-    mxml_node_t *xn = ee;
-    const char *type, *text;
-    if(et != EPLIST_DICT)
+    struct eplist_dindex_s *index;
+    struct eplist_node_s *en;
+    unsigned count = 0, size = 1, i;
+
+    for(en=dict+dict->child; ; en+=en->next) {
+        count ++;
+        if(!en->next)
+            break;
+    }
+    while(size < 2 * count)
+        size <<= 1;
+    index = calloc(1, sizeof(struct eplist_dindex_s) + size * sizeof(unsigned));
+    if(!index)
         return NULL;
-    xn = mxmlGetFirstChild(xn);
-    while(xn) {
-        type = mxmlGetElement(xn);
-        if(!type) {
-            xn = mxmlGetNextSibling(xn);
-            continue;
+    index->mask = size - 1;
+
+    for(en=dict+dict->child; ; en+=en->next) {
+        if(en->key) {
+            for(i=en->keyhash&index->mask; index->slot[i]; i=(i+1)&index->mask)
+                if(dict[index->slot[i]].keyhash == en->keyhash && !strcmp(dict[index->slot[i]].key, en->key))
+                    break;
+            if(!index->slot[i])
+                index->slot[i] = en - dict;
         }
-        if(strcmp(type, "key"))
-            return NULL;
-        text = mxmlGetOpaque(xn);
-        xn = eplist_next(xn);
-        if(!xn)
-            return NULL;
-        if(!strcmp(text, key)) {
-            if(expect_type) {
-                et = eplist_type(xn);
-                if(et != expect_type)
-                    return NULL;
+        if(!en->next)
+            break;
+    }
+    return index;
+}
+
+static struct eplist_node_s *eplist_dict_lookup(struct eplist_node_s *dict, const char *key, unsigned hash)
+{
+    struct eplist_dindex_s *index;
+    struct eplist_node_s *en;
+    unsigned i;
+
+    if(dict->flags & EPLIST_NODE_INDEX) {
+        index = dict->v.index;
+        if(!index)
+            index = dict->v.index = eplist_dict_index(dict);
+        if(index) {
+            for(i=hash&index->mask; index->slot[i]; i=(i+1)&index->mask) {
+                en = dict + index->slot[i];
+                if(en->keyhash == hash && !strcmp(en->key, key))
+                    return en;
             }
-            return xn;
+            return NULL;
         }
-        xn = mxmlGetNextSibling(xn);
+    }
+
+    for(en=dict+dict->child; ; en+=en->next) {
+        if(en->key && en->keyhash == hash && !strcmp(en->key, key))
+            return en;
+        if(!en->next)
+            break;
     }
     return NULL;
 }
 
-epelem_t eplist_array_first(epelem_t ee)
+epelem_t eplist_dict_find(epelem_t ee, const char *key, int expect_type)
 {
-    int et = eplist_type(ee);
-    mxml_node_t *xn = ee;
-    const char *type;
-    if(et != EPLIST_ARRAY)
+    struct eplist_node_s *en = ee;
+    if(!en || en->type != EPLIST_DICT || !en->child)
         return NULL;
-    xn = mxmlGetFirstChild(xn);
-    while(xn) {
-        type = mxmlGetElement(xn);
-        if(type)
-            break;
-        xn = mxmlGetNextSibling(xn);
-    }
-    return xn;
+    en = eplist_dict_lookup(en, key, eplist_keyhash(key));
+    if(en && expect_type && en->type != expect_type)
+        return NULL;
+    return en;
 }
 
-static epelem_t eplist_deref(epelem_t ee)
+epelem_t eplist_array_first(epelem_t ee)
 {
-    mxml_node_t *xn;
-    if(!ee)
+    struct eplist_node_s *en = ee;
+    if(!en || en->type != EPLIST_ARRAY || !en->child)
         return NULL;
-    xn = mxmlGetUserData(ee);
-    if(xn)
-        return xn;
-    return ee;
+    return en + en->child;
 }
 
 const char *eplist_get_string(epelem_t ee)
 {
-    int et = eplist_type(ee);
-    if(et != EPLIST_STRING)
+    struct eplist_node_s *en = ee;
+    if(!en || en->type != EPLIST_STRING)
         return NULL;
-    return mxmlGetOpaque(eplist_deref(ee));
+    return en->v.str;
 }
 
 long long eplist_get_integer(epelem_t ee)
 {
-    int et = eplist_type(ee);
-    const char *text;
-    if(et != EPLIST_INTEGER)
+    struct eplist_node_s *en = ee;
+    if(!en || en->type != EPLIST_INTEGER)
         return -1ll;
-    text = mxmlGetOpaque(eplist_deref(ee));
-    if(!text)
-        return -1ll;
-    return strtoull(text, NULL, 0);
+    return en->v.ival;
 }
 
 int eplist_get_bool(epelem_t ee)
 {
-    const char *type;
-    if(!ee)
-        return -1;
-    type = mxmlGetElement(ee);
-    if(!type)
+    struct eplist_node_s *en = ee;
+    if(!en || en->type != EPLIST_BOOL)
         return -1;
-    if(!strcmp(type, "false"))
-        return 0;
-    if(!strcmp(type, "true"))
-        return 1;
-    return -1;
-}
-
-static const unsigned char eplist_b64[] = {
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
-    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x40, 0xff, 0xff,
-    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
-    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
-    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    return en->v.ival;
+}
+
+static struct eplist_data_s *eplist_data(epelem_t ee)
+{
+    struct eplist_node_s *en = ee;
+    struct eplist_data_s *ed;
+    if(!en || en->type != EPLIST_DATA || !(ed = en->v.data))
+        return NULL;
+    if(ed->src) {
+        if(eplist_data_add(ed, ed->src, ed->srclen) || eplist_data_add(ed, NULL, 0))
+            return NULL;
+        ed->src = NULL;
+    }
+    return ed->b64.bad ? NULL : ed;
+}
 
 void *eplist_get_data(epelem_t ee, unsigned long *psize)
 {
-    int et = eplist_type(ee);
-    unsigned i, ch, b;
-    unsigned long size, nc = 0, np = 0;
-    const unsigned char *text;
+    struct eplist_node_s *en = ee;
+    struct eplist_data_s *ed;
     unsigned char *out;
-    if(et != EPLIST_DATA)
+    unsigned long size;
+    b64_state_t b64;
+
+    /* data nobody has looked at yet is decoded straight into the copy */
+    if(en && en->type == EPLIST_DATA && (ed = en->v.data) && ed->src) {
+        out = malloc(B64_DECODE_MAX(ed->srclen) + 1);
+        if(!out)
+            return NULL;
+        b64_init(&b64);
+        size = b64_decode(&b64, ed->src, ed->srclen, out);
+        b64_finish(&b64);
+        if(b64.bad) {
+            free(out);
+            return NULL;
+        }
+        out[size] = 0;
+        if(psize)
+            *psize = size;
+        return out;
+    }
+
+    ed = eplist_data(ee);
+    if(!ed)
+        return NULL;
+    out = malloc(ed->size + 1);
+    if(!out)
+        return NULL;
+    memcpy(out, ed->data, ed->size);
+    out[ed->size] = 0;
+    if(psize)
+        *psize = ed->size;
+    return out;
+}
+
+const void *eplist_get_data_ref(epelem_t ee, unsigned long *psize)
+{
+    struct eplist_data_s *ed = eplist_data(ee);
+    if(!ed)
         return NULL;
-    text = (const unsigned char *)mxmlGetOpaque(eplist_deref(ee));
-    if(!text)
+    if(psize)
+        *psize = ed->size;
+    return ed->data;
+}
+
+int eplist_get_data_hash(epelem_t ee, unsigned long long *hash)
+{
+    struct eplist_data_s *ed = eplist_data(ee);
+    unsigned long long h0 = 0xcbf29ce484222325ull, h1 = 0x9e3779b97f4a7c15ull, w;
+    unsigned long i;
+    if(!ed)
+        return -1;
+    if(!ed->hashed) {
+        for(i=0; i+8<=ed->size; i+=8) {
+            memcpy(&w, ed->data + i, 8);
+            h0 = (h0 ^ w) * 0x100000001b3ull;
+            h1 = (h1 + w) * 0xff51afd7ed558ccdull;
+            h1 ^= h1 >> 29;
+        }
+        for(; i<ed->size; i++) {
+            h0 = (h0 ^ ed->data[i]) * 0x100000001b3ull;
+            h1 = (h1 + ed->data[i]) * 0xff51afd7ed558ccdull;
+            h1 ^= h1 >> 29;
+        }
+        ed->hash[0] = h0;
+        ed->hash[1] = h1 ^ ed->size;
+        ed->hashed = 1;
+    }
+    hash[0] = ed->hash[0];
+    hash[1] = ed->hash[1];
+    return 0;
+}
+
+/* embedded plist documents are parsed on first use and kept with the data */
+epelem_t eplist_get_plist(epelem_t ee)
+{
+    struct eplist_data_s *ed = eplist_data(ee);
+    eplist_t epl;
+    char *text = NULL;
+
+    if(!ed || ed->nested < 0)
         return NULL;
-    for(i=0; text[i]; i++) {
-        ch = eplist_b64[text[i]];
-        if(ch < 64) {
-            if(np)
+    if(ed->inner)
+        return eplist_root(ed->inner);
+
+    if(ed->size >= sizeof(EPLIST_BP_MAGIC) - 1 && !memcmp(ed->data, EPLIST_BP_MAGIC, sizeof(EPLIST_BP_MAGIC) - 1)) {
+        epl = calloc(1, sizeof(struct eplist_s));
+        if(!epl)
+            return NULL;
+        epl->xml = eplist_bp_parse(ed->data, ed->size, NULL);
+        if(!epl->xml || eplist_flatten(epl)) {
+            eplist_free(epl);
+            epl = NULL;
+        }
+    } else {
+        /* mapped binary plist data is not NUL terminated */
+        if(!ed->alloc) {
+            text = eplist_get_data(ee, NULL);
+            if(!text)
                 return NULL;
-            nc ++;
         }
-        if(ch == 64)
-            np ++;
+        epl = eplist_load(EPLIST_LOAD_STRING, text ? text : (char *)ed->data);
+        free(text);
     }
-    if((nc + np) & 3)
+
+    if(!epl) {
+        ed->nested = -1;
         return NULL;
-    size = (nc * 6) >> 3;
-    out = malloc(size + 1);
-    if(!out)
+    }
+    ed->inner = epl;
+    return eplist_root(epl);
+}
+
+/*
+ * Path queries: '/'-separated dict keys, each optionally followed by any
+ * number of [n] (array element n), [*] (every array element) and # (the
+ * plist embedded in a data value). A backslash escapes the next character.
+ */
+
+#define EPLIST_Q_KEY            1
+#define EPLIST_Q_INDEX          2
+#define EPLIST_Q_ALL            3
+#define EPLIST_Q_NESTED         4
+
+struct eplist_qop_s {
+    int op;
+    unsigned keyhash;
+    unsigned long index;
+    const char *key;
+};
+
+struct eplist_query_s {
+    unsigned nops;
+    struct eplist_qop_s *ops;
+    char *pool;
+};
+
+void eplist_query_free(eplist_query_t q)
+{
+    if(!q)
+        return;
+    free(q->ops);
+    free(q->pool);
+    free(q);
+}
+
+eplist_query_t eplist_query_compile(const char *path)
+{
+    unsigned long len = strlen(path);
+    struct eplist_query_s *q = calloc(1, sizeof(struct eplist_query_s));
+    struct eplist_qop_s *op;
+    const char *p = path;
+    char *o, *key, *end;
+    unsigned step;
+
+    if(!q)
         return NULL;
-    nc = np = 0;
-    b = 0;
-    for(i=0; text[i]; i++) {
-        ch = eplist_b64[text[i]];
-        if(ch < 64) {
-            nc += 6;
-            b |= ch << (32 - nc);
-            if(nc >= 8) {
-                out[np ++] = b >> 24;
-                b <<= 8;
-                nc -= 8;
+    q->ops = calloc(len + 1, sizeof(struct eplist_qop_s));
+    q->pool = o = malloc(len + 1);
+    if(!q->ops || !q->pool)
+        goto fail;
+
+    if(*p == '/')
+        p ++;
+    while(*p) {
+        step = q->nops;
+        key = o;
+        while(*p && *p != '/' && *p != '[' && *p != '#') {
+            if(*p == '\\' && p[1])
+                p ++;
+            *(o ++) = *(p ++);
+        }
+        if(o > key) {
+            *(o ++) = 0;
+            op = &q->ops[q->nops ++];
+            op->op = EPLIST_Q_KEY;
+            op->key = key;
+            op->keyhash = eplist_keyhash(key);
+        }
+        while(*p == '[' || *p == '#') {
+            op = &q->ops[q->nops ++];
+            if(*(p ++) == '#') {
+                op->op = EPLIST_Q_NESTED;
+            } else if(p[0] == '*' && p[1] == ']') {
+                op->op = EPLIST_Q_ALL;
+                p += 2;
+            } else {
+                if(*p < '0' || *p > '9')
+                    goto fail;
+                op->op = EPLIST_Q_INDEX;
+                op->index = strtoul(p, &end, 10);
+                if(*end != ']')
+                    goto fail;
+                p = end + 1;
             }
         }
+        if(q->nops == step)
+            goto fail;
+        if(*p == '/' && !*(++ p))
+            goto fail;
     }
-    out[np] = 0;
-    if(psize)
-        *psize = size;
-    return out;
+    return q;
+
+fail:
+    eplist_query_free(q);
+    return NULL;
+}
+
+static int eplist_query_run(eplist_query_t q, unsigned i, struct eplist_node_s *en, int (*cb)(void *param, epelem_t ee), void *param)
+{
+    struct eplist_node_s *cn;
+    unsigned long n;
+    int ret;
+
+    for(; en && i<q->nops; i++) {
+        switch(q->ops[i].op) {
+        case EPLIST_Q_KEY:
+            if(en->type != EPLIST_DICT || !en->child)
+                return 0;
+            en = eplist_dict_lookup(en, q->ops[i].key, q->ops[i].keyhash);
+            break;
+        case EPLIST_Q_INDEX:
+            en = eplist_array_first(en);
+            for(n=q->ops[i].index; en && n; n--)
+                en = eplist_next(en);
+            break;
+        case EPLIST_Q_ALL:
+            for(cn=eplist_array_first(en); cn; cn=eplist_next(cn)) {
+                ret = eplist_query_run(q, i + 1, cn, cb, param);
+                if(ret)
+                    return ret;
+            }
+            return 0;
+        case EPLIST_Q_NESTED:
+            en = eplist_get_plist(en);
+            break;
+        }
+    }
+    return en ? cb(param, en) : 0;
+}
+
+int eplist_query(epelem_t ee, eplist_query_t q, int (*cb)(void *param, epelem_t ee), void *param)
+{
+    if(!ee || !q)
+        return 0;
+    return eplist_query_run(q, 0, ee, cb, param);
+}
+
+static int eplist_query_stop(void *param, epelem_t ee)
+{
+    *(epelem_t *)param = ee;
+    return 1;
+}
+
+epelem_t eplist_query_first(epelem_t ee, eplist_query_t q)
+{
+    epelem_t res = NULL;
+    eplist_query(ee, q, eplist_query_stop, &res);
+    return res;
+}
+
+epelem_t eplist_find(epelem_t ee, const char *path)
+{
+    eplist_query_t q = eplist_query_compile(path);
+    epelem_t res = eplist_query_first(ee, q);
+    eplist_query_free(q);
+    return res;
 }
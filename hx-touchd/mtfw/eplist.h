@@ -8,11 +8,15 @@
 
 typedef struct eplist_s *eplist_t;
 typedef void *epelem_t;
+typedef struct eplist_query_s *eplist_query_t;
 
 #define EPLIST_LOAD_FILE        1
 #define EPLIST_LOAD_STRING      2
+#define EPLIST_LOAD_BPLIST      3
 
 eplist_t eplist_load(int srctype, void *src);
+eplist_t eplist_load_key(int srctype, void *src, const char *key);
+eplist_t eplist_load_parallel(int srctype, void *src, int nthreads);
 void eplist_free(eplist_t epl);
 
 #define EPLIST_ARRAY            1
@@ -24,6 +28,7 @@ void eplist_free(eplist_t epl);
 
 int eplist_type(epelem_t ee);
 epelem_t eplist_root(eplist_t epl);
+unsigned eplist_count(eplist_t epl);
 epelem_t eplist_next(epelem_t ee);
 epelem_t eplist_dict_find(epelem_t ee, const char *key, int expect_type);
 epelem_t eplist_array_first(epelem_t ee);
@@ -31,5 +36,30 @@ const char *eplist_get_string(epelem_t ee);
 long long eplist_get_integer(epelem_t ee);
 int eplist_get_bool(epelem_t ee);
 void *eplist_get_data(epelem_t ee, unsigned long *size);
+const void *eplist_get_data_ref(epelem_t ee, unsigned long *size);
+int eplist_get_data_hash(epelem_t ee, unsigned long long *hash);
+epelem_t eplist_get_plist(epelem_t ee);
+
+/* paths look like "C1F5D,2/Firmware Config#/Boot Sequence[*]/Address" */
+eplist_query_t eplist_query_compile(const char *path);
+int eplist_query(epelem_t ee, eplist_query_t q, int (*cb)(void *param, epelem_t ee), void *param);
+epelem_t eplist_query_first(epelem_t ee, eplist_query_t q);
+epelem_t eplist_find(epelem_t ee, const char *path);
+void eplist_query_free(eplist_query_t q);
+
+/*
+ * Structural scan of an XML plist. entry is called for every member of the
+ * root dict, covering its <key> through the end of its value (key is NULL
+ * if it could not be decoded); element for elements below the root object
+ * that carry ID or IDREF; close at the end of each element below it. A
+ * non-zero return from a callback stops the scan.
+ */
+typedef struct eplist_scan_ops {
+    int (*entry)(void *param, const char *key, unsigned long offs, unsigned long len);
+    int (*element)(void *param, int depth, unsigned long offs, const char *id, const char *idref);
+    int (*close)(void *param, int depth, unsigned long end);
+} eplist_scan_ops_t;
+
+int eplist_scan(const void *base, unsigned long len, const eplist_scan_ops_t *ops, void *param);
 
 #endif
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mtfw.h"
+
+/*
+ * Transfer shape of bootload() in hx-touchd.c: every write() is followed
+ * by a read() of the bytes clocked back during the same full-duplex
+ * transfer, so wire bytes count each payload byte once.
+ */
+#define XFER_CHUNK      16384
+#define CS_GUARD_US     1000
+#define ACK_GUARD_US    1000
+#define BOOT_SETTLE_US  50000
+
+static const char *type_names[] = { "-", "WRITE", "WRITE_ACK", "WAIT_IRQ", "SET_TYPE" };
+
+typedef struct {
+    unsigned long wire;
+    unsigned xfers, cs, acks;
+    unsigned long guard;
+} cost_t;
+
+static struct {
+    double clock;
+    double xfer_us;
+    double ioctl_us;
+    double sleep_us;
+    double irq_us;
+} model = { 8e6, 40.0, 15.0, 80.0, 5000.0 };
+
+typedef struct {
+    unsigned idx;
+    mtfw_item_t *item;
+    cost_t cost;
+    double us;
+} entry_t;
+
+static void cost_item(const mtfw_item_t *item, cost_t *c)
+{
+    memset(c, 0, sizeof(*c));
+    if(item->type != MTFW_WRITE && item->type != MTFW_WRITE_ACK)
+        return;
+
+    c->cs = 1;
+    c->guard = CS_GUARD_US;
+    c->wire = item->size;
+    c->xfers = 2 * ((item->size + XFER_CHUNK - 1) / XFER_CHUNK);
+
+    if(item->type == MTFW_WRITE_ACK) {
+        c->cs ++;
+        c->acks ++;
+        c->guard += CS_GUARD_US + ACK_GUARD_US;
+        c->wire += 2;
+        c->xfers += 2;
+    }
+}
+
+static double cost_us(const cost_t *c)
+{
+    unsigned sleeps = c->guard ? (c->guard + CS_GUARD_US - 1) / CS_GUARD_US : 0;
+    return c->wire * 8.0 * 1e6 / model.clock + c->xfers * model.xfer_us +
+           c->cs * 2 * model.ioctl_us + c->guard + sleeps * model.sleep_us;
+}
+
+static void cost_add(cost_t *d, const cost_t *s)
+{
+    d->wire += s->wire;
+    d->xfers += s->xfers;
+    d->cs += s->cs;
+    d->acks += s->acks;
+    d->guard += s->guard;
+}
+
+static unsigned get32xe(const unsigned char *buf)
+{
+    return ((unsigned)buf[0] << 8) | buf[1] | ((unsigned)buf[2] << 24) | ((unsigned)buf[3] << 16);
+}
+
+static void describe(const mtfw_item_t *item, char *str, unsigned len)
+{
+    mtfw_cursor_t cur;
+    unsigned char buf[MTFW_BLOCK];
+    const unsigned char *data;
+
+    if(item->type == MTFW_SET_TYPE && item->size >= 1) {
+        snprintf(str, len, "firmware generation %u", item->data[0]);
+        return;
+    }
+    if(item->type != MTFW_WRITE && item->type != MTFW_WRITE_ACK) {
+        snprintf(str, len, "-");
+        return;
+    }
+
+    mtfw_cursor_init(&cur, item);
+    if(mtfw_cursor_next(&cur, buf, &data) <= 0) {
+        snprintf(str, len, "(empty)");
+        return;
+    }
+    if(item->size == 16 && data[0] == 0x1E && data[1] == 0x33)
+        snprintf(str, len, "regwr %08x mask %08x val %08x", get32xe(data + 2), get32xe(data + 6), get32xe(data + 10));
+    else if(item->size >= 16 && data[0] == 0x18 && data[1] == 0xE1 && data[2] == 0x30 && data[3] == 0x01)
+        snprintf(str, len, "calload %08x, %u words", get32xe(data + 6), ((unsigned)data[4] << 8) | data[5]);
+    else if(item->size > 16)
+        snprintf(str, len, "blob");
+    else
+        snprintf(str, len, "command");
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const entry_t *ea = a, *eb = b;
+    return ea->us < eb->us ? 1 : ea->us > eb->us ? -1 : (int)ea->idx - (int)eb->idx;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mtfw-inspect [options] <personality> <fwimage> <syscfg>\n"
+                    "   -c <hz>    SPI clock (default %.0f)\n"
+                    "   -x <us>    per read/write call overhead (default %.0f)\n"
+                    "   -i <us>    per CS# ioctl overhead (default %.0f)\n"
+                    "   -s <us>    extra latency per usleep() (default %.0f)\n"
+                    "   -q <us>    boot IRQ wait (default %.0f)\n"
+                    "   -n <num>   number of items to rank (default 10)\n",
+                    model.clock, model.xfer_us, model.ioctl_us, model.sleep_us, model.irq_us);
+}
+
+int main(int argc, char *argv[])
+{
+    mtfw_item_t *mtfw, *iter;
+    entry_t *list;
+    cost_t total, fixed;
+    double total_us, fixed_us;
+    unsigned n, i, top = 10;
+    char desc[64];
+    int opt;
+
+    while((opt = getopt(argc, argv, "c:x:i:s:q:n:")) != -1) {
+        switch(opt) {
+        case 'c': model.clock = strtod(optarg, NULL); break;
+        case 'x': model.xfer_us = strtod(optarg, NULL); break;
+        case 'i': model.ioctl_us = strtod(optarg, NULL); break;
+        case 's': model.sleep_us = strtod(optarg, NULL); break;
+        case 'q': model.irq_us = strtod(optarg, NULL); break;
+        case 'n': top = strtoul(optarg, NULL, 0); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(argc - optind != 3 || model.clock <= 0) {
+        usage();
+        return 1;
+    }
+
+    mtfw = mtfw_load_firmware(argv[optind], argv[optind + 1], argv[optind + 2]);
+    if(!mtfw) {
+        fprintf(stderr, "failed loading firmware\n");
+        return 1;
+    }
+
+    for(n=0, iter=mtfw; iter; iter=iter->next)
+        n ++;
+    list = calloc(n, sizeof(entry_t));
+    if(!list) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* reset handshake, boot IRQ, and the 4-byte probe under CS# */
+    memset(&fixed, 0, sizeof(fixed));
+    fixed.wire = 8;
+    fixed.xfers = 4;
+    fixed.cs = 1;
+    fixed.guard = 2 * CS_GUARD_US + BOOT_SETTLE_US;
+    fixed_us = cost_us(&fixed) + model.irq_us + 3 * model.ioctl_us;
+    total = fixed;
+    total_us = fixed_us;
+
+    printf("%4s %-10s %8s %8s %4s %4s %7s %10s  %s\n", "#", "type", "size", "wire", "cs", "ack", "guard", "time(us)", "what");
+    for(i=0, iter=mtfw; iter; i++, iter=iter->next) {
+        list[i].idx = i;
+        list[i].item = iter;
+        cost_item(iter, &list[i].cost);
+        list[i].us = cost_us(&list[i].cost);
+        cost_add(&total, &list[i].cost);
+        total_us += list[i].us;
+
+        describe(iter, desc, sizeof(desc));
+        printf("%4u %-10s %8u %8lu %4u %4u %7lu %10.0f  %s\n", i, type_names[iter->type], iter->size,
+               list[i].cost.wire, list[i].cost.cs, list[i].cost.acks, list[i].cost.guard, list[i].us, desc);
+    }
+
+    printf("\ntotal: %u items, %lu wire bytes, %u transfers, %u CS cycles, %u acks, %lu us guard\n",
+           n, total.wire, total.xfers, total.cs, total.acks, total.guard);
+    printf("predicted upload: %.1f ms at %.2f MHz (%.1f ms fixed reset/boot overhead)\n",
+           total_us / 1000.0, model.clock / 1e6, fixed_us / 1000.0);
+
+    qsort(list, n, sizeof(entry_t), entry_cmp);
+    if(top > n)
+        top = n;
+    printf("\nmost expensive items:\n");
+    for(i=0; i<top; i++) {
+        describe(list[i].item, desc, sizeof(desc));
+        printf("%4u %-10s %10.0f us %5.1f%%  %s\n", list[i].idx, type_names[list[i].item->type],
+               list[i].us, 100.0 * list[i].us / total_us, desc);
+    }
+
+    free(list);
+    mtfw_free_firmware(mtfw);
+    return 0;
+}
@@ -9,12 +9,17 @@
 #include <stdint.h>
 
 #include "eplist.h"
+#include "qdict.h"
 #include "syscfg.h"
+#include "mtlz.h"
+#include "mtidx.h"
 #include "mtfw.h"
 
 #define GEN_1   1
 #define GEN_2   2
 
+#define MTFW_PACK_MIN   256
+
 static const struct {
     const char *provider;
     const char *syscfg;
@@ -26,6 +31,17 @@ static const struct {
     { "prox-calibration", "PxCl" },
     { "multi-touch-calibration", "MtCl" } };
 
+/* decoded blobs shared by content across personalities and files */
+typedef struct mtfw_blob {
+    unsigned refs;
+    unsigned long size;
+    unsigned char *data;
+    unsigned packed;
+    unsigned mark;
+} mtfw_blob_t;
+
+static qdict *mtfw_blobs;
+
 static mtfw_item_t *mtfw_item_add(mtfw_item_t ***pptail, unsigned type, void *data, unsigned size, int copy)
 {
     mtfw_item_t *item = calloc(1, sizeof(mtfw_item_t));
@@ -50,6 +66,103 @@ static mtfw_item_t *mtfw_item_add(mtfw_item_t ***pptail, unsigned type, void *da
     return item;
 }
 
+static void mtfw_item_release(mtfw_item_t *item)
+{
+    mtfw_blob_t *blob = item->blob;
+    if(blob) {
+        if(!-- blob->refs) {
+            free(blob->data);
+            blob->data = NULL;
+            blob->packed = 0;
+        }
+        item->blob = NULL;
+    } else
+        free(item->data);
+    item->data = NULL;
+}
+
+static unsigned mtfw_item_packed(const mtfw_item_t *item)
+{
+    const mtfw_blob_t *blob = item->blob;
+    return blob ? blob->packed : item->packed;
+}
+
+/* a hash hit is only trusted once the bytes match */
+static int mtfw_blob_equal(mtfw_blob_t *blob, epelem_t ee)
+{
+    unsigned char buf[MTFW_BLOCK];
+    const unsigned char *bits, *data;
+    unsigned long len;
+    mtfw_item_t tmp;
+    mtfw_cursor_t cur;
+    int sz;
+
+    bits = eplist_get_data_ref(ee, &len);
+    if(!bits || len != blob->size)
+        return 0;
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.size = len;
+    tmp.blob = blob;
+    mtfw_cursor_init(&cur, &tmp);
+    while((sz = mtfw_cursor_next(&cur, buf, &data)) > 0) {
+        if(memcmp(bits, data, sz))
+            return 0;
+        bits += sz;
+    }
+    return !sz;
+}
+
+static mtfw_item_t *mtfw_item_add_blob(mtfw_item_t ***pptail, epelem_t ee)
+{
+    unsigned long long hash[2];
+    char key[33];
+    mtfw_blob_t *blob;
+    mtfw_item_t *item;
+    void *bits;
+    unsigned long len;
+
+    if(eplist_get_data_hash(ee, hash))
+        return NULL;
+    if(!mtfw_blobs) {
+        mtfw_blobs = qdict_new(sizeof(mtfw_blob_t));
+        if(!mtfw_blobs)
+            return NULL;
+    }
+    snprintf(key, sizeof(key), "%016llx%016llx", hash[0], hash[1]);
+    blob = qdict_find(mtfw_blobs, key, QDICT_ANY);
+    if(!blob)
+        return NULL;
+
+    if(!blob->refs) {
+        bits = eplist_get_data(ee, &len);
+        if(!bits)
+            return NULL;
+        blob->data = bits;
+        blob->size = len;
+    } else if(!mtfw_blob_equal(blob, ee)) {
+        bits = eplist_get_data(ee, &len);
+        if(!bits)
+            return NULL;
+        item = mtfw_item_add(pptail, MTFW_WRITE_ACK, bits, len, 0);
+        if(!item)
+            free(bits);
+        return item;
+    }
+
+    item = mtfw_item_add(pptail, MTFW_WRITE_ACK, blob->data, blob->size, 0);
+    if(!item) {
+        if(!blob->refs) {
+            free(blob->data);
+            blob->data = NULL;
+        }
+        return NULL;
+    }
+    item->packed = blob->packed;
+    item->blob = blob;
+    blob->refs ++;
+    return item;
+}
+
 static inline void mtfw_put16be(uint8_t *buf, uint16_t val)
 {
     buf[0] = val >> 8;
@@ -109,10 +222,29 @@ static mtfw_item_t *mtfw_item_add_calload(mtfw_item_t ***pptail, uint32_t addr,
     mtfw_put16be(&buf[10], mtfw_sum(&buf[4], 6));
     mtfw_copy16be(&buf[12], data, len);
     mtfw_put32xe(&buf[12 + ((len + 3) & -4)], mtfw_sum(data, len));
+    free(data);
 
     return mtfw;
 }
 
+/* the index is only ever written here, never on the load path */
+int mtfw_index_firmware(const char *fname)
+{
+    FILE *f;
+    int ret;
+
+    f = fopen(fname, "r");
+    if(!f) {
+        fprintf(stderr, "Failed to open input file.\n");
+        return -1;
+    }
+    ret = mtidx_build(fname, f);
+    fclose(f);
+    if(ret)
+        fprintf(stderr, "Failed to index %s.\n", fname);
+    return ret;
+}
+
 static void *mtfw_request_cal(const char *syscfg, const char *name, unsigned long *len)
 {
     unsigned i;
@@ -128,10 +260,11 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
     FILE *f;
     eplist_t epl = NULL;
     epelem_t root, fw, fwcfg, seq, seql, act;
-    void *bits, *fwcfgbits = NULL;
+    void *bits;
     unsigned long len;
     unsigned long long addr, mask, val;
     const char *acts;
+    char *text;
     int mode, i;
 
     f = fopen(fname, "r");
@@ -139,7 +272,13 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
         fprintf(stderr, "Failed to open input file.\n");
         goto fail;
     }
-    epl = eplist_load(EPLIST_LOAD_FILE, f);
+    mtidx_lookup(fname, f, pers, &text);
+    if(text) {
+        epl = eplist_load(EPLIST_LOAD_STRING, text);
+        free(text);
+    }
+    if(!epl)
+        epl = eplist_load_key(EPLIST_LOAD_FILE, f, pers);
     fclose(f);
 
     if(!epl) {
@@ -190,15 +329,10 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
         if(!mtfw_item_add_calload(&ptail, 0x10009000, bits, len))
             goto fail;
 
-        bits = eplist_get_data(seq, &len);
-        if(!bits) {
+        if(!mtfw_item_add_blob(&ptail, seq)) {
             fprintf(stderr, "Preconstructed blob item did not decode correctly.\n");
             goto fail;
         }
-        if(!mtfw_item_add(&ptail, MTFW_WRITE_ACK, bits, len, 0)) {
-            free(bits);
-            goto fail;
-        }
 
         if(!mtfw_item_add_regwr(&ptail, 0x10003060, -1u, 6099))
             goto fail;
@@ -228,15 +362,10 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
                 fprintf(stderr, "Non-data item in preconstructed blob array.\n");
                 goto fail;
             }
-            bits = eplist_get_data(seql, &len);
-            if(!bits) {
+            if(!mtfw_item_add_blob(&ptail, seql)) {
                 fprintf(stderr, "Preconstructed blob item did not decode correctly.\n");
                 goto fail;
             }
-            if(!mtfw_item_add(&ptail, MTFW_WRITE_ACK, bits, len, 0)) {
-                free(bits);
-                goto fail;
-            }
             seql = eplist_next(seql);
         }
 
@@ -246,22 +375,17 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
             goto fail;
         }
 
-        fwcfgbits = eplist_get_data(fwcfg, &len);
-        if(!fwcfgbits) {
+        if(!eplist_get_data_ref(fwcfg, NULL)) {
             fprintf(stderr, "Configuration blob did not decode correctly.\n");
             goto fail;
         }
 
-        eplist_free(epl);
-
-        epl = eplist_load(EPLIST_LOAD_STRING, fwcfgbits);
-        if(!epl) {
+        root = eplist_get_plist(fwcfg);
+        if(!root) {
             fprintf(stderr, "Failed to load configuration blob.\n");
             goto fail;
         }
 
-        root = eplist_root(epl);
-
         seq = eplist_dict_find(root, "Calibration Sequence", EPLIST_ARRAY);
         if(!seq) {
             fprintf(stderr, "Failed to find calibration sequence.\n");
@@ -339,12 +463,191 @@ mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char
     }
 
     eplist_free(epl);
-    free(fwcfgbits);
 
     return head;
 
 fail:
     eplist_free(epl);
-    free(fwcfgbits);
+    mtfw_free_firmware(head);
     return NULL;
 }
+
+void mtfw_free_firmware(mtfw_item_t *head)
+{
+    mtfw_item_t *next;
+    for(; head; head=next) {
+        next = head->next;
+        mtfw_item_release(head);
+        free(head);
+    }
+}
+
+/* shared blobs are counted once, by the first item that uses them */
+void mtfw_firmware_stats(mtfw_item_t *head, mtfw_stats_t *stats)
+{
+    static unsigned mark;
+    mtfw_blob_t *blob;
+    unsigned packed;
+
+    if(!++ mark)
+        mark ++;
+    stats->raw = stats->resident = 0;
+    for(; head; head=head->next) {
+        blob = head->blob;
+        if(blob) {
+            if(blob->mark == mark)
+                continue;
+            blob->mark = mark;
+        }
+        packed = mtfw_item_packed(head);
+        stats->raw += head->size;
+        stats->resident += packed ? packed : head->size;
+    }
+}
+
+/* a shared blob is compressed once and all its items read the packed copy */
+static int mtfw_pack_item(mtfw_item_t *item)
+{
+    unsigned nblk = (item->size + MTFW_BLOCK - 1) / MTFW_BLOCK;
+    mtfw_blob_t *blob = item->blob;
+    const unsigned char *data = blob ? blob->data : item->data;
+    unsigned char *out, *op, *nout;
+    unsigned i, sz, csz;
+
+    out = malloc(item->size + 2 * nblk);
+    if(!out)
+        return 0;
+    op = out;
+
+    for(i=0; i<item->size; i+=MTFW_BLOCK) {
+        sz = item->size - i;
+        if(sz > MTFW_BLOCK)
+            sz = MTFW_BLOCK;
+        csz = mtlz_compress(data + i, sz, op + 2, sz - 1);
+        if(csz) {
+            op[0] = csz;
+            op[1] = csz >> 8;
+        } else {
+            memcpy(op + 2, data + i, sz);
+            op[0] = sz;
+            op[1] = (sz >> 8) | 0x80;
+            csz = sz;
+        }
+        op += 2 + csz;
+    }
+
+    if(op - out >= item->size) {
+        free(out);
+        return 0;
+    }
+
+    item->packed = op - out;
+    nout = realloc(out, item->packed);
+    if(nout)
+        out = nout;
+    if(blob) {
+        free(blob->data);
+        blob->data = out;
+        blob->packed = item->packed;
+    } else
+        mtfw_item_release(item);
+    item->data = out;
+    return 1;
+}
+
+static int mtfw_pack_cmp(const void *a, const void *b)
+{
+    const mtfw_item_t *ia = *(const mtfw_item_t **)a, *ib = *(const mtfw_item_t **)b;
+    return ia->size < ib->size ? 1 : ia->size > ib->size ? -1 : 0;
+}
+
+void mtfw_pack_firmware(mtfw_item_t *head, unsigned long budget, mtfw_stats_t *stats)
+{
+    mtfw_item_t *iter, **list;
+    mtfw_stats_t st;
+    unsigned n = 0, i;
+
+    mtfw_firmware_stats(head, &st);
+
+    for(iter=head; iter; iter=iter->next)
+        if(!mtfw_item_packed(iter) && iter->size >= MTFW_PACK_MIN)
+            n ++;
+    list = n ? malloc(n * sizeof(*list)) : NULL;
+    if(list) {
+        n = 0;
+        for(iter=head; iter; iter=iter->next)
+            if(!mtfw_item_packed(iter) && iter->size >= MTFW_PACK_MIN)
+                list[n ++] = iter;
+        qsort(list, n, sizeof(*list), mtfw_pack_cmp);
+
+        for(i=0; i<n; i++) {
+            if(budget && st.resident <= budget)
+                break;
+            if(mtfw_item_packed(list[i]))
+                continue;
+            if(mtfw_pack_item(list[i]))
+                st.resident -= list[i]->size - list[i]->packed;
+        }
+        free(list);
+    }
+
+    for(iter=head; iter; iter=iter->next)
+        if(iter->blob) {
+            iter->data = ((mtfw_blob_t *)iter->blob)->data;
+            iter->packed = mtfw_item_packed(iter);
+        }
+
+    if(stats)
+        *stats = st;
+}
+
+void mtfw_cursor_init(mtfw_cursor_t *cur, const mtfw_item_t *item)
+{
+    cur->item = item;
+    cur->offs = 0;
+    cur->pos = 0;
+}
+
+int mtfw_cursor_next(mtfw_cursor_t *cur, unsigned char *buf, const unsigned char **pdata)
+{
+    const mtfw_item_t *item = cur->item;
+    const mtfw_blob_t *blob = item->blob;
+    const unsigned char *data = blob ? blob->data : item->data;
+    unsigned packed = blob ? blob->packed : item->packed;
+    const unsigned char *blk;
+    unsigned sz, csz;
+
+    if(cur->offs >= item->size)
+        return 0;
+
+    sz = item->size - cur->offs;
+    if(sz > MTFW_BLOCK)
+        sz = MTFW_BLOCK;
+
+    if(!packed) {
+        *pdata = data + cur->offs;
+        cur->offs += sz;
+        return sz;
+    }
+
+    if(cur->pos + 2 > packed)
+        return -1;
+    blk = data + cur->pos;
+    csz = blk[0] | ((blk[1] & 0x7F) << 8);
+    if(cur->pos + 2 + csz > packed)
+        return -1;
+
+    if(blk[1] & 0x80) {
+        if(csz != sz)
+            return -1;
+        *pdata = blk + 2;
+    } else {
+        if(mtlz_decompress(blk + 2, csz, buf, MTFW_BLOCK) != sz)
+            return -1;
+        *pdata = buf;
+    }
+
+    cur->pos += 2 + csz;
+    cur->offs += sz;
+    return sz;
+}
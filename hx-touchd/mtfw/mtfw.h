@@ -15,9 +15,30 @@ typedef struct mtfw_item {
     unsigned type;
     unsigned char *data;
     unsigned size;
+    unsigned packed;
+    void *blob;
     struct mtfw_item *next;
 } mtfw_item_t;
 
+/* packed items are stored as independently compressed blocks of this size */
+#define MTFW_BLOCK      16384
+
+typedef struct mtfw_cursor {
+    const mtfw_item_t *item;
+    unsigned offs, pos;
+} mtfw_cursor_t;
+
+typedef struct mtfw_stats {
+    unsigned long raw;
+    unsigned long resident;
+} mtfw_stats_t;
+
 mtfw_item_t *mtfw_load_firmware(const char *pers, const char *fname, const char *syscfg);
+int mtfw_index_firmware(const char *fname);
+void mtfw_free_firmware(mtfw_item_t *head);
+void mtfw_pack_firmware(mtfw_item_t *head, unsigned long budget, mtfw_stats_t *stats);
+void mtfw_firmware_stats(mtfw_item_t *head, mtfw_stats_t *stats);
+void mtfw_cursor_init(mtfw_cursor_t *cur, const mtfw_item_t *item);
+int mtfw_cursor_next(mtfw_cursor_t *cur, unsigned char *buf, const unsigned char **pdata);
 
 #endif
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Writes a synthetic mtprops/syscfg pair shaped like the vendor files:
+ * GEN_2 personalities carry a "Constructed Firmware" array of blobs and a
+ * "Firmware Config" <data> holding a nested plist; every Nth personality
+ * is GEN_1 with a single blob. Blobs are streamed, so sizes are limited
+ * by disk only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+static const char b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static unsigned long long rng_state = 0x2545f4914f6cdd1dull;
+
+static unsigned rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state >> 32;
+}
+
+struct b64_out {
+    FILE *f;
+    const char *indent;
+    unsigned v, nv, col;
+};
+
+static void b64_putc(struct b64_out *bo, char ch)
+{
+    if(!bo->col)
+        fputs(bo->indent, bo->f);
+    fputc(ch, bo->f);
+    if(++ bo->col == 68) {
+        fputc('\n', bo->f);
+        bo->col = 0;
+    }
+}
+
+static void b64_byte(struct b64_out *bo, unsigned char byte)
+{
+    bo->v = (bo->v << 8) | byte;
+    if(++ bo->nv < 3)
+        return;
+    b64_putc(bo, b64_chars[(bo->v >> 18) & 63]);
+    b64_putc(bo, b64_chars[(bo->v >> 12) & 63]);
+    b64_putc(bo, b64_chars[(bo->v >> 6) & 63]);
+    b64_putc(bo, b64_chars[bo->v & 63]);
+    bo->v = bo->nv = 0;
+}
+
+static void b64_end(struct b64_out *bo)
+{
+    unsigned v = bo->v << (8 * (3 - bo->nv));
+    if(bo->nv) {
+        b64_putc(bo, b64_chars[(v >> 18) & 63]);
+        b64_putc(bo, b64_chars[(v >> 12) & 63]);
+        b64_putc(bo, bo->nv > 1 ? b64_chars[(v >> 6) & 63] : '=');
+        b64_putc(bo, '=');
+    }
+    if(bo->col)
+        fputc('\n', bo->f);
+}
+
+/* firmware images are far from random; mix runs, repeats and noise */
+static void put_blob(FILE *f, const char *indent, unsigned long size)
+{
+    struct b64_out bo = { f, indent, 0, 0, 0 };
+    unsigned char hist[256];
+    unsigned long i = 0, n;
+    unsigned mode, b;
+
+    memset(hist, 0, sizeof(hist));
+    while(i < size) {
+        mode = rng() % 4;
+        n = 16 + rng() % 240;
+        if(n > size - i)
+            n = size - i;
+        b = rng();
+        for(; n; n--, i++) {
+            switch(mode) {
+            case 0: b = rng(); break;
+            case 1: break;
+            case 2: b = hist[(i + 64) & 255]; break;
+            case 3: b = (b + 1) & 0xff; break;
+            }
+            hist[i & 255] = b;
+            b64_byte(&bo, b);
+        }
+    }
+    b64_end(&bo);
+}
+
+static const struct {
+    const char *provider;
+    const char *syscfg;
+    unsigned addr;
+    unsigned size;
+} gen_providers[] = {
+    { "multi-touch-calibration", "MtCl", 0x10009000, 1536 },
+    { "prox-calibration", "PxCl", 0x10009600, 320 },
+    { "orb-gap-cal", "OrbG", 0x10009800, 256 },
+    { "orb-force-cal", "OFCl", 0x10009900, 512 },
+};
+#define NPROVIDERS (sizeof(gen_providers) / sizeof(gen_providers[0]))
+
+static char *fw_config(unsigned pers, unsigned nboot, unsigned long *plen)
+{
+    char *buf;
+    size_t len;
+    FILE *f = open_memstream(&buf, &len);
+    unsigned i, ncal = 1 + pers % NPROVIDERS;
+
+    if(!f)
+        return NULL;
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+               "<plist version=\"1.0\">\n<dict>\n\t<key>Calibration Sequence</key>\n\t<array>\n");
+    for(i=0; i<ncal; i++)
+        fprintf(f, "\t\t<dict>\n\t\t\t<key>Address</key>\n\t\t\t<integer>%u</integer>\n"
+                   "\t\t\t<key>Provider</key>\n\t\t\t<string>%s</string>\n\t\t</dict>\n",
+                gen_providers[i].addr, gen_providers[i].provider);
+    fprintf(f, "\t</array>\n\t<key>Boot Sequence</key>\n\t<array>\n");
+    for(i=0; i<nboot; i++)
+        fprintf(f, "\t\t<dict>\n\t\t\t<key>Address</key>\n\t\t\t<integer>%u</integer>\n"
+                   "\t\t\t<key>Mask</key>\n\t\t\t<integer>%u</integer>\n"
+                   "\t\t\t<key>Value</key>\n\t\t\t<integer>%u</integer>\n\t\t</dict>\n",
+                0x10003000 + 4 * i, rng() | 1, rng() & 0xffff);
+    fprintf(f, "\t\t<dict>\n\t\t\t<key>Action</key>\n\t\t\t<string>RequestCalibration</string>\n\t\t</dict>\n"
+               "\t</array>\n\t<key>Sensor Rows</key>\n\t<integer>%u</integer>\n"
+               "\t<key>Sensor Columns</key>\n\t<integer>%u</integer>\n</dict>\n</plist>\n",
+            20 + pers % 8, 14 + pers % 6);
+    fclose(f);
+    *plen = len;
+    return buf;
+}
+
+static int write_syscfg(const char *fname)
+{
+    FILE *f = fopen(fname, "wb");
+    uint32_t hdr[6], key[5], offs, i, j;
+
+    if(!f)
+        return -1;
+    offs = sizeof(hdr) + NPROVIDERS * sizeof(key);
+    memcpy(&hdr[0], "gfCS", 4);
+    hdr[1] = 0x7c;
+    hdr[2] = offs;
+    for(i=0; i<NPROVIDERS; i++)
+        hdr[2] += gen_providers[i].size;
+    hdr[3] = 2;
+    hdr[4] = 0;
+    hdr[5] = NPROVIDERS;
+    fwrite(hdr, sizeof(hdr), 1, f);
+    for(i=0; i<NPROVIDERS; i++) {
+        memcpy(&key[0], "BTNC", 4);
+        for(j=0; j<4; j++)
+            ((char *)&key[1])[j] = gen_providers[i].syscfg[3 - j];
+        key[2] = gen_providers[i].size;
+        key[3] = offs;
+        key[4] = -1u;
+        fwrite(key, sizeof(key), 1, f);
+        offs += gen_providers[i].size;
+    }
+    for(i=0; i<NPROVIDERS; i++)
+        for(j=0; j<gen_providers[i].size; j++)
+            fputc(rng(), f);
+    return fclose(f);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mtgen [-p personalities] [-b blob-KiB] [-n blobs] [-g gen1-every] [-r idref-every]\n"
+                    "             [-c boot-steps] [-S seed] <output-base>\n"
+                    "writes <output-base>.mtprops and <output-base>.syscfg\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned npers = 8, nblobs = 3, gen1 = 4, idref = 2, nboot = 6, p, j;
+    unsigned long blob = 256, cfglen, i;
+    struct b64_out bo;
+    char *path, *cfg;
+    int opt, shared = 0;
+    FILE *f;
+
+    while((opt = getopt(argc, argv, "p:b:n:g:r:c:S:")) != -1) {
+        switch(opt) {
+        case 'p': npers = strtoul(optarg, NULL, 0); break;
+        case 'b': blob = strtoul(optarg, NULL, 0); break;
+        case 'n': nblobs = strtoul(optarg, NULL, 0); break;
+        case 'g': gen1 = strtoul(optarg, NULL, 0); break;
+        case 'r': idref = strtoul(optarg, NULL, 0); break;
+        case 'c': nboot = strtoul(optarg, NULL, 0); break;
+        case 'S': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(optind + 1 != argc || !npers || !nblobs) {
+        usage();
+        return 1;
+    }
+    blob *= 1024;
+
+    path = malloc(strlen(argv[optind]) + 16);
+    if(!path)
+        return 1;
+    sprintf(path, "%s.syscfg", argv[optind]);
+    if(write_syscfg(path)) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return 1;
+    }
+    sprintf(path, "%s.mtprops", argv[optind]);
+    f = fopen(path, "w");
+    if(!f) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return 1;
+    }
+
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+               "<plist version=\"1.0\">\n<dict>\n");
+    for(p=0; p<npers; p++) {
+        fprintf(f, "\t<key>C1F%uD,%u</key>\n\t<dict>\n", p, p % 3 + 1);
+        fprintf(f, "\t\t<key>Product &amp; Revision</key>\n\t\t<string>J%u &lt;proto %u&gt;</string>\n", 100 + p, p % 4);
+        if(gen1 && p % gen1 == gen1 - 1) {
+            fprintf(f, "\t\t<key>Constructed Firmware</key>\n\t\t<data>\n");
+            put_blob(f, "\t\t", blob);
+            fprintf(f, "\t\t</data>\n");
+        } else {
+            fprintf(f, "\t\t<key>Constructed Firmware</key>\n\t\t<array>\n");
+            for(j=0; j<nblobs; j++) {
+                /* the second blob is shared between personalities */
+                if(j == 1 && idref && shared && p % idref == 0) {
+                    fprintf(f, "\t\t\t<data IDREF=\"1\"/>\n");
+                    continue;
+                }
+                fprintf(f, j == 1 && idref && !shared ? "\t\t\t<data ID=\"1\">\n" : "\t\t\t<data>\n");
+                if(j == 1 && idref)
+                    shared = 1;
+                put_blob(f, "\t\t\t", j ? blob / 4 + rng() % 4096 : blob);
+                fprintf(f, "\t\t\t</data>\n");
+            }
+            fprintf(f, "\t\t</array>\n");
+
+            cfg = fw_config(p, nboot, &cfglen);
+            if(!cfg)
+                return 1;
+            fprintf(f, "\t\t<key>Firmware Config</key>\n\t\t<data>\n");
+            memset(&bo, 0, sizeof(bo));
+            bo.f = f;
+            bo.indent = "\t\t";
+            for(i=0; i<cfglen; i++)
+                b64_byte(&bo, cfg[i]);
+            b64_end(&bo);
+            fprintf(f, "\t\t</data>\n");
+            free(cfg);
+        }
+        fprintf(f, "\t\t<key>Enabled</key>\n\t\t<%s/>\n\t\t<key>Interface</key>\n\t\t<integer>%u</integer>\n\t</dict>\n",
+                p % 5 ? "true" : "false", p % 3);
+    }
+    fprintf(f, "</dict>\n</plist>\n");
+    if(fclose(f)) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return 1;
+    }
+    free(path);
+    return 0;
+}
@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Sidecar index for XML mtprops files. <file>.idx records the byte range
+ * of every top-level key/value pair, so one personality can be parsed
+ * without tokenizing the rest of the file. The index is only used while
+ * the file size and mtime match, and every range read back must match its
+ * recorded hash. IDREFs that leave a range are listed under its key and
+ * the referenced elements are parsed alongside it. Loads never write the
+ * index; it is built ahead of time with hx-touchd -i:
+ *
+ *   mtidx 1 <size> <mtime sec> <mtime nsec>
+ *   id <offs> <len> <hash> <name>
+ *   key <offs> <len> <hash> <nrefs> <name>
+ *   ref <name>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "qdict.h"
+#include "eplist.h"
+#include "mtidx.h"
+
+#define MTIDX_MAGIC     "mtidx 1"
+#define MTIDX_SUFFIX    ".idx"
+#define MTIDX_IDDEPTH   64
+
+#define MTIDX_HEAD      "<plist><dict>"
+#define MTIDX_MID       "</dict><stash>"
+#define MTIDX_TAIL      "</stash></plist>"
+
+struct mtidx_range_s {
+    unsigned long offs, len;
+    unsigned long long hash;
+};
+
+struct mtidx_list_s {
+    char **str;
+    unsigned count, alloc;
+};
+
+struct mtidx_id_s {
+    struct mtidx_range_s r;
+    struct mtidx_list_s refs;
+};
+
+struct mtidx_key_s {
+    struct mtidx_range_s r;
+    char *name;
+    struct mtidx_list_s refs;
+};
+
+struct mtidx_scan_s {
+    const char *base;
+    qdict *ids;
+    struct mtidx_key_s *keys;
+    unsigned nkeys, akeys;
+    struct mtidx_list_s refs;
+    struct {
+        struct mtidx_id_s *id;
+        int depth;
+    } open[MTIDX_IDDEPTH];
+    int nopen, dup;
+};
+
+static unsigned long long mtidx_hash(const void *data, unsigned long len)
+{
+    const unsigned char *p = data;
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    while(len --)
+        hash = (hash ^ *(p ++)) * 0x100000001b3ull;
+    return hash;
+}
+
+static char *mtidx_path(const char *fname, const char *suffix)
+{
+    char *path = malloc(strlen(fname) + strlen(suffix) + 1);
+    if(path) {
+        strcpy(path, fname);
+        strcat(path, suffix);
+    }
+    return path;
+}
+
+static int mtidx_list_add(struct mtidx_list_s *list, const char *str)
+{
+    char **nstr;
+    unsigned i;
+
+    for(i=0; i<list->count; i++)
+        if(!strcmp(list->str[i], str))
+            return 0;
+    if(list->count == list->alloc) {
+        list->alloc = list->alloc ? list->alloc * 2 : 8;
+        nstr = realloc(list->str, list->alloc * sizeof(char *));
+        if(!nstr)
+            return -1;
+        list->str = nstr;
+    }
+    list->str[list->count] = strdup(str);
+    if(!list->str[list->count])
+        return -1;
+    list->count ++;
+    return 0;
+}
+
+static void mtidx_list_free(struct mtidx_list_s *list)
+{
+    unsigned i;
+    for(i=0; i<list->count; i++)
+        free(list->str[i]);
+    free(list->str);
+    list->str = NULL;
+    list->count = list->alloc = 0;
+}
+
+static void mtidx_range_set(struct mtidx_scan_s *sc, struct mtidx_range_s *r, unsigned long offs, unsigned long len)
+{
+    r->offs = offs;
+    r->len = len;
+    r->hash = mtidx_hash(sc->base + offs, len);
+}
+
+static int mtidx_entry(void *param, const char *key, unsigned long offs, unsigned long len)
+{
+    struct mtidx_scan_s *sc = param;
+    struct mtidx_key_s *keys, *mk;
+
+    if(!key || strchr(key, '\n')) {
+        mtidx_list_free(&sc->refs);
+        return 0;
+    }
+    if(sc->nkeys == sc->akeys) {
+        sc->akeys = sc->akeys ? sc->akeys * 2 : 16;
+        keys = realloc(sc->keys, sc->akeys * sizeof(struct mtidx_key_s));
+        if(!keys)
+            return -1;
+        sc->keys = keys;
+    }
+    mk = &sc->keys[sc->nkeys];
+    mk->name = strdup(key);
+    if(!mk->name)
+        return -1;
+    mtidx_range_set(sc, &mk->r, offs, len);
+    mk->refs = sc->refs;
+    memset(&sc->refs, 0, sizeof(sc->refs));
+    sc->nkeys ++;
+    return 0;
+}
+
+static int mtidx_element(void *param, int depth, unsigned long offs, const char *idname, const char *ref)
+{
+    struct mtidx_scan_s *sc = param;
+    struct mtidx_id_s *id;
+    int i;
+
+    if(ref) {
+        for(i=0; i<sc->nopen; i++)
+            if(mtidx_list_add(&sc->open[i].id->refs, ref))
+                return -1;
+        if(mtidx_list_add(&sc->refs, ref))
+            return -1;
+    }
+    if(!idname)
+        return 0;
+    if(sc->nopen == MTIDX_IDDEPTH || strchr(idname, '\n'))
+        return -1;
+    id = qdict_find(sc->ids, idname, QDICT_ADD);
+    if(!id) {
+        /* a full load resolves to the first definition; don't try to match that */
+        sc->dup = 1;
+        return 0;
+    }
+    id->r.offs = offs;
+    sc->open[sc->nopen].id = id;
+    sc->open[sc->nopen ++].depth = depth;
+    return 0;
+}
+
+static int mtidx_close(void *param, int depth, unsigned long end)
+{
+    struct mtidx_scan_s *sc = param;
+    struct mtidx_id_s *id;
+
+    if(sc->nopen && sc->open[sc->nopen - 1].depth == depth) {
+        id = sc->open[-- sc->nopen].id;
+        mtidx_range_set(sc, &id->r, id->r.offs, end - id->r.offs);
+    }
+    return 0;
+}
+
+static const eplist_scan_ops_t mtidx_scan_ops = { mtidx_entry, mtidx_element, mtidx_close };
+
+static struct mtidx_id_s *mtidx_id(qdict *ids, const char *name)
+{
+    return qdict_find(ids, name, QDICT_FIND);
+}
+
+/* IDs a key needs that are defined outside its own range, transitively */
+static int mtidx_key_deps(qdict *ids, struct mtidx_key_s *key, struct mtidx_list_s *deps)
+{
+    struct mtidx_list_s seen = { 0 };
+    struct mtidx_id_s *id;
+    unsigned i, j;
+    int ret = -1;
+
+    for(i=0; i<key->refs.count; i++)
+        if(mtidx_list_add(&seen, key->refs.str[i]))
+            goto out;
+    for(i=0; i<seen.count; i++) {
+        id = mtidx_id(ids, seen.str[i]);
+        if(!id || (id->r.offs >= key->r.offs && id->r.offs < key->r.offs + key->r.len))
+            continue;
+        if(mtidx_list_add(deps, seen.str[i]))
+            goto out;
+        for(j=0; j<id->refs.count; j++)
+            if(mtidx_list_add(&seen, id->refs.str[j]))
+                goto out;
+    }
+    ret = 0;
+out:
+    mtidx_list_free(&seen);
+    return ret;
+}
+
+struct mtidx_write_s {
+    FILE *f;
+};
+
+static void mtidx_write_id(void *param, const char *str, void *elem)
+{
+    struct mtidx_write_s *wr = param;
+    struct mtidx_id_s *id = elem;
+    fprintf(wr->f, "id %lu %lu %016llx %s\n", id->r.offs, id->r.len, id->r.hash, str);
+}
+
+static void mtidx_free_id(void *param, const char *str, void *elem)
+{
+    struct mtidx_id_s *id = elem;
+    mtidx_list_free(&id->refs);
+}
+
+static int mtidx_write(struct mtidx_scan_s *sc, const char *fname, struct stat *st)
+{
+    struct mtidx_list_s deps = { 0 };
+    struct mtidx_write_s wr;
+    char *tmp, *path, sfx[32];
+    int ret = -1, fail = 0;
+    unsigned i, j;
+
+    snprintf(sfx, sizeof(sfx), MTIDX_SUFFIX ".%d", (int)getpid());
+    tmp = mtidx_path(fname, sfx);
+    path = mtidx_path(fname, MTIDX_SUFFIX);
+    if(!tmp || !path)
+        goto out;
+    wr.f = fopen(tmp, "w");
+    if(!wr.f)
+        goto out;
+
+    fprintf(wr.f, MTIDX_MAGIC " %lu %lu %lu\n", (unsigned long)st->st_size,
+            (unsigned long)st->st_mtim.tv_sec, (unsigned long)st->st_mtim.tv_nsec);
+    if(!sc->dup) {
+        qdict_iter(sc->ids, mtidx_write_id, &wr);
+        for(i=0; i<sc->nkeys; i++) {
+            if(mtidx_key_deps(sc->ids, &sc->keys[i], &deps)) {
+                fail = 1;
+                break;
+            }
+            fprintf(wr.f, "key %lu %lu %016llx %u %s\n", sc->keys[i].r.offs, sc->keys[i].r.len,
+                    sc->keys[i].r.hash, deps.count, sc->keys[i].name);
+            for(j=0; j<deps.count; j++)
+                fprintf(wr.f, "ref %s\n", deps.str[j]);
+            mtidx_list_free(&deps);
+        }
+    }
+
+    if(fclose(wr.f) || fail || rename(tmp, path))
+        unlink(tmp);
+    else
+        ret = 0;
+out:
+    mtidx_list_free(&deps);
+    free(tmp);
+    free(path);
+    return ret;
+}
+
+int mtidx_build(const char *fname, FILE *f)
+{
+    struct mtidx_scan_s sc;
+    struct stat st;
+    unsigned i;
+    void *map;
+    int ret = -1;
+
+    if(fstat(fileno(f), &st) || st.st_size < 8)
+        return -1;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if(map == MAP_FAILED)
+        return -1;
+    if(!memcmp(map, "bplist", 6)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    memset(&sc, 0, sizeof(sc));
+    sc.base = map;
+    sc.ids = qdict_new_ex(sizeof(struct mtidx_id_s), QDICT_ARENA);
+    if(sc.ids) {
+        /* a file the scanner can't follow still gets an index, just without keys */
+        if(eplist_scan(map, st.st_size, &mtidx_scan_ops, &sc))
+            sc.dup = 1;
+        ret = mtidx_write(&sc, fname, &st);
+        qdict_iter(sc.ids, mtidx_free_id, NULL);
+        qdict_free(sc.ids);
+    }
+
+    for(i=0; i<sc.nkeys; i++) {
+        free(sc.keys[i].name);
+        mtidx_list_free(&sc.keys[i].refs);
+    }
+    free(sc.keys);
+    mtidx_list_free(&sc.refs);
+    munmap(map, st.st_size);
+    return ret;
+}
+
+static int mtidx_read_range(FILE *f, const struct mtidx_range_s *r, unsigned long size, char *buf)
+{
+    unsigned long pos = 0;
+    ssize_t res;
+
+    if(r->offs > size || r->len > size - r->offs)
+        return -1;
+    while(pos < r->len) {
+        res = pread(fileno(f), buf + pos, r->len - pos, r->offs + pos);
+        if(res <= 0)
+            return -1;
+        pos += res;
+    }
+    return mtidx_hash(buf, r->len) == r->hash ? 0 : -1;
+}
+
+/*
+ * Returns -1 when there is no usable index for the file. Otherwise *ptext
+ * is a document holding just the key (to be freed by the caller), or NULL
+ * if the index has no range for it.
+ */
+int mtidx_lookup(const char *fname, FILE *f, const char *key, char **ptext)
+{
+    unsigned long size, sec, nsec, total, pos;
+    struct mtidx_list_s refs = { 0 };
+    struct mtidx_range_s krange, *ir;
+    char *path, *line = NULL, *text = NULL;
+    int found = 0, inkey = 0, ret = -1, n;
+    size_t lsize = 0;
+    qdict *ids;
+    struct stat st;
+    ssize_t len;
+    FILE *fi;
+    unsigned i;
+
+    *ptext = NULL;
+    if(fstat(fileno(f), &st))
+        return -1;
+    path = mtidx_path(fname, MTIDX_SUFFIX);
+    if(!path)
+        return -1;
+    fi = fopen(path, "r");
+    free(path);
+    if(!fi)
+        return -1;
+    ids = qdict_new_ex(sizeof(struct mtidx_range_s), QDICT_HASH);
+    if(!ids) {
+        fclose(fi);
+        return -1;
+    }
+
+    if(fscanf(fi, MTIDX_MAGIC " %lu %lu %lu\n", &size, &sec, &nsec) != 3 || size != (unsigned long)st.st_size ||
+       sec != (unsigned long)st.st_mtim.tv_sec || nsec != (unsigned long)st.st_mtim.tv_nsec)
+        goto out;
+
+    while((len = getline(&line, &lsize, fi)) > 0) {
+        if(line[len - 1] == '\n')
+            line[-- len] = 0;
+        if(!strncmp(line, "id ", 3)) {
+            inkey = 0;
+            if(sscanf(line, "id %lu %lu %llx%n", &krange.offs, &krange.len, &krange.hash, &n) != 3 || line[n] != ' ')
+                goto out;
+            ir = qdict_find(ids, line + n + 1, QDICT_ADD);
+            if(ir)
+                *ir = krange;
+        } else if(!strncmp(line, "key ", 4)) {
+            inkey = 0;
+            if(found)
+                continue;
+            if(sscanf(line, "key %lu %lu %llx %u%n", &krange.offs, &krange.len, &krange.hash, &i, &n) != 4 || line[n] != ' ')
+                goto out;
+            if(!strcmp(line + n + 1, key))
+                found = inkey = 1;
+        } else if(!strncmp(line, "ref ", 4)) {
+            if(inkey && mtidx_list_add(&refs, line + 4))
+                goto out;
+        } else
+            goto out;
+    }
+
+    ret = 0;
+    if(!found)
+        goto out;
+
+    total = strlen(MTIDX_HEAD) + krange.len + strlen(MTIDX_MID) + strlen(MTIDX_TAIL) + 1;
+    for(i=0; i<refs.count; i++) {
+        ir = qdict_find(ids, refs.str[i], QDICT_FIND);
+        if(!ir) {
+            ret = -1;
+            goto out;
+        }
+        total += ir->len;
+    }
+    text = malloc(total);
+    if(!text)
+        goto out;
+
+    ret = -1;
+    strcpy(text, MTIDX_HEAD);
+    pos = strlen(MTIDX_HEAD);
+    if(mtidx_read_range(f, &krange, size, text + pos))
+        goto out;
+    pos += krange.len;
+    strcpy(text + pos, MTIDX_MID);
+    pos += strlen(MTIDX_MID);
+    for(i=0; i<refs.count; i++) {
+        ir = qdict_find(ids, refs.str[i], QDICT_FIND);
+        if(mtidx_read_range(f, ir, size, text + pos))
+            goto out;
+        pos += ir->len;
+    }
+    strcpy(text + pos, MTIDX_TAIL);
+    *ptext = text;
+    text = NULL;
+    ret = 0;
+
+out:
+    free(text);
+    free(line);
+    mtidx_list_free(&refs);
+    qdict_free(ids);
+    fclose(fi);
+    return ret;
+}
@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+#ifndef _MTIDX_H
+#define _MTIDX_H
+
+#include <stdio.h>
+
+int mtidx_lookup(const char *fname, FILE *f, const char *key, char **ptext);
+int mtidx_build(const char *fname, FILE *f);
+
+#endif
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Small LZ77 block codec in the spirit of LZ4: each sequence is a token
+ * byte (literal count in the high nibble, match length - 4 in the low
+ * nibble, 15 meaning "more length bytes follow"), the literals, and a
+ * 16-bit little-endian match offset. The final sequence has no match.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "mtlz.h"
+
+#define MTLZ_MINMATCH   4
+#define MTLZ_HASHLOG    12
+#define MTLZ_MAXOFFS    65535
+
+static inline uint32_t mtlz_read32(const uint8_t *p)
+{
+    uint32_t val;
+    memcpy(&val, p, 4);
+    return val;
+}
+
+static inline unsigned mtlz_hash(uint32_t val)
+{
+    return (val * 2654435761u) >> (32 - MTLZ_HASHLOG);
+}
+
+static uint8_t *mtlz_put_token(uint8_t *op, uint8_t *oend, const uint8_t *lit, unsigned nlit, unsigned offs, unsigned mlen)
+{
+    uint8_t *token;
+    unsigned len;
+
+    if(op + 1 + nlit / 255 + 1 + nlit + 2 + mlen / 255 + 1 > oend)
+        return NULL;
+
+    token = op ++;
+    *token = (nlit < 15 ? nlit : 15) << 4;
+    if(nlit >= 15) {
+        for(len=nlit-15; len>=255; len-=255)
+            *(op ++) = 255;
+        *(op ++) = len;
+    }
+    memcpy(op, lit, nlit);
+    op += nlit;
+
+    if(!offs)
+        return op;
+
+    *(op ++) = offs;
+    *(op ++) = offs >> 8;
+    mlen -= MTLZ_MINMATCH;
+    *token |= mlen < 15 ? mlen : 15;
+    if(mlen >= 15) {
+        for(len=mlen-15; len>=255; len-=255)
+            *(op ++) = 255;
+        *(op ++) = len;
+    }
+    return op;
+}
+
+unsigned mtlz_compress(const void *src, unsigned size, void *dst, unsigned dsize)
+{
+    const uint8_t *base = src, *ip = base, *anchor = base, *iend = base + size, *match;
+    uint8_t *op = dst, *oend = op + dsize;
+    uint32_t table[1 << MTLZ_HASHLOG];
+    unsigned h, ref, len;
+
+    memset(table, 0, sizeof(table));
+
+    while(iend - ip >= MTLZ_MINMATCH) {
+        h = mtlz_hash(mtlz_read32(ip));
+        ref = table[h];
+        table[h] = ip - base + 1;
+        if(!ref) {
+            ip ++;
+            continue;
+        }
+        match = base + ref - 1;
+        if(ip - match > MTLZ_MAXOFFS || mtlz_read32(match) != mtlz_read32(ip)) {
+            ip ++;
+            continue;
+        }
+
+        for(len=MTLZ_MINMATCH; ip+len<iend && match[len]==ip[len]; len++)
+            ;
+
+        op = mtlz_put_token(op, oend, anchor, ip - anchor, ip - match, len);
+        if(!op)
+            return 0;
+        ip += len;
+        anchor = ip;
+    }
+
+    op = mtlz_put_token(op, oend, anchor, iend - anchor, 0, 0);
+    if(!op)
+        return 0;
+    return op - (uint8_t *)dst;
+}
+
+int mtlz_decompress(const void *src, unsigned size, void *dst, unsigned dsize)
+{
+    const uint8_t *ip = src, *iend = ip + size, *match;
+    uint8_t *op = dst, *oend = op + dsize;
+    unsigned token, len, offs, ext;
+
+    while(ip < iend) {
+        token = *(ip ++);
+
+        len = token >> 4;
+        if(len == 15)
+            do {
+                if(ip >= iend)
+                    return -1;
+                ext = *(ip ++);
+                len += ext;
+            } while(ext == 255);
+        if(len > iend - ip || len > oend - op)
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        if(ip >= iend)
+            break;
+
+        if(iend - ip < 2)
+            return -1;
+        offs = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(!offs || offs > op - (uint8_t *)dst)
+            return -1;
+
+        len = token & 15;
+        if(len == 15)
+            do {
+                if(ip >= iend)
+                    return -1;
+                ext = *(ip ++);
+                len += ext;
+            } while(ext == 255);
+        len += MTLZ_MINMATCH;
+        if(len > oend - op)
+            return -1;
+
+        match = op - offs;
+        if(offs >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else
+            while(len --)
+                *(op ++) = *(match ++);
+    }
+
+    return op - (uint8_t *)dst;
+}
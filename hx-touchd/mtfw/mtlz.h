@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+#ifndef _MTLZ_H
+#define _MTLZ_H
+
+unsigned mtlz_compress(const void *src, unsigned size, void *dst, unsigned dsize);
+int mtlz_decompress(const void *src, unsigned size, void *dst, unsigned dsize);
+
+#endif
@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2020 Corellium LLC
+ */
+
+/*
+ * Insert and lookup throughput of the qdict backends from 1e3 keys up, one
+ * key at a time and through the sorted bulk calls, whose results are checked
+ * against qdict_find. Each run is a child process so its peak RSS can be
+ * reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "qdict.h"
+
+static const struct {
+    const char *name;
+    unsigned flags;
+} backends[] = {
+    { "avl", 0 },
+    { "arena", QDICT_ARENA },
+    { "hash", QDICT_HASH },
+};
+#define NBACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static unsigned long long rng_state = 0x2545f4914f6cdd1dull;
+
+static unsigned rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state >> 32;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* keys look like the plist IDs and personality names eplist indexes */
+static char **make_keys(unsigned n, unsigned salt)
+{
+    char **keys = malloc(n * sizeof(char *)), buf[32];
+    unsigned i;
+
+    if(!keys)
+        return NULL;
+    for(i=0; i<n; i++) {
+        if(i & 1)
+            snprintf(buf, sizeof(buf), "%u", i * 2 + salt);
+        else
+            snprintf(buf, sizeof(buf), "C1F%uD,%u", i * 2 + salt, i % 3 + 1);
+        keys[i] = strdup(buf);
+        if(!keys[i])
+            return NULL;
+    }
+    return keys;
+}
+
+static void shuffle(char **keys, unsigned n)
+{
+    unsigned i, j;
+    char *t;
+
+    for(i=n-1; i>0; i--) {
+        j = rng() % (i + 1);
+        t = keys[i];
+        keys[i] = keys[j];
+        keys[j] = t;
+    }
+}
+
+static int key_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* sorted build with repeated keys, then a sorted batch of hits and misses */
+static unsigned bench_sorted(char **keys, char **miss, unsigned n, unsigned flags, double *t_build, double *t_batch)
+{
+    unsigned ns = n + n / 8, nq = 2 * n, i, fails = 0;
+    char **srt = malloc(ns * sizeof(char *)), **q = malloc(nq * sizeof(char *));
+    void **elems = malloc(nq * sizeof(void *));
+    qdict *dict;
+    double t;
+
+    if(!srt || !q || !elems)
+        return 1;
+    memcpy(srt, keys, n * sizeof(char *));
+    for(i=n; i<ns; i++)
+        srt[i] = keys[(i - n) * 8];
+    qsort(srt, ns, sizeof(char *), key_cmp);
+    memcpy(q, keys, n * sizeof(char *));
+    memcpy(q + n, miss, n * sizeof(char *));
+    qsort(q, nq, sizeof(char *), key_cmp);
+
+    t = now();
+    dict = qdict_build_sorted(sizeof(void *), flags, (const char *const *)srt, ns, elems);
+    *t_build = now() - t;
+    if(!dict)
+        return 1;
+    for(i=0; i<ns; i++)
+        if(i && !strcmp(srt[i - 1], srt[i])) {
+            if(elems[i])
+                fails ++;
+        } else if(!elems[i] || qdict_find(dict, srt[i], QDICT_FIND) != elems[i])
+            fails ++;
+
+    t = now();
+    qdict_find_many(dict, (const char *const *)q, nq, elems);
+    *t_batch = now() - t;
+    for(i=0; i<nq; i++)
+        if(qdict_find(dict, q[i], QDICT_FIND) != elems[i])
+            fails ++;
+
+    qdict_free(dict);
+    free(srt);
+    free(q);
+    free(elems);
+    return fails;
+}
+
+static void bench(unsigned n, unsigned flags)
+{
+    char **keys = make_keys(n, 0), **miss = make_keys(n, 1);
+    double t, t_add, t_hit, t_miss, t_free, t_build = 0, t_batch = 0;
+    unsigned i, fails = 0;
+    qdict *dict;
+
+    if(!keys || !miss) {
+        printf("out of memory");
+        return;
+    }
+    shuffle(keys, n);
+
+    t = now();
+    dict = qdict_new_ex(sizeof(void *), flags);
+    for(i=0; i<n; i++)
+        if(!qdict_find(dict, keys[i], QDICT_ADD))
+            fails ++;
+    t_add = now() - t;
+
+    shuffle(keys, n);
+    t = now();
+    for(i=0; i<n; i++)
+        if(!qdict_find(dict, keys[i], QDICT_FIND))
+            fails ++;
+    t_hit = now() - t;
+
+    t = now();
+    for(i=0; i<n; i++)
+        if(qdict_find(dict, miss[i], QDICT_FIND))
+            fails ++;
+    t_miss = now() - t;
+
+    t = now();
+    qdict_free(dict);
+    t_free = now() - t;
+
+    fails += bench_sorted(keys, miss, n, flags, &t_build, &t_batch);
+
+    printf("%9.1f %9.1f %9.1f %9.1f %9.1f ns/op %9.2f ms free%s", t_add * 1e9 / n, t_hit * 1e9 / n,
+           t_miss * 1e9 / n, t_build * 1e9 / (n + n / 8), t_batch * 1e9 / (2 * n), t_free * 1e3,
+           fails ? " FAILED" : "");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: qdbench [-m max-keys]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long max = 10000000, n;
+    struct rusage ru;
+    unsigned b;
+    int opt, status;
+    pid_t pid;
+
+    while((opt = getopt(argc, argv, "m:")) != -1) {
+        switch(opt) {
+        case 'm': max = strtoul(optarg, NULL, 0); break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if(optind != argc) {
+        usage();
+        return 1;
+    }
+
+    printf("%-9s %-6s %9s %9s %9s %9s %9s\n", "keys", "dict", "insert", "hit", "miss", "build", "batch");
+    for(n=1000; n<=max; n*=10)
+        for(b=0; b<NBACKENDS; b++) {
+            printf("%-9lu %-6s", n, backends[b].name);
+            fflush(stdout);
+            pid = fork();
+            if(!pid) {
+                bench(n, backends[b].flags);
+                fflush(stdout);
+                _exit(0);
+            }
+            if(pid < 0 || wait4(pid, &status, 0, &ru) < 0) {
+                printf("failed to run\n");
+                continue;
+            }
+            printf("  %8ld KiB peak\n", ru.ru_maxrss);
+        }
+    return 0;
+}
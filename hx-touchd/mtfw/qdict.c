@@ -7,29 +7,69 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "qdict.h"
 
+/* both node layouts keep the key pointer right before the element */
 typedef struct qelem_s {
     unsigned depth;
     struct qelem_s *left, *right, *parent, **up;
     char *str;
 } qelem;
 
+/*
+ * Arena nodes are carved from QDICT_CHUNK-sized slabs with the key stored
+ * after the element; children are 32-bit indices (slab << QDICT_IDXBITS |
+ * offset / 8), 0 being none. Nothing is freed until the whole dictionary.
+ */
+typedef struct qnode_s {
+    uint32_t left, right;
+    uint32_t height;
+    char *str;
+} qnode;
+
+#define QDICT_IDXBITS   13
+#define QDICT_CHUNK     (8u << QDICT_IDXBITS)
+
+/*
+ * Hash mode keeps arena nodes in an open-addressing table of (hash, node)
+ * slots probed a group at a time. Growing leaves the old table in place
+ * and moves QDICT_MIGRATE slots over on every insert.
+ */
+typedef struct qslot_s {
+    uint32_t hash, node;
+} qslot;
+
+#define QDICT_GROUP     8
+#define QDICT_MIGRATE   64
+
 struct qdict_s {
     int size;
+    unsigned flags;
     qelem *root;
+    uint32_t aroot;
+    char **chunks;
+    unsigned nchunks, achunks, used;
+    qslot *slots, *oslots;
+    unsigned mask, omask, count, migrated;
 };
 
-qdict *qdict_new(int size)
+qdict *qdict_new_ex(int size, unsigned flags)
 {
     qdict *dict = calloc(1, sizeof(qdict));
     if(!dict)
         return dict;
     dict->size = size;
+    dict->flags = flags;
     return dict;
 }
 
+qdict *qdict_new(int size)
+{
+    return qdict_new_ex(size, 0);
+}
+
 static int qdict_delta(qelem *elem)
 {
     int res = 0;
@@ -112,12 +152,286 @@ static void qdict_rebalance(qelem *elem)
     }
 }
 
+static inline qnode *qdict_node(qdict *dict, uint32_t idx)
+{
+    return (qnode *)(dict->chunks[idx >> QDICT_IDXBITS] + ((idx & ((1u << QDICT_IDXBITS) - 1)) << 3));
+}
+
+static inline uint32_t qdict_height(qdict *dict, uint32_t idx)
+{
+    return idx ? qdict_node(dict, idx)->height : 0;
+}
+
+static uint32_t qdict_alloc(qdict *dict, const char *str)
+{
+    unsigned long klen = strlen(str) + 1, need = (sizeof(qnode) + dict->size + klen + 7) & ~7ul;
+    char **chunks;
+    qnode *node;
+    uint32_t idx;
+
+    /* a slab holds one node at least; the first slab's offset 0 stands for none */
+    if(!dict->nchunks || dict->used + need > QDICT_CHUNK) {
+        if(dict->nchunks == dict->achunks) {
+            dict->achunks = dict->achunks ? dict->achunks * 2 : 16;
+            chunks = realloc(dict->chunks, dict->achunks * sizeof(char *));
+            if(!chunks)
+                return 0;
+            dict->chunks = chunks;
+        }
+        dict->chunks[dict->nchunks] = malloc(need + 8 > QDICT_CHUNK ? need + 8 : QDICT_CHUNK);
+        if(!dict->chunks[dict->nchunks])
+            return 0;
+        dict->nchunks ++;
+        dict->used = 8;
+    }
+
+    idx = ((dict->nchunks - 1) << QDICT_IDXBITS) | (dict->used >> 3);
+    node = qdict_node(dict, idx);
+    memset(node, 0, sizeof(qnode) + dict->size);
+    node->height = 1;
+    node->str = (char *)(node + 1) + dict->size;
+    memcpy(node->str, str, klen);
+    dict->used += need;
+    if(dict->used > QDICT_CHUNK)
+        dict->used = QDICT_CHUNK;
+    return idx;
+}
+
+static void qdict_fix(qdict *dict, qnode *node)
+{
+    uint32_t hl = qdict_height(dict, node->left), hr = qdict_height(dict, node->right);
+    node->height = (hl > hr ? hl : hr) + 1;
+}
+
+static uint32_t qdict_rotate(qdict *dict, uint32_t idx, int right)
+{
+    qnode *node = qdict_node(dict, idx), *pivot;
+    uint32_t pidx;
+
+    if(right) {
+        pidx = node->left;
+        pivot = qdict_node(dict, pidx);
+        node->left = pivot->right;
+        pivot->right = idx;
+    } else {
+        pidx = node->right;
+        pivot = qdict_node(dict, pidx);
+        node->right = pivot->left;
+        pivot->left = idx;
+    }
+    qdict_fix(dict, node);
+    qdict_fix(dict, pivot);
+    return pidx;
+}
+
+/* returns the new subtree root; *pnew is the added node, or the existing one negated */
+static uint32_t qdict_insert(qdict *dict, uint32_t idx, const char *str, int64_t *pnew)
+{
+    qnode *node, *child;
+    uint32_t sub;
+    int delta, cmp;
+
+    if(!idx)
+        return *pnew = qdict_alloc(dict, str);
+
+    node = qdict_node(dict, idx);
+    cmp = strcmp(str, node->str);
+    if(!cmp) {
+        *pnew = -(int64_t)idx;
+        return idx;
+    }
+    if(cmp < 0) {
+        sub = qdict_insert(dict, node->left, str, pnew);
+        node->left = sub;
+    } else {
+        sub = qdict_insert(dict, node->right, str, pnew);
+        node->right = sub;
+    }
+    if(*pnew <= 0)
+        return idx;
+
+    qdict_fix(dict, node);
+    delta = (int)qdict_height(dict, node->right) - (int)qdict_height(dict, node->left);
+    if(delta < -1) {
+        child = qdict_node(dict, node->left);
+        if(qdict_height(dict, child->right) > qdict_height(dict, child->left))
+            node->left = qdict_rotate(dict, node->left, 0);
+        return qdict_rotate(dict, idx, 1);
+    }
+    if(delta > 1) {
+        child = qdict_node(dict, node->right);
+        if(qdict_height(dict, child->left) > qdict_height(dict, child->right))
+            node->right = qdict_rotate(dict, node->right, 1);
+        return qdict_rotate(dict, idx, 0);
+    }
+    return idx;
+}
+
+static void *qdict_arena_find(qdict *dict, const char *str, unsigned mode)
+{
+    uint32_t idx = dict->aroot;
+    int64_t nidx = 0;
+    qnode *node;
+    int cmp;
+
+    if(!(mode & QDICT_ADD)) {
+        while(idx) {
+            node = qdict_node(dict, idx);
+            cmp = strcmp(str, node->str);
+            if(!cmp)
+                return node + 1;
+            idx = cmp < 0 ? node->left : node->right;
+        }
+        return NULL;
+    }
+
+    dict->aroot = qdict_insert(dict, dict->aroot, str, &nidx);
+    if(nidx < 0)
+        return (mode & QDICT_FIND) ? qdict_node(dict, -nidx) + 1 : NULL;
+    return nidx ? qdict_node(dict, nidx) + 1 : NULL;
+}
+
+static void qdict_arena_iter(qdict *dict, uint32_t idx, void(*func)(void *param, const char *str, void *elem), void *param)
+{
+    qnode *node;
+    while(idx) {
+        node = qdict_node(dict, idx);
+        if(node->left)
+            qdict_arena_iter(dict, node->left, func, param);
+        func(param, node->str, node + 1);
+        idx = node->right;
+    }
+}
+
+static uint32_t qdict_hash(const char *str)
+{
+    uint32_t h = 2166136261u;
+    while(*str)
+        h = (h ^ (unsigned char)*(str ++)) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+/* returns the matching slot, or the empty one ending the probe; str NULL matches nothing */
+static qslot *qdict_probe(qdict *dict, qslot *slots, unsigned mask, uint32_t h, const char *str)
+{
+    unsigned g = h & mask & ~(QDICT_GROUP - 1), i;
+    qslot *grp;
+
+    for(;;) {
+        grp = slots + g;
+        for(i=0; i<QDICT_GROUP; i++) {
+            if(!grp[i].node)
+                return grp + i;
+            if(grp[i].hash == h && str && !strcmp(qdict_node(dict, grp[i].node)->str, str))
+                return grp + i;
+        }
+        g = (g + QDICT_GROUP) & mask;
+    }
+}
+
+static void qdict_migrate(qdict *dict, unsigned count)
+{
+    qslot *slot;
+
+    while(dict->oslots && count --) {
+        slot = dict->oslots + dict->migrated;
+        if(slot->node)
+            *qdict_probe(dict, dict->slots, dict->mask, slot->hash, NULL) = *slot;
+        if(dict->migrated ++ == dict->omask) {
+            free(dict->oslots);
+            dict->oslots = NULL;
+        }
+    }
+}
+
+static int qdict_grow(qdict *dict)
+{
+    unsigned size = dict->slots ? (dict->mask + 1) * 2 : 2 * QDICT_GROUP;
+    qslot *slots = calloc(size, sizeof(qslot));
+
+    if(!slots)
+        return -1;
+    qdict_migrate(dict, -1u);
+    dict->oslots = dict->slots;
+    dict->omask = dict->mask;
+    dict->migrated = 0;
+    dict->slots = slots;
+    dict->mask = size - 1;
+    return 0;
+}
+
+static void *qdict_hash_find(qdict *dict, const char *str, unsigned mode)
+{
+    uint32_t h = qdict_hash(str), idx;
+    qslot *slot = NULL;
+
+    if(dict->slots) {
+        slot = qdict_probe(dict, dict->slots, dict->mask, h, str);
+        if(!slot->node && dict->oslots)
+            slot = qdict_probe(dict, dict->oslots, dict->omask, h, str);
+        if(slot->node)
+            return (mode & QDICT_FIND) ? qdict_node(dict, slot->node) + 1 : NULL;
+    }
+
+    if(!(mode & QDICT_ADD))
+        return NULL;
+    if(!dict->slots || (dict->count + 1) * 8 > (dict->mask + 1) * 7)
+        if(qdict_grow(dict))
+            return NULL;
+    qdict_migrate(dict, QDICT_MIGRATE);
+    idx = qdict_alloc(dict, str);
+    if(!idx)
+        return NULL;
+    slot = qdict_probe(dict, dict->slots, dict->mask, h, NULL);
+    slot->hash = h;
+    slot->node = idx;
+    dict->count ++;
+    return qdict_node(dict, idx) + 1;
+}
+
+static int qdict_cmp(const void *a, const void *b)
+{
+    return strcmp((*(qnode **)a)->str, (*(qnode **)b)->str);
+}
+
+/* iteration over a hash dict walks a sorted snapshot of its nodes */
+static void qdict_hash_iter(qdict *dict, void(*func)(void *param, const char *str, void *elem), void *param)
+{
+    qnode **nodes;
+    unsigned i, n = 0;
+
+    if(!dict->count)
+        return;
+    nodes = malloc(dict->count * sizeof(qnode *));
+    if(!nodes)
+        return;
+    for(i=0; i<=dict->mask; i++)
+        if(dict->slots[i].node)
+            nodes[n ++] = qdict_node(dict, dict->slots[i].node);
+    if(dict->oslots)
+        for(i=dict->migrated; i<=dict->omask; i++)
+            if(dict->oslots[i].node)
+                nodes[n ++] = qdict_node(dict, dict->oslots[i].node);
+    qsort(nodes, n, sizeof(qnode *), qdict_cmp);
+    for(i=0; i<n; i++)
+        func(param, nodes[i]->str, nodes[i] + 1);
+    free(nodes);
+}
+
 void *qdict_find(qdict *_dict, const char *str, unsigned mode)
 {
     qdict *dict = _dict;
     qelem **pelem = &(dict->root), *parent = NULL;
     int cmp;
 
+    if(dict->flags & QDICT_HASH)
+        return qdict_hash_find(dict, str, mode);
+    if(dict->flags & QDICT_ARENA)
+        return qdict_arena_find(dict, str, mode);
+
     while(*pelem) {
         cmp = strcmp(str, (*pelem)->str);
         if(!cmp) {
@@ -150,6 +464,171 @@ void *qdict_find(qdict *_dict, const char *str, unsigned mode)
     return parent + 1;
 }
 
+static qelem *qdict_link_sorted(qelem **elems, unsigned n, qelem *parent, qelem **up)
+{
+    unsigned mid = n / 2;
+    qelem *elem;
+
+    if(!n)
+        return NULL;
+    elem = elems[mid];
+    elem->parent = parent;
+    elem->up = up;
+    elem->left = qdict_link_sorted(elems, mid, elem, &elem->left);
+    elem->right = qdict_link_sorted(elems + mid + 1, n - mid - 1, elem, &elem->right);
+    qdict_update(elem);
+    return elem;
+}
+
+static uint32_t qdict_arena_link(qdict *dict, uint32_t *idxs, unsigned n)
+{
+    unsigned mid = n / 2;
+    qnode *node;
+
+    if(!n)
+        return 0;
+    node = qdict_node(dict, idxs[mid]);
+    node->left = qdict_arena_link(dict, idxs, mid);
+    node->right = qdict_arena_link(dict, idxs + mid + 1, n - mid - 1);
+    qdict_fix(dict, node);
+    return idxs[mid];
+}
+
+qdict *qdict_build_sorted(int size, unsigned flags, const char *const *strs, unsigned n, void **elems)
+{
+    qdict *dict = qdict_new_ex(size, flags);
+    qelem **list = NULL;
+    uint32_t *idxs = NULL;
+    unsigned i, nu = 0;
+    int cmp;
+
+    if(!dict)
+        return NULL;
+    if(n && (flags & (QDICT_ARENA | QDICT_HASH)) == QDICT_ARENA)
+        idxs = malloc(n * sizeof(uint32_t));
+    else if(n && !(flags & QDICT_HASH))
+        list = malloc(n * sizeof(qelem *));
+    if(n && !idxs && !list && !(flags & QDICT_HASH))
+        goto fail;
+
+    for(i=0; i<n; i++) {
+        if(i) {
+            cmp = strcmp(strs[i - 1], strs[i]);
+            if(cmp > 0)
+                goto fail;
+            if(!cmp) {
+                elems[i] = NULL;
+                continue;
+            }
+        }
+        if(flags & QDICT_HASH) {
+            elems[i] = qdict_hash_find(dict, strs[i], QDICT_ADD);
+            if(!elems[i])
+                goto fail;
+        } else if(idxs) {
+            idxs[nu] = qdict_alloc(dict, strs[i]);
+            if(!idxs[nu])
+                goto fail;
+            elems[i] = qdict_node(dict, idxs[nu ++]) + 1;
+        } else {
+            list[nu] = calloc(1, sizeof(qelem) + size);
+            if(!list[nu])
+                goto fail;
+            list[nu]->str = strdup(strs[i]);
+            if(!list[nu]->str) {
+                free(list[nu]);
+                goto fail;
+            }
+            elems[i] = list[nu ++] + 1;
+        }
+    }
+
+    if(idxs)
+        dict->aroot = qdict_arena_link(dict, idxs, nu);
+    else if(list)
+        dict->root = qdict_link_sorted(list, nu, NULL, &dict->root);
+    free(idxs);
+    free(list);
+    return dict;
+
+fail:
+    for(i=0; list && i<nu; i++) {
+        free(list[i]->str);
+        free(list[i]);
+    }
+    free(idxs);
+    free(list);
+    qdict_free(dict);
+    return NULL;
+}
+
+/* strs[lo..hi) are the ones equal to str */
+static void qdict_split(const char *const *strs, unsigned n, const char *str, unsigned *plo, unsigned *phi)
+{
+    unsigned lo = 0, hi = n, mid;
+
+    while(lo < hi) {
+        mid = (lo + hi) / 2;
+        if(strcmp(strs[mid], str) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *plo = lo;
+    for(hi=lo; hi<n && !strcmp(strs[hi], str); hi++)
+        ;
+    *phi = hi;
+}
+
+static void qdict_find_many_recurse(qelem *elem, const char *const *strs, unsigned n, void **elems)
+{
+    unsigned lo, hi, i;
+
+    if(!n)
+        return;
+    if(!elem) {
+        memset(elems, 0, n * sizeof(void *));
+        return;
+    }
+    qdict_split(strs, n, elem->str, &lo, &hi);
+    for(i=lo; i<hi; i++)
+        elems[i] = elem + 1;
+    qdict_find_many_recurse(elem->left, strs, lo, elems);
+    qdict_find_many_recurse(elem->right, strs + hi, n - hi, elems + hi);
+}
+
+static void qdict_arena_find_many(qdict *dict, uint32_t idx, const char *const *strs, unsigned n, void **elems)
+{
+    unsigned lo, hi, i;
+    qnode *node;
+
+    if(!n)
+        return;
+    if(!idx) {
+        memset(elems, 0, n * sizeof(void *));
+        return;
+    }
+    node = qdict_node(dict, idx);
+    qdict_split(strs, n, node->str, &lo, &hi);
+    for(i=lo; i<hi; i++)
+        elems[i] = node + 1;
+    qdict_arena_find_many(dict, node->left, strs, lo, elems);
+    qdict_arena_find_many(dict, node->right, strs + hi, n - hi, elems + hi);
+}
+
+void qdict_find_many(qdict *dict, const char *const *strs, unsigned n, void **elems)
+{
+    unsigned i;
+
+    if(dict->flags & QDICT_HASH) {
+        for(i=0; i<n; i++)
+            elems[i] = qdict_hash_find(dict, strs[i], QDICT_FIND);
+    } else if(dict->flags & QDICT_ARENA)
+        qdict_arena_find_many(dict, dict->aroot, strs, n, elems);
+    else
+        qdict_find_many_recurse(dict->root, strs, n, elems);
+}
+
 static void qdict_iter_recurse(qelem *elem, void(*func)(void *param, const char *str, void *elem), void *param)
 {
     if(elem->left)
@@ -162,14 +641,17 @@ static void qdict_iter_recurse(qelem *elem, void(*func)(void *param, const char
 void qdict_iter(qdict *_dict, void(*func)(void *param, const char *str, void *elem), void *param)
 {
     qdict *dict = _dict;
-    if(dict->root)
+    if(dict->flags & QDICT_HASH)
+        qdict_hash_iter(dict, func, param);
+    else if(dict->flags & QDICT_ARENA)
+        qdict_arena_iter(dict, dict->aroot, func, param);
+    else if(dict->root)
         qdict_iter_recurse(dict->root, func, param);
 }
 
 const char *qdict_str(void *_elem)
 {
-    qelem *elem = _elem;
-    return elem[-1].str;
+    return ((char **)_elem)[-1];
 }
 
 static void qdict_free_recurse(qelem *elem)
@@ -185,7 +667,13 @@ static void qdict_free_recurse(qelem *elem)
 void qdict_free(qdict *_dict)
 {
     qdict *dict = _dict;
+    unsigned i;
     if(dict->root)
         qdict_free_recurse(dict->root);
+    for(i=0; i<dict->nchunks; i++)
+        free(dict->chunks[i]);
+    free(dict->chunks);
+    free(dict->slots);
+    free(dict->oslots);
     free(dict);
 }
@@ -12,8 +12,18 @@ typedef struct qdict_s qdict;
 #define QDICT_FIND      2
 #define QDICT_ANY       3
 
+/* qdict_new_ex() flags: nodes and keys come from slabs freed with the dict */
+#define QDICT_ARENA     1
+/* arena nodes found through a hash table; qdict_iter() sorts a snapshot */
+#define QDICT_HASH      2
+
 qdict *qdict_new(int size);
+qdict *qdict_new_ex(int size, unsigned flags);
 void *qdict_find(qdict *dict, const char *str, unsigned mode);
+/* strs[] sorted by strcmp; elems[i] is NULL for a repeated key */
+qdict *qdict_build_sorted(int size, unsigned flags, const char *const *strs, unsigned n, void **elems);
+/* strs[] sorted by strcmp; elems[i] is NULL where not found */
+void qdict_find_many(qdict *dict, const char *const *strs, unsigned n, void **elems);
 void qdict_iter(qdict *dict, void(*func)(void *param, const char *str, void *elem), void *param);
 const char *qdict_str(void *elem);
 void qdict_free(qdict *dict);
@@ -0,0 +1,419 @@
+/*
+ * Arena node allocation for Mini-XML, a small XML file parsing library.
+ *
+ * https://www.msweet.org/mxml
+ *
+ * Copyright © 2003-2019 by Michael R Sweet.
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "config.h"
+#include "mxml-private.h"
+#include <stddef.h>
+
+
+/*
+ * The first block of an arena holds the arena header followed directly by
+ * the root node, so any node can find its arena by walking up to the root.
+ */
+
+#define _MXML_ARENA_FIRST	4096	/* Size of the first block */
+#define _MXML_ARENA_MAX		1048576	/* Largest size blocks grow to */
+#define _MXML_ARENA_ALIGN(n)	(((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define _MXML_ARENA_NAMES	64	/* Buckets for interned names */
+
+typedef struct _mxml_block_s		/**** Arena memory block ****/
+{
+  struct _mxml_block_s	*next;		/* Previously allocated block */
+  size_t		size;		/* Size of block */
+} _mxml_block_t;
+
+typedef struct _mxml_aref_s		/**** Custom node needing a destructor ****/
+{
+  struct _mxml_aref_s	*next;		/* Next reference */
+  mxml_node_t		*node;		/* Custom node */
+} _mxml_aref_t;
+
+typedef struct _mxml_name_s		/**** Interned element name ****/
+{
+  struct _mxml_name_s	*next;		/* Next name in bucket */
+  char			name[1];	/* Name string */
+} _mxml_name_t;
+
+
+/*
+ * Local functions...
+ */
+
+static char	*mxml_arena_strdup(_mxml_arena_t *arena, const char *s);
+static size_t	mxml_node_size(int flags);
+
+
+/*
+ * '_mxml_arena_alloc()' - Allocate memory from an arena.
+ */
+
+void *					/* O - Memory or @code NULL@ */
+_mxml_arena_alloc(_mxml_arena_t *arena,	/* I - Arena */
+                  size_t        size)	/* I - Number of bytes */
+{
+  _mxml_block_t	*block;			/* New block */
+  size_t	bsize;			/* Size of new block */
+  void		*ptr;			/* Allocated memory */
+
+
+  size = _MXML_ARENA_ALIGN(size);
+
+  if ((size_t)(arena->end - arena->ptr) < size)
+  {
+    bsize = arena->next_size;
+    if (bsize < size + sizeof(_mxml_block_t))
+      bsize = size + sizeof(_mxml_block_t);
+
+    if ((block = malloc(bsize)) == NULL)
+      return (NULL);
+
+    block->next   = arena->blocks;
+    block->size   = bsize;
+    arena->blocks = block;
+    arena->ptr    = (char *)(block + 1);
+    arena->end    = (char *)block + bsize;
+
+    if (arena->next_size < _MXML_ARENA_MAX)
+      arena->next_size *= 2;
+  }
+
+  ptr        = arena->ptr;
+  arena->ptr += size;
+
+  return (ptr);
+}
+
+
+/*
+ * '_mxml_arena_custom()' - Remember a custom node so its data is destroyed with the arena.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+_mxml_arena_custom(_mxml_arena_t *arena,/* I - Arena */
+                   mxml_node_t   *node)	/* I - Custom node */
+{
+  _mxml_aref_t	*ref;			/* New reference */
+
+
+  if ((ref = _mxml_arena_alloc(arena, sizeof(_mxml_aref_t))) == NULL)
+    return (-1);
+
+  ref->node      = node;
+  ref->next      = arena->customs;
+  arena->customs = ref;
+
+  return (0);
+}
+
+
+/*
+ * '_mxml_arena_delete()' - Free the arena owned by a root node.
+ *
+ * Custom data still attached to arena nodes is destroyed first.
+ */
+
+void
+_mxml_arena_delete(mxml_node_t *root)	/* I - Root node */
+{
+  _mxml_arena_t	*arena = (_mxml_arena_t *)root - 1;
+					/* Arena */
+  _mxml_aref_t	*ref;			/* Current custom reference */
+  _mxml_block_t	*block,			/* Current block */
+		*next;			/* Next block */
+
+
+  for (ref = arena->customs; ref; ref = ref->next)
+  {
+    if (ref->node->type == MXML_CUSTOM && ref->node->value.custom.data &&
+        ref->node->value.custom.destroy)
+      (*(ref->node->value.custom.destroy))(ref->node->value.custom.data);
+  }
+
+ /*
+  * The first block holds the arena itself, so free it last...
+  */
+
+  for (block = arena->blocks; block; block = next)
+  {
+    next = block->next;
+    free(block);
+  }
+}
+
+
+/*
+ * '_mxml_arena_get()' - Get the arena a node was allocated from.
+ */
+
+_mxml_arena_t *				/* O - Arena or @code NULL@ if none */
+_mxml_arena_get(mxml_node_t *node)	/* I - Node */
+{
+  for (; node; node = node->parent)
+  {
+    if (node->flags & _MXML_NODE_ROOT)
+      return ((_mxml_arena_t *)node - 1);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * '_mxml_arena_new()' - Create an arena and return its root node.
+ */
+
+mxml_node_t *				/* O - Root node or @code NULL@ */
+_mxml_arena_new(int flags)		/* I - MXML_ARENA/MXML_COMPACT */
+{
+  _mxml_block_t	*block;			/* First block */
+  _mxml_arena_t	*arena;			/* New arena */
+  mxml_node_t	*root;			/* Root node */
+  size_t	size = sizeof(_mxml_block_t) + sizeof(_mxml_arena_t) + mxml_node_size(flags);
+					/* Space used by the above */
+
+
+  if ((block = malloc(_MXML_ARENA_FIRST)) == NULL)
+    return (NULL);
+
+  block->next = NULL;
+  block->size = _MXML_ARENA_FIRST;
+
+  arena = (_mxml_arena_t *)(block + 1);
+  memset(arena, 0, sizeof(_mxml_arena_t));
+  arena->blocks    = block;
+  arena->ptr       = (char *)block + _MXML_ARENA_ALIGN(size);
+  arena->end       = (char *)block + _MXML_ARENA_FIRST;
+  arena->next_size = 2 * _MXML_ARENA_FIRST;
+  arena->flags     = flags;
+
+  root = (mxml_node_t *)(arena + 1);
+  memset(root, 0, mxml_node_size(flags));
+  root->flags = _MXML_NODE_ARENA | _MXML_NODE_ROOT |
+                ((flags & MXML_COMPACT) ? _MXML_NODE_COMPACT : 0);
+
+  return (root);
+}
+
+
+/*
+ * '_mxml_arena_node()' - Allocate a cleared node from an arena.
+ */
+
+mxml_node_t *				/* O - Node or @code NULL@ */
+_mxml_arena_node(_mxml_arena_t *arena)	/* I - Arena */
+{
+  mxml_node_t	*node;			/* New node */
+  size_t	size = mxml_node_size(arena->flags);
+					/* Size of node */
+
+
+  if ((node = _mxml_arena_alloc(arena, size)) == NULL)
+    return (NULL);
+
+  memset(node, 0, size);
+  node->flags = _MXML_NODE_ARENA |
+                ((arena->flags & MXML_COMPACT) ? _MXML_NODE_COMPACT : 0);
+
+  return (node);
+}
+
+
+/*
+ * '_mxml_node_adopt()' - Move an allocated string into the node's arena.
+ *
+ * The string is freed when the node is not an arena node or on failure.
+ */
+
+char *					/* O - String for the node or @code NULL@ */
+_mxml_node_adopt(mxml_node_t *node,	/* I - Node */
+                 char        *s)	/* I - Allocated string */
+{
+  char	*copy;				/* Arena copy */
+
+
+  if (!s || !(node->flags & _MXML_NODE_ARENA))
+    return (s);
+
+  copy = _mxml_node_strdup(node, s);
+  free(s);
+
+  return (copy);
+}
+
+
+/*
+ * '_mxml_node_intern()' - Get the shared copy of an element name for a node.
+ *
+ * Arenas created with @code MXML_INTERN@ keep one copy of each name, so
+ * names within a document can be compared by pointer.  Other nodes, and the
+ * comments, CDATA and declarations stored as elements, get their own copy.
+ */
+
+char *					/* O - Name for the node or @code NULL@ */
+_mxml_node_intern(mxml_node_t *node,	/* I - Node */
+                  const char  *s)	/* I - Element name */
+{
+  _mxml_arena_t	*arena;			/* Node's arena */
+  _mxml_name_t	*name,			/* Current name */
+		**bucket;		/* Bucket for name */
+  unsigned	hash;			/* Hash of name */
+  size_t	len;			/* Length of name */
+  const char	*ptr;			/* Pointer into name */
+
+
+  if (!(node->flags & _MXML_NODE_ARENA))
+    return (strdup(s));
+
+  if ((arena = _mxml_arena_get(node)) == NULL)
+    return (NULL);
+
+  if (!(arena->flags & MXML_INTERN) || *s == '!' || *s == '?')
+    return (mxml_arena_strdup(arena, s));
+
+  if (!arena->names)
+  {
+    if ((arena->names = _mxml_arena_alloc(arena, _MXML_ARENA_NAMES * sizeof(_mxml_name_t *))) == NULL)
+      return (NULL);
+
+    memset(arena->names, 0, _MXML_ARENA_NAMES * sizeof(_mxml_name_t *));
+  }
+
+  for (hash = 0, ptr = s; *ptr; ptr ++)
+    hash = hash * 31 + (unsigned char)*ptr;
+
+  bucket = arena->names + hash % _MXML_ARENA_NAMES;
+
+  for (name = *bucket; name; name = name->next)
+  {
+    if (!strcmp(name->name, s))
+      return (name->name);
+  }
+
+  len = strlen(s) + 1;
+  if ((name = _mxml_arena_alloc(arena, offsetof(_mxml_name_t, name) + len)) == NULL)
+    return (NULL);
+
+  memcpy(name->name, s, len);
+  name->next = *bucket;
+  *bucket    = name;
+
+  return (name->name);
+}
+
+
+/*
+ * '_mxml_node_strdup()' - Copy a string for a node.
+ */
+
+char *					/* O - Copy or @code NULL@ */
+_mxml_node_strdup(mxml_node_t *node,	/* I - Node */
+                  const char  *s)	/* I - String */
+{
+  _mxml_arena_t	*arena;			/* Node's arena */
+
+
+  if (!(node->flags & _MXML_NODE_ARENA))
+    return (strdup(s));
+
+  if ((arena = _mxml_arena_get(node)) == NULL)
+    return (NULL);
+
+  return (mxml_arena_strdup(arena, s));
+}
+
+
+/*
+ * '_mxml_node_strfree()' - Free a string owned by a node.
+ */
+
+void
+_mxml_node_strfree(mxml_node_t *node,	/* I - Node */
+                   char        *s)	/* I - String */
+{
+  if (!(node->flags & (_MXML_NODE_ARENA | _MXML_NODE_VIEW)))
+    free(s);
+}
+
+
+/*
+ * '_mxml_node_unview()' - Copy the mapped text of an opaque node.
+ *
+ * The copy comes from the node's arena or the heap and replaces the view.
+ */
+
+char *					/* O - Opaque string or @code NULL@ */
+_mxml_node_unview(mxml_node_t *node)	/* I - Opaque node */
+{
+  _mxml_arena_t	*arena;			/* Node's arena */
+  size_t	len;			/* Length of text */
+  char		*copy;			/* Copy */
+
+
+  if (!(node->flags & _MXML_NODE_VIEW))
+    return (node->value.opaque);
+
+  len = node->value.view.length;
+
+  if (!(node->flags & _MXML_NODE_ARENA))
+    copy = malloc(len + 1);
+  else if ((arena = _mxml_arena_get(node)) != NULL)
+    copy = _mxml_arena_alloc(arena, len + 1);
+  else
+    copy = NULL;
+
+  if (!copy)
+    return (NULL);
+
+  memcpy(copy, node->value.view.data, len);
+  copy[len] = '\0';
+
+  node->value.opaque = copy;
+  node->flags        &= ~_MXML_NODE_VIEW;
+
+  return (copy);
+}
+
+
+/*
+ * 'mxml_arena_strdup()' - Copy a string into an arena.
+ */
+
+static char *				/* O - Copy or @code NULL@ */
+mxml_arena_strdup(_mxml_arena_t *arena,	/* I - Arena */
+                  const char    *s)	/* I - String */
+{
+  size_t	len = strlen(s) + 1;	/* Length of string */
+  char		*copy;			/* Copy */
+
+
+  if ((copy = _mxml_arena_alloc(arena, len)) != NULL)
+    memcpy(copy, s, len);
+
+  return (copy);
+}
+
+
+/*
+ * 'mxml_node_size()' - Size of a node allocated with the given flags.
+ */
+
+static size_t				/* O - Size in bytes */
+mxml_node_size(int flags)		/* I - MXML_ARENA/MXML_COMPACT */
+{
+  if (flags & MXML_COMPACT)
+    return (_MXML_ARENA_ALIGN(offsetof(mxml_node_t, ref_count)));
+  else
+    return (sizeof(mxml_node_t));
+}
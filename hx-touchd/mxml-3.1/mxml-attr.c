@@ -68,8 +68,8 @@ mxmlElementDeleteAttr(mxml_node_t *node,/* I - Element */
       * Delete this attribute...
       */
 
-      free(attr->name);
-      free(attr->value);
+      _mxml_node_strfree(node, attr->name);
+      _mxml_node_strfree(node, attr->value);
 
       i --;
       if (i > 0)
@@ -77,7 +77,7 @@ mxmlElementDeleteAttr(mxml_node_t *node,/* I - Element */
 
       node->value.element.num_attrs --;
 
-      if (node->value.element.num_attrs == 0)
+      if (node->value.element.num_attrs == 0 && !(node->flags & _MXML_NODE_ARENA))
         free(node->value.element.attrs);
       return;
     }
@@ -217,12 +217,12 @@ mxmlElementSetAttr(mxml_node_t *node,	/* I - Element node */
     return;
 
   if (value)
-    valuec = strdup(value);
+    valuec = _mxml_node_strdup(node, value);
   else
     valuec = NULL;
 
-  if (mxml_set_attr(node, name, valuec))
-    free(valuec);
+  if (mxml_set_attr(node, name, valuec) && valuec)
+    _mxml_node_strfree(node, valuec);
 }
 
 
@@ -265,14 +265,14 @@ mxmlElementSetAttrf(mxml_node_t *node,	/* I - Element node */
   */
 
   va_start(ap, format);
-  value = _mxml_vstrdupf(format, ap);
+  value = _mxml_node_adopt(node, _mxml_vstrdupf(format, ap));
   va_end(ap);
 
   if (!value)
     mxml_error("Unable to allocate memory for attribute '%s' in element %s!",
                name, node->value.element.name);
   else if (mxml_set_attr(node, name, value))
-    free(value);
+    _mxml_node_strfree(node, value);
 }
 
 
@@ -303,7 +303,7 @@ mxml_set_attr(mxml_node_t *node,	/* I - Element node */
       */
 
       if (attr->value)
-        free(attr->value);
+        _mxml_node_strfree(node, attr->value);
 
       attr->value = value;
 
@@ -311,10 +311,18 @@ mxml_set_attr(mxml_node_t *node,	/* I - Element node */
     }
 
  /*
-  * Add a new attribute...
+  * Add a new attribute; arena arrays are copied rather than reallocated...
   */
 
-  if (node->value.element.num_attrs == 0)
+  if (node->flags & _MXML_NODE_ARENA)
+  {
+    _mxml_arena_t *arena = _mxml_arena_get(node);
+
+    attr = arena ? _mxml_arena_alloc(arena, (node->value.element.num_attrs + 1) * sizeof(_mxml_attr_t)) : NULL;
+    if (attr && node->value.element.num_attrs)
+      memcpy(attr, node->value.element.attrs, node->value.element.num_attrs * sizeof(_mxml_attr_t));
+  }
+  else if (node->value.element.num_attrs == 0)
     attr = malloc(sizeof(_mxml_attr_t));
   else
     attr = realloc(node->value.element.attrs,
@@ -330,7 +338,7 @@ mxml_set_attr(mxml_node_t *node,	/* I - Element node */
   node->value.element.attrs = attr;
   attr += node->value.element.num_attrs;
 
-  if ((attr->name = strdup(name)) == NULL)
+  if ((attr->name = _mxml_node_strdup(node, name)) == NULL)
   {
     mxml_error("Unable to allocate memory for attribute '%s' in element %s!",
                name, node->value.element.name);
@@ -24,23 +24,7 @@ int					/* O - 0 on success, -1 on failure */
 mxmlEntityAddCallback(
     mxml_entity_cb_t cb)		/* I - Callback function to add */
 {
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
-
-
-  if (global->num_entity_cbs < (int)(sizeof(global->entity_cbs) / sizeof(global->entity_cbs[0])))
-  {
-    global->entity_cbs[global->num_entity_cbs] = cb;
-    global->num_entity_cbs ++;
-
-    return (0);
-  }
-  else
-  {
-    mxml_error("Unable to add entity callback!");
-
-    return (-1);
-  }
+  return (mxmlOptionsAddEntityCallback(_mxml_global(), cb));
 }
 
 
@@ -83,17 +67,7 @@ mxmlEntityGetName(int val)		/* I - Character value */
 int					/* O - Character value or -1 on error */
 mxmlEntityGetValue(const char *name)	/* I - Entity name */
 {
-  int		i;			/* Looping var */
-  int		ch;			/* Character value */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
-
-
-  for (i = 0; i < global->num_entity_cbs; i ++)
-    if ((ch = (global->entity_cbs[i])(name)) >= 0)
-      return (ch);
-
-  return (-1);
+  return (_mxml_entity_value(_mxml_global(), name));
 }
 
 
@@ -105,26 +79,7 @@ void
 mxmlEntityRemoveCallback(
     mxml_entity_cb_t cb)		/* I - Callback function to remove */
 {
-  int		i;			/* Looping var */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
-
-
-  for (i = 0; i < global->num_entity_cbs; i ++)
-    if (cb == global->entity_cbs[i])
-    {
-     /*
-      * Remove the callback...
-      */
-
-      global->num_entity_cbs --;
-
-      if (i < global->num_entity_cbs)
-        memmove(global->entity_cbs + i, global->entity_cbs + i + 1,
-	        (global->num_entity_cbs - i) * sizeof(global->entity_cbs[0]));
-
-      return;
-    }
+  mxmlOptionsRemoveEntityCallback(_mxml_global(), cb);
 }
 
 
@@ -436,3 +391,24 @@ _mxml_entity_cb(const char *name)	/* I - Entity name */
   else
     return (-1);
 }
+
+
+/*
+ * '_mxml_entity_value()' - Get the character for a named entity using the given options.
+ */
+
+int					/* O - Character value or -1 on error */
+_mxml_entity_value(
+    _mxml_global_t *global,		/* I - Options */
+    const char     *name)		/* I - Entity name */
+{
+  int		i;			/* Looping var */
+  int		ch;			/* Character value */
+
+
+  for (i = 0; i < global->num_entity_cbs; i ++)
+    if ((ch = (global->entity_cbs[i])(name)) >= 0)
+      return (ch);
+
+  return (-1);
+}
@@ -17,6 +17,7 @@
 #  include <unistd.h>
 #endif /* !_WIN32 */
 #include "mxml-private.h"
+#include <limits.h>
 
 
 /*
@@ -35,46 +36,177 @@
 #define mxml_bad_char(ch) ((ch) < ' ' && (ch) != '\n' && (ch) != '\r' && (ch) != '\t')
 
 
+/*
+ * Macro to test for a character that can be copied as-is into text...
+ */
+
+#define mxml_plain_char(ch) ((ch) < 0x80 && (ch) != '<' && (ch) != '&' && !mxml_bad_char(ch))
+
+
+/*
+ * Shortest opaque text that MXML_DEFER_TEXT leaves in mapped data...
+ */
+
+#define _MXML_DEFER_MIN	256
+
+
+/*
+ * Size of the output buffers used when saving...
+ */
+
+#define _MXML_WRITE_SIZE	32768
+
+
 /*
  * Types and structures...
  */
 
 typedef int (*_mxml_getc_cb_t)(void *, int *);
-typedef int (*_mxml_putc_cb_t)(int, void *);
+typedef int (*_mxml_span_cb_t)(void *, int, char *, int, int *);
+typedef const char *(*_mxml_view_cb_t)(void *, int, const char *, int);
+typedef const char *(*_mxml_skip_cb_t)(void *, int, size_t, size_t *);
 
 typedef struct _mxml_fdbuf_s		/**** File descriptor buffer ****/
 {
   int		fd;			/* File descriptor */
+  FILE		*fp;			/* File to read from instead of fd */
+  const unsigned char *map;		/* Mapped data used in place of buffer */
+  _mxml_global_t *global;		/* Options for error messages */
   unsigned char	*current,		/* Current position in buffer */
 		*end,			/* End of buffer */
 		buffer[8192];		/* Character buffer */
 } _mxml_fdbuf_t;
 
+typedef struct _mxml_strbuf_s		/**** String being loaded ****/
+{
+  const char	*s;			/* Current position in string */
+  _mxml_global_t *global;		/* Options for error messages */
+} _mxml_strbuf_t;
+
+typedef struct _mxml_wbuf_s		/**** Output buffer ****/
+{
+  char		*start,			/* Start of buffer */
+		*current,		/* Current position in buffer */
+		*end;			/* End of buffer */
+  size_t	bytes;			/* Bytes flushed from buffer */
+  int		(*flush_cb)(struct _mxml_wbuf_s *);
+					/* Function to empty or grow buffer */
+  int		fd;			/* File descriptor to write to */
+  FILE		*fp;			/* File to write to */
+  char		*overflow;		/* Buffer for bytes past end of string */
+} _mxml_wbuf_t;
+
+typedef struct _mxml_loadstate_s	/**** State of a load waiting for data ****/
+{
+  int		flags;			/* Load flags */
+  int		starved,		/* Read function ran out of data */
+		suspended;		/* Load stopped until there is more data */
+  mxml_node_t	*first,			/* First node added */
+		*parent,		/* Current parent node */
+		*feed;			/* Custom node being fed */
+  mxml_type_t	type;			/* Current node type */
+  int		line,			/* Current line number */
+		whitespace,		/* Non-zero if whitespace seen */
+		elide,			/* Drop whitespace between elements? */
+		encoding,		/* Character encoding */
+		arena_pending;		/* Arena flags for the root node */
+  char		*buffer,		/* String buffer */
+		*bufptr,		/* Pointer into buffer */
+		*feedbuf,		/* Custom value buffer */
+		*feedptr;		/* Pointer into custom value buffer */
+  int		bufsize,		/* Size of buffer */
+		feedsize;		/* Size of custom value buffer */
+} _mxml_loadstate_t;
+
+struct _mxml_parser_s			/**** Push parser ****/
+{
+  _mxml_fdbuf_t	buf;			/* Data being loaded, must be first */
+  _mxml_loadstate_t state;		/* State of the load */
+  mxml_node_t	*top;			/* Top node */
+  mxml_load_cb_t cb;			/* Load callback */
+  mxml_sax_cb_t	sax_cb;			/* SAX callback */
+  void		*sax_data;		/* SAX user data */
+  unsigned char	*data;			/* Data not loaded yet */
+  size_t	used,			/* Bytes of data */
+		alloc,			/* Allocated bytes of data */
+		scanned,		/* Bytes of data scanned */
+		safe;			/* Bytes of data that can be loaded */
+  int		scan,			/* Scanner state (_MXML_SCAN_xxx) */
+		count,			/* Bytes in tag name or comment */
+		quote,			/* Quote around attribute value */
+		need;			/* UTF-8 bytes still to come */
+  char		name[8],		/* Start of tag name */
+		last[3];		/* Last three bytes */
+  int		final,			/* No more data will be fed */
+		done;			/* Load has ended */
+  mxml_node_t	*result;		/* Result of the load */
+};
+
+
+/*
+ * Push parser scanner states...
+ */
+
+#define _MXML_SCAN_TEXT		0	/* Text */
+#define _MXML_SCAN_ENTITY	1	/* Entity in text */
+#define _MXML_SCAN_NAME		2	/* Name after '<' */
+#define _MXML_SCAN_TAG		3	/* Close tag or declaration */
+#define _MXML_SCAN_SPACE	4	/* Space before attribute name */
+#define _MXML_SCAN_ATTR		5	/* Attribute name */
+#define _MXML_SCAN_EQUALS	6	/* Space before '=' */
+#define _MXML_SCAN_VALUE	7	/* Space before attribute value */
+#define _MXML_SCAN_QUOTED	8	/* Quoted attribute value */
+#define _MXML_SCAN_UNQUOTED	9	/* Unquoted attribute value */
+#define _MXML_SCAN_SLASH	10	/* '/' or '?' before '>' */
+#define _MXML_SCAN_COMMENT	11	/* Comment */
+#define _MXML_SCAN_CDATA	12	/* CDATA */
+#define _MXML_SCAN_PI		13	/* Processing instruction */
+#define _MXML_SCAN_END		14	/* End of tag */
+#define _MXML_SCAN_HOLD		15	/* Wait for the end of data */
+
 
 /*
  * Local functions...
  */
 
-static int		mxml_add_char(int ch, char **ptr, char **buffer, int *bufsize);
+static int		mxml_add_char(int ch, char **ptr, char **buffer, int *bufsize, _mxml_global_t *global);
+static int		mxml_add_span(void *p, _mxml_span_cb_t span_cb, int encoding, char **bufptr, char **buffer, int *bufsize, int *line, _mxml_global_t *global);
+static int		mxml_alloc_flush(_mxml_wbuf_t *buf);
+static void		mxml_elide_space(mxml_node_t *parent, mxml_node_t **first);
+static int		mxml_expand_buffer(char **bufptr, char **buffer, int *bufsize, _mxml_global_t *global);
+static int		mxml_fd_flush(_mxml_wbuf_t *buf);
 static int		mxml_fd_getc(void *p, int *encoding);
-static int		mxml_fd_putc(int ch, void *p);
 static int		mxml_fd_read(_mxml_fdbuf_t *buf);
-static int		mxml_fd_write(_mxml_fdbuf_t *buf);
-static int		mxml_file_getc(void *p, int *encoding);
-static int		mxml_file_putc(int ch, void *p);
-static int		mxml_get_entity(mxml_node_t *parent, void *p, int *encoding, _mxml_getc_cb_t getc_cb, int *line);
+static const char	*mxml_fd_skip(void *p, int encoding, size_t min, size_t *len);
+static int		mxml_fd_span(void *p, int encoding, char *dst, int max, int *line);
+static const char	*mxml_fd_view(void *p, int encoding, const char *text, int len);
+static int		mxml_file_flush(_mxml_wbuf_t *buf);
+static int		mxml_get_entity(mxml_node_t *parent, void *p, int *encoding, _mxml_getc_cb_t getc_cb, int *line, _mxml_global_t *global);
 static inline int	mxml_isspace(int ch)
 			{
 			  return (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n');
 			}
-static mxml_node_t	*mxml_load_data(mxml_node_t *top, void *p, mxml_load_cb_t cb, _mxml_getc_cb_t getc_cb, mxml_sax_cb_t sax_cb, void *sax_data);
-static int		mxml_parse_element(mxml_node_t *node, void *p, int *encoding, _mxml_getc_cb_t getc_cb, int *line);
+static mxml_node_t	*mxml_load_data(mxml_node_t *top, void *p, mxml_load_cb_t cb, _mxml_getc_cb_t getc_cb, _mxml_span_cb_t span_cb, _mxml_view_cb_t view_cb, _mxml_skip_cb_t skip_cb, mxml_sax_cb_t sax_cb, void *sax_data, _mxml_loadstate_t *state, _mxml_global_t *global);
+static int		mxml_parse_element(mxml_node_t *node, void *p, int *encoding, _mxml_getc_cb_t getc_cb, int *line, _mxml_global_t *global);
+static int		mxml_push_getc(void *p, int *encoding);
+static int		mxml_push_load(mxml_parser_t *parser);
+static void		mxml_push_scan(mxml_parser_t *parser);
+static int		mxml_span(const unsigned char *src, int max, char *dst, int *line);
+static int		mxml_string_flush(_mxml_wbuf_t *buf);
 static int		mxml_string_getc(void *p, int *encoding);
-static int		mxml_string_putc(int ch, void *p);
-static int		mxml_write_name(const char *s, void *p, _mxml_putc_cb_t putc_cb);
-static int		mxml_write_node(mxml_node_t *node, void *p, mxml_save_cb_t cb, int col, _mxml_putc_cb_t putc_cb, _mxml_global_t *global);
-static int		mxml_write_string(const char *s, void *p, _mxml_putc_cb_t putc_cb);
-static int		mxml_write_ws(mxml_node_t *node, void *p, mxml_save_cb_t cb, int ws, int col, _mxml_putc_cb_t putc_cb);
+static int		mxml_string_span(void *p, int encoding, char *dst, int max, int *line);
+static int		mxml_write_bytes(_mxml_wbuf_t *buf, const char *s, size_t len);
+static inline int	mxml_write_char(_mxml_wbuf_t *buf, int ch)
+			{
+			  if (buf->current >= buf->end && (*buf->flush_cb)(buf) < 0)
+			    return (-1);
+			  *(buf->current)++ = (char)ch;
+			  return (0);
+			}
+static int		mxml_write_name(const char *s, _mxml_wbuf_t *buf);
+static int		mxml_write_node(mxml_node_t *node, _mxml_wbuf_t *buf, mxml_save_cb_t cb, int col, _mxml_global_t *global);
+static int		mxml_write_string(const char *s, _mxml_wbuf_t *buf);
+static int		mxml_write_ws(mxml_node_t *node, _mxml_wbuf_t *buf, mxml_save_cb_t cb, int ws, int col);
 
 
 /*
@@ -99,6 +231,28 @@ mxml_node_t *				/* O - First node or @code NULL@ if the file could not be read.
 mxmlLoadFd(mxml_node_t    *top,		/* I - Top node */
            int            fd,		/* I - File descriptor to read from */
            mxml_load_cb_t cb)		/* I - Callback function or constant */
+{
+  return (mxmlLoadFdEx(top, fd, cb, MXML_NO_CALLBACK, NULL, NULL));
+}
+
+
+/*
+ * 'mxmlLoadFdEx()' - Load a file descriptor into an XML node tree with the given options.
+ *
+ * This combines @link mxmlLoadFd@ and @link mxmlSAXLoadFd@; pass
+ * @code MXML_NO_CALLBACK@ as "sax_cb" to just build the tree.  The error,
+ * entity and custom data callbacks and the load flags are taken from
+ * "options" instead of the settings made for the calling thread, which are
+ * only used when "options" is @code NULL@.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the file could not be read. */
+mxmlLoadFdEx(mxml_node_t    *top,	/* I - Top node */
+             int            fd,		/* I - File descriptor to read from */
+             mxml_load_cb_t cb,		/* I - Callback function or constant */
+             mxml_sax_cb_t  sax_cb,	/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+             void           *sax_data,	/* I - SAX user data */
+             mxml_options_t *options)	/* I - Options or @code NULL@ */
 {
   _mxml_fdbuf_t	buf;			/* File descriptor buffer */
 
@@ -108,6 +262,9 @@ mxmlLoadFd(mxml_node_t    *top,		/* I - Top node */
   */
 
   buf.fd      = fd;
+  buf.fp      = NULL;
+  buf.map     = NULL;
+  buf.global  = options ? options : _mxml_global();
   buf.current = buf.buffer;
   buf.end     = buf.buffer;
 
@@ -115,7 +272,7 @@ mxmlLoadFd(mxml_node_t    *top,		/* I - Top node */
   * Read the XML data...
   */
 
-  return (mxml_load_data(top, &buf, cb, mxml_fd_getc, MXML_NO_CALLBACK, NULL));
+  return (mxml_load_data(top, &buf, cb, mxml_fd_getc, mxml_fd_span, NULL, NULL, sax_cb, sax_data, NULL, buf.global));
 }
 
 
@@ -142,11 +299,102 @@ mxmlLoadFile(mxml_node_t    *top,	/* I - Top node */
              FILE           *fp,	/* I - File to read from */
              mxml_load_cb_t cb)		/* I - Callback function or constant */
 {
+  return (mxmlLoadFileEx(top, fp, cb, MXML_NO_CALLBACK, NULL, NULL));
+}
+
+
+/*
+ * 'mxmlLoadFileEx()' - Load a file into an XML node tree with the given options.
+ *
+ * See @link mxmlLoadFdEx@.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the file could not be read. */
+mxmlLoadFileEx(mxml_node_t    *top,	/* I - Top node */
+               FILE           *fp,	/* I - File to read from */
+               mxml_load_cb_t cb,	/* I - Callback function or constant */
+               mxml_sax_cb_t  sax_cb,	/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+               void           *sax_data,/* I - SAX user data */
+               mxml_options_t *options)	/* I - Options or @code NULL@ */
+{
+  _mxml_fdbuf_t	buf;			/* File buffer */
+
+
+ /*
+  * Initialize the file buffer...
+  */
+
+  buf.fd      = -1;
+  buf.fp      = fp;
+  buf.map     = NULL;
+  buf.global  = options ? options : _mxml_global();
+  buf.current = buf.buffer;
+  buf.end     = buf.buffer;
+
+ /*
+  * Read the XML data...
+  */
+
+  return (mxml_load_data(top, &buf, cb, mxml_fd_getc, mxml_fd_span, NULL, NULL, sax_cb, sax_data, NULL, buf.global));
+}
+
+
+/*
+ * 'mxmlLoadMapped()' - Load mapped XML data into an XML node tree.
+ *
+ * This works like @link mxmlLoadFile@ on a file mapped into memory, for
+ * example with mmap().  Opaque values that need no decoding are not copied:
+ * they refer to the mapped data, which must stay mapped and unchanged until
+ * the tree is deleted.  @link mxmlGetOpaqueView@ returns such a value in
+ * place; @link mxmlGetOpaque@ copies it on first use so that it can be
+ * nul-terminated.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the data could not be read. */
+mxmlLoadMapped(mxml_node_t    *top,	/* I - Top node */
+               const void     *data,	/* I - Mapped data */
+               size_t         length,	/* I - Length of data */
+               mxml_load_cb_t cb)	/* I - Callback function or constant */
+{
+  return (mxmlLoadMappedEx(top, data, length, cb, MXML_NO_CALLBACK, NULL, NULL));
+}
+
+
+/*
+ * 'mxmlLoadMappedEx()' - Load mapped XML data into an XML node tree with the given options.
+ *
+ * See @link mxmlLoadMapped@ and @link mxmlLoadFdEx@.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the data could not be read. */
+mxmlLoadMappedEx(
+    mxml_node_t    *top,		/* I - Top node */
+    const void     *data,		/* I - Mapped data */
+    size_t         length,		/* I - Length of data */
+    mxml_load_cb_t cb,			/* I - Callback function or constant */
+    mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+    void           *sax_data,		/* I - SAX user data */
+    mxml_options_t *options)		/* I - Options or @code NULL@ */
+{
+  _mxml_fdbuf_t	buf;			/* Mapped data buffer */
+
+
+ /*
+  * Read straight from the mapping...
+  */
+
+  buf.fd      = -1;
+  buf.fp      = NULL;
+  buf.map     = data;
+  buf.global  = options ? options : _mxml_global();
+  buf.current = (unsigned char *)data;
+  buf.end     = (unsigned char *)data + length;
+
  /*
   * Read the XML data...
   */
 
-  return (mxml_load_data(top, fp, cb, mxml_file_getc, MXML_NO_CALLBACK, NULL));
+  return (mxml_load_data(top, &buf, cb, mxml_fd_getc, mxml_fd_span, mxml_fd_view, mxml_fd_skip, sax_cb, sax_data, NULL, buf.global));
 }
 
 
@@ -173,12 +421,208 @@ mxmlLoadString(mxml_node_t    *top,	/* I - Top node */
                const char     *s,	/* I - String to load */
                mxml_load_cb_t cb)	/* I - Callback function or constant */
 {
+  return (mxmlLoadStringEx(top, s, cb, MXML_NO_CALLBACK, NULL, NULL));
+}
+
+
+/*
+ * 'mxmlLoadStringEx()' - Load a string into an XML node tree with the given options.
+ *
+ * See @link mxmlLoadFdEx@.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the string has errors. */
+mxmlLoadStringEx(
+    mxml_node_t    *top,		/* I - Top node */
+    const char     *s,			/* I - String to load */
+    mxml_load_cb_t cb,			/* I - Callback function or constant */
+    mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+    void           *sax_data,		/* I - SAX user data */
+    mxml_options_t *options)		/* I - Options or @code NULL@ */
+{
+  _mxml_strbuf_t	buf;		/* String buffer */
+
+
+  buf.s      = s;
+  buf.global = options ? options : _mxml_global();
+
  /*
   * Read the XML data...
   */
 
-  return (mxml_load_data(top, (void *)&s, cb, mxml_string_getc, MXML_NO_CALLBACK,
-                         NULL));
+  return (mxml_load_data(top, &buf, cb, mxml_string_getc, mxml_string_span,
+                         NULL, NULL, sax_cb, sax_data, NULL, buf.global));
+}
+
+
+/*
+ * 'mxmlParserDelete()' - Free a push parser without finishing the load.
+ *
+ * Nodes that were already added to the tree are deleted.
+ */
+
+void
+mxmlParserDelete(mxml_parser_t *parser)	/* I - Parser */
+{
+  if (!parser)
+    return;
+
+  if (parser->state.suspended)
+  {
+    parser->state.arena_pending = 0;
+
+    mxmlDelete(parser->state.first);
+
+    free(parser->state.buffer);
+    free(parser->state.feedbuf);
+  }
+
+  free(parser->data);
+  free(parser);
+}
+
+
+/*
+ * 'mxmlParserFeed()' - Pass the next chunk of XML data to a push parser.
+ *
+ * Everything that can be parsed with the data seen so far is loaded and
+ * reported to the SAX callback before this function returns; the rest of the
+ * chunk, at most an unfinished tag, entity or character, is kept for the
+ * next call.
+ */
+
+int					/* O - 0 on success, -1 on error */
+mxmlParserFeed(mxml_parser_t *parser,	/* I - Parser */
+               const void    *data,	/* I - Data */
+               size_t        length)	/* I - Length of data */
+{
+  unsigned char	*temp;			/* New data buffer */
+  size_t	alloc;			/* Size of new data buffer */
+
+
+  if (!parser || parser->done)
+    return (parser && parser->result ? 0 : -1);
+
+  if (parser->used + length > parser->alloc)
+  {
+    for (alloc = parser->alloc ? parser->alloc : 8192; alloc < parser->used + length; alloc *= 2);
+
+    if ((temp = realloc(parser->data, alloc)) == NULL)
+    {
+      _mxml_error(parser->buf.global, "Unable to allocate %u bytes for XML data.", (unsigned)alloc);
+      return (-1);
+    }
+
+    parser->data  = temp;
+    parser->alloc = alloc;
+  }
+
+  memcpy(parser->data + parser->used, data, length);
+  parser->used += length;
+
+  mxml_push_scan(parser);
+
+  if (!parser->safe)
+    return (0);
+
+  return (mxml_push_load(parser));
+}
+
+
+/*
+ * 'mxmlParserFinish()' - Load the rest of the data and free a push parser.
+ *
+ * The return value is the same as for @link mxmlLoadString@ or
+ * @link mxmlSAXLoadString@ with the whole document.
+ */
+
+mxml_node_t *				/* O - First node or @code NULL@ if the data has errors. */
+mxmlParserFinish(mxml_parser_t *parser)	/* I - Parser */
+{
+  mxml_node_t	*node;			/* Loaded tree */
+
+
+  if (!parser)
+    return (NULL);
+
+  if (!parser->done)
+  {
+    parser->final = 1;
+    mxml_push_load(parser);
+  }
+
+  node = parser->result;
+
+  mxmlParserDelete(parser);
+
+  return (node);
+}
+
+
+/*
+ * 'mxmlParserNew()' - Create a push parser.
+ *
+ * Unlike the other load functions, which read a whole document at once, a
+ * push parser is given the document in chunks with @link mxmlParserFeed@ as
+ * they arrive, for example from a pipe or decompressor, and nodes are added
+ * (or SAX events raised) as soon as their data is complete.
+ * @link mxmlParserFinish@ ends the load and returns the tree.  The arguments
+ * are those of @link mxmlSAXLoadString@; pass @code MXML_NO_CALLBACK@ as
+ * "sax_cb" to just build the tree.
+ *
+ * The load flags in effect are captured here, but the custom data and error
+ * handlers of the calling thread are used, so the thread must not change them
+ * or exit while the parser is in use; use @link mxmlParserNewEx@ to avoid
+ * this.  UTF-16 documents are only parsed when finished.
+ */
+
+mxml_parser_t *				/* O - Parser or @code NULL@ on error */
+mxmlParserNew(mxml_node_t    *top,	/* I - Top node */
+              mxml_load_cb_t cb,	/* I - Callback function or constant */
+              mxml_sax_cb_t  sax_cb,	/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+              void           *sax_data)	/* I - SAX user data */
+{
+  return (mxmlParserNewEx(top, cb, sax_cb, sax_data, NULL));
+}
+
+
+/*
+ * 'mxmlParserNewEx()' - Create a push parser with the given options.
+ *
+ * See @link mxmlParserNew@.  The error, entity and custom data callbacks and
+ * the load flags are taken from "options" instead of the settings made for
+ * the calling thread, which are only used when "options" is @code NULL@.
+ * The options must stay allocated and unchanged while the parser is in use.
+ */
+
+mxml_parser_t *				/* O - Parser or @code NULL@ on error */
+mxmlParserNewEx(
+    mxml_node_t    *top,		/* I - Top node */
+    mxml_load_cb_t cb,			/* I - Callback function or constant */
+    mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+    void           *sax_data,		/* I - SAX user data */
+    mxml_options_t *options)		/* I - Options or @code NULL@ */
+{
+  mxml_parser_t	*parser;		/* New parser */
+  _mxml_global_t *global = options ? options : _mxml_global();
+					/* Options */
+
+
+  if ((parser = calloc(1, sizeof(mxml_parser_t))) == NULL)
+  {
+    _mxml_error(global, "Unable to allocate memory for parser!");
+    return (NULL);
+  }
+
+  parser->buf.fd      = -1;
+  parser->buf.global  = global;
+  parser->top         = top;
+  parser->cb          = cb;
+  parser->sax_cb      = sax_cb;
+  parser->sax_data    = sax_data;
+  parser->state.flags = parser->buf.global->load_flags;
+
+  return (parser);
 }
 
 
@@ -203,43 +647,57 @@ mxmlSaveAllocString(
     mxml_node_t    *node,		/* I - Node to write */
     mxml_save_cb_t cb)			/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
 {
-  int	bytes;				/* Required bytes */
-  char	buffer[8192];			/* Temporary buffer */
-  char	*s;				/* Allocated string */
+  return (mxmlSaveAllocStringEx(node, cb, NULL));
+}
+
+
+/*
+ * 'mxmlSaveAllocStringEx()' - Save an XML tree to an allocated string with the given options.
+ *
+ * See @link mxmlSaveFdEx@.
+ */
+
+char *					/* O - Allocated string or @code NULL@ */
+mxmlSaveAllocStringEx(
+    mxml_node_t    *node,		/* I - Node to write */
+    mxml_save_cb_t cb,			/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
+    mxml_options_t *options)		/* I - Options or @code NULL@ */
+{
+  int		col;			/* Final column */
+  _mxml_wbuf_t	buf;			/* Output buffer */
+  char		*s;			/* Allocated string */
+  _mxml_global_t *global = options ? options : _mxml_global();
+					/* Options */
 
 
  /*
-  * Write the node to the temporary buffer...
+  * Write the node to a string that grows as needed, so the node is only
+  * written once...
   */
 
-  bytes = mxmlSaveString(node, buffer, sizeof(buffer), cb);
-
-  if (bytes <= 0)
+  if ((buf.start = malloc(8192)) == NULL)
     return (NULL);
 
-  if (bytes < (int)(sizeof(buffer) - 1))
-  {
-   /*
-    * Node fit inside the buffer, so just duplicate that string and
-    * return...
-    */
+  buf.current  = buf.start;
+  buf.end      = buf.start + 8191;
+  buf.flush_cb = mxml_alloc_flush;
 
-    return (strdup(buffer));
+  if ((col = mxml_write_node(node, &buf, cb, 0, global)) < 0 ||
+      (col > 0 && mxml_write_char(&buf, '\n') < 0) ||
+      buf.current == buf.start)
+  {
+    free(buf.start);
+    return (NULL);
   }
 
  /*
-  * Allocate a buffer of the required size and save the node to the
-  * new buffer...
+  * Nul-terminate the string and give back the unused space...
   */
 
-  if ((s = malloc(bytes + 1)) == NULL)
-    return (NULL);
-
-  mxmlSaveString(node, s, bytes + 1, cb);
+  *(buf.current) = '\0';
 
- /*
-  * Return the allocated string...
-  */
+  if ((s = realloc(buf.start, (size_t)(buf.current - buf.start) + 1)) == NULL)
+    s = buf.start;
 
   return (s);
 }
@@ -259,37 +717,58 @@ int					/* O - 0 on success, -1 on error. */
 mxmlSaveFd(mxml_node_t    *node,	/* I - Node to write */
            int            fd,		/* I - File descriptor to write to */
 	   mxml_save_cb_t cb)		/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
+{
+  return (mxmlSaveFdEx(node, fd, cb, NULL));
+}
+
+
+/*
+ * 'mxmlSaveFdEx()' - Save an XML tree to a file descriptor with the given options.
+ *
+ * The wrap margin and custom data save function are taken from "options"
+ * instead of the settings made for the calling thread, which are only used
+ * when "options" is @code NULL@.
+ */
+
+int					/* O - 0 on success, -1 on error. */
+mxmlSaveFdEx(mxml_node_t    *node,	/* I - Node to write */
+             int            fd,		/* I - File descriptor to write to */
+	     mxml_save_cb_t cb,		/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
+	     mxml_options_t *options)	/* I - Options or @code NULL@ */
 {
   int		col;			/* Final column */
-  _mxml_fdbuf_t	buf;			/* File descriptor buffer */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
+  _mxml_wbuf_t	buf;			/* Output buffer */
+  char		buffer[_MXML_WRITE_SIZE];/* Buffer for data */
+  _mxml_global_t *global = options ? options : _mxml_global();
+					/* Options */
 
 
  /*
-  * Initialize the file descriptor buffer...
+  * Initialize the output buffer...
   */
 
-  buf.fd      = fd;
-  buf.current = buf.buffer;
-  buf.end     = buf.buffer + sizeof(buf.buffer);
+  buf.fd       = fd;
+  buf.start    = buffer;
+  buf.current  = buffer;
+  buf.end      = buffer + sizeof(buffer);
+  buf.flush_cb = mxml_fd_flush;
 
  /*
   * Write the node...
   */
 
-  if ((col = mxml_write_node(node, &buf, cb, 0, mxml_fd_putc, global)) < 0)
+  if ((col = mxml_write_node(node, &buf, cb, 0, global)) < 0)
     return (-1);
 
   if (col > 0)
-    if (mxml_fd_putc('\n', &buf) < 0)
+    if (mxml_write_char(&buf, '\n') < 0)
       return (-1);
 
  /*
   * Flush and return...
   */
 
-  return (mxml_fd_write(&buf));
+  return (mxml_fd_flush(&buf));
 }
 
 
@@ -308,27 +787,55 @@ mxmlSaveFile(mxml_node_t    *node,	/* I - Node to write */
              FILE           *fp,	/* I - File to write to */
 	     mxml_save_cb_t cb)		/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
 {
-  int	col;				/* Final column */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
+  return (mxmlSaveFileEx(node, fp, cb, NULL));
+}
+
+
+/*
+ * 'mxmlSaveFileEx()' - Save an XML tree to a file with the given options.
+ *
+ * See @link mxmlSaveFdEx@.
+ */
+
+int					/* O - 0 on success, -1 on error. */
+mxmlSaveFileEx(mxml_node_t    *node,	/* I - Node to write */
+               FILE           *fp,	/* I - File to write to */
+	       mxml_save_cb_t cb,	/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
+	       mxml_options_t *options)	/* I - Options or @code NULL@ */
+{
+  int		col;			/* Final column */
+  _mxml_wbuf_t	buf;			/* Output buffer */
+  char		buffer[_MXML_WRITE_SIZE];/* Buffer for data */
+  _mxml_global_t *global = options ? options : _mxml_global();
+					/* Options */
+
 
+ /*
+  * Initialize the output buffer...
+  */
+
+  buf.fp       = fp;
+  buf.start    = buffer;
+  buf.current  = buffer;
+  buf.end      = buffer + sizeof(buffer);
+  buf.flush_cb = mxml_file_flush;
 
  /*
   * Write the node...
   */
 
-  if ((col = mxml_write_node(node, fp, cb, 0, mxml_file_putc, global)) < 0)
+  if ((col = mxml_write_node(node, &buf, cb, 0, global)) < 0)
     return (-1);
 
   if (col > 0)
-    if (putc('\n', fp) < 0)
+    if (mxml_write_char(&buf, '\n') < 0)
       return (-1);
 
  /*
-  * Return 0 (success)...
+  * Flush and return...
   */
 
-  return (0);
+  return (mxml_file_flush(&buf));
 }
 
 
@@ -337,7 +844,8 @@ mxmlSaveFile(mxml_node_t    *node,	/* I - Node to write */
  *
  * This function returns the total number of bytes that would be
  * required for the string but only copies (bufsize - 1) characters
- * into the specified buffer.
+ * into the specified buffer.  The buffer may be @code NULL@ when bufsize
+ * is 0 to just get the size.
  *
  * The callback argument specifies a function that returns a whitespace
  * string or NULL before and after each element. If @code MXML_NO_CALLBACK@
@@ -352,39 +860,64 @@ mxmlSaveString(mxml_node_t    *node,	/* I - Node to write */
                int            bufsize,	/* I - Size of string buffer */
                mxml_save_cb_t cb)	/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
 {
-  int	col;				/* Final column */
-  char	*ptr[2];			/* Pointers for putc_cb */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
+  return (mxmlSaveStringEx(node, buffer, bufsize, cb, NULL));
+}
+
+
+/*
+ * 'mxmlSaveStringEx()' - Save an XML node tree to a string with the given options.
+ *
+ * See @link mxmlSaveString@ and @link mxmlSaveFdEx@.
+ */
+
+int					/* O - Size of string */
+mxmlSaveStringEx(mxml_node_t    *node,	/* I - Node to write */
+                 char           *buffer,/* I - String buffer */
+                 int            bufsize,/* I - Size of string buffer */
+                 mxml_save_cb_t cb,	/* I - Whitespace callback or @code MXML_NO_CALLBACK@ */
+                 mxml_options_t *options)/* I - Options or @code NULL@ */
+{
+  int		col;			/* Final column */
+  _mxml_wbuf_t	buf;			/* Output buffer */
+  char		overflow[_MXML_WRITE_SIZE];/* Buffer for data past end of string */
+  _mxml_global_t *global = options ? options : _mxml_global();
+					/* Options */
 
 
  /*
-  * Write the node...
+  * Write the node, leaving room for the nul...
   */
 
-  ptr[0] = buffer;
-  ptr[1] = buffer + bufsize;
+  buf.start    = buffer;
+  buf.current  = buffer;
+  buf.end      = bufsize > 0 ? buffer + bufsize - 1 : buffer;
+  buf.bytes    = 0;
+  buf.flush_cb = mxml_string_flush;
+  buf.overflow = overflow;
 
-  if ((col = mxml_write_node(node, ptr, cb, 0, mxml_string_putc, global)) < 0)
+  if ((col = mxml_write_node(node, &buf, cb, 0, global)) < 0)
     return (-1);
 
   if (col > 0)
-    mxml_string_putc('\n', ptr);
+    mxml_write_char(&buf, '\n');
 
  /*
   * Nul-terminate the buffer...
   */
 
-  if (ptr[0] >= ptr[1])
-    buffer[bufsize - 1] = '\0';
-  else
-    ptr[0][0] = '\0';
+  if (bufsize > 0)
+  {
+    if (buf.start == buffer)
+      *(buf.current) = '\0';
+    else
+      buffer[bufsize - 1] = '\0';
+  }
 
  /*
   * Return the number of characters...
   */
 
-  return ((int)(ptr[0] - buffer));
+  return ((int)(buf.bytes + (size_t)(buf.current - buf.start)));
 }
 
 
@@ -414,23 +947,8 @@ mxmlSAXLoadFd(mxml_node_t    *top,	/* I - Top node */
               mxml_sax_cb_t  sax_cb,	/* I - SAX callback or @code MXML_NO_CALLBACK@ */
               void           *sax_data)	/* I - SAX user data */
 {
-  _mxml_fdbuf_t	buf;			/* File descriptor buffer */
-
-
- /*
-  * Initialize the file descriptor buffer...
-  */
-
-  buf.fd      = fd;
-  buf.current = buf.buffer;
-  buf.end     = buf.buffer;
-
- /*
-  * Read the XML data...
-  */
-
-  return (mxml_load_data(top, &buf, cb, mxml_fd_getc, sax_cb, sax_data));
-}
+  return (mxmlLoadFdEx(top, fd, cb, sax_cb, sax_data, NULL));
+}
 
 
 /*
@@ -460,11 +978,33 @@ mxmlSAXLoadFile(
     mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
     void           *sax_data)		/* I - SAX user data */
 {
- /*
-  * Read the XML data...
-  */
+  return (mxmlLoadFileEx(top, fp, cb, sax_cb, sax_data, NULL));
+}
+
+
+/*
+ * 'mxmlSAXLoadMapped()' - Load mapped XML data into an XML node tree
+ *                         using a SAX callback.
+ *
+ * This works like @link mxmlSAXLoadFile@ on a file mapped into memory.
+ * As with @link mxmlLoadMapped@, opaque values of retained nodes may refer
+ * to the mapped data, which must stay mapped until those nodes are deleted.
+ *
+ * The SAX callback must call @link mxmlRetain@ for any nodes that need to
+ * be kept for later use. Otherwise, nodes are deleted when the parent
+ * node is closed or after each data, comment, CDATA, or directive node.
+ */
 
-  return (mxml_load_data(top, fp, cb, mxml_file_getc, sax_cb, sax_data));
+mxml_node_t *				/* O - First node or @code NULL@ if the data could not be read. */
+mxmlSAXLoadMapped(
+    mxml_node_t    *top,		/* I - Top node */
+    const void     *data,		/* I - Mapped data */
+    size_t         length,		/* I - Length of data */
+    mxml_load_cb_t cb,			/* I - Callback function or constant */
+    mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
+    void           *sax_data)		/* I - SAX user data */
+{
+  return (mxmlLoadMappedEx(top, data, length, cb, sax_cb, sax_data, NULL));
 }
 
 
@@ -495,11 +1035,26 @@ mxmlSAXLoadString(
     mxml_sax_cb_t  sax_cb,		/* I - SAX callback or @code MXML_NO_CALLBACK@ */
     void           *sax_data)		/* I - SAX user data */
 {
- /*
-  * Read the XML data...
-  */
+  return (mxmlLoadStringEx(top, s, cb, sax_cb, sax_data, NULL));
+}
+
+
+/*
+ * 'mxmlSetCustomFeedHandler()' - Set the incremental load function for custom data.
+ *
+ * The feed function is called with successive runs of a custom value's
+ * (UTF-8) characters as they are read, and once more with a length of 0
+ * when the value ends, instead of the whole value being collected into a
+ * string for the load function.  It must return 0 on success and non-zero
+ * on error.
+ *
+ */
 
-  return (mxml_load_data(top, (void *)&s, cb, mxml_string_getc, sax_cb, sax_data));
+void
+mxmlSetCustomFeedHandler(
+    mxml_custom_feed_cb_t feed)		/* I - Feed function */
+{
+  mxmlOptionsSetCustomFeedHandler(_mxml_global(), feed);
 }
 
 
@@ -519,12 +1074,7 @@ mxmlSetCustomHandlers(
     mxml_custom_load_cb_t load,		/* I - Load function */
     mxml_custom_save_cb_t save)		/* I - Save function */
 {
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
-
-
-  global->custom_load_cb = load;
-  global->custom_save_cb = save;
+  mxmlOptionsSetCustomHandlers(_mxml_global(), load, save);
 }
 
 
@@ -535,11 +1085,40 @@ mxmlSetCustomHandlers(
 void
 mxmlSetErrorCallback(mxml_error_cb_t cb)/* I - Error callback function */
 {
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
+  mxmlOptionsSetErrorCallback(_mxml_global(), cb);
+}
 
 
-  global->error_cb = cb;
+/*
+ * 'mxmlSetLoadFlags()' - Set how the nodes of loaded documents are allocated.
+ *
+ * With @code MXML_ARENA@, a document loaded without a top node or SAX
+ * callback takes its nodes and strings from one arena that is freed at once
+ * when the root node is deleted; deleting any other node of it only unlinks
+ * the node.  Nodes added under an arena node come from the same arena.
+ * @code MXML_COMPACT@ also leaves the reference count and user data out of
+ * each node: @link mxmlRetain@ and @link mxmlRelease@ behave as if the count
+ * were 1 and @link mxmlSetUserData@ fails.  @code MXML_INTERN@ shares one
+ * copy of each element name in the arena, so names of one document can be
+ * compared by pointer.  @code MXML_ELIDE_SPACE@ drops whitespace-only text
+ * that lies between child elements or between a child element and the
+ * parent's tags; whitespace that is the only content of an element is kept.
+ * It has no effect on SAX loads.
+ *
+ * @code MXML_COMPACT_DOM@ combines all of the above.  @code MXML_DEFER_TEXT@
+ * applies to mapped loads only: opaque text of 256 bytes or more without
+ * entities is found with @code memchr@ and left in the mapped data without
+ * being checked, like other mapped text; text that the load callback ignores
+ * is skipped the same way at any length.  Invalid characters in it are not
+ * reported and line numbers in later error messages do not count its
+ * newlines.  The flags are kept per thread; 0 restores normal loading.  Use
+ * @link mxmlOptionsSetLoadFlags@ to set them for particular loads only.
+ */
+
+void
+mxmlSetLoadFlags(int flags)		/* I - @code MXML_ARENA@, @code MXML_COMPACT@, @code MXML_INTERN@, @code MXML_ELIDE_SPACE@, @code MXML_DEFER_TEXT@ or 0 */
+{
+  mxmlOptionsSetLoadFlags(_mxml_global(), flags);
 }
 
 
@@ -554,11 +1133,7 @@ mxmlSetErrorCallback(mxml_error_cb_t cb)/* I - Error callback function */
 void
 mxmlSetWrapMargin(int column)		/* I - Column for wrapping, 0 to disable wrapping */
 {
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
-
-
-  global->wrap = column;
+  mxmlOptionsSetWrapMargin(_mxml_global(), column);
 }
 
 
@@ -567,37 +1142,15 @@ mxmlSetWrapMargin(int column)		/* I - Column for wrapping, 0 to disable wrapping
  */
 
 static int				/* O  - 0 on success, -1 on error */
-mxml_add_char(int  ch,			/* I  - Character to add */
-              char **bufptr,		/* IO - Current position in buffer */
-	      char **buffer,		/* IO - Current buffer */
-	      int  *bufsize)		/* IO - Current buffer size */
+mxml_add_char(int            ch,	/* I  - Character to add */
+              char           **bufptr,	/* IO - Current position in buffer */
+	      char           **buffer,	/* IO - Current buffer */
+	      int            *bufsize,	/* IO - Current buffer size */
+	      _mxml_global_t *global)	/* I  - Options */
 {
-  char	*newbuffer;			/* New buffer value */
-
-
-  if (*bufptr >= (*buffer + *bufsize - 4))
-  {
-   /*
-    * Increase the size of the buffer...
-    */
-
-    if (*bufsize < 1024)
-      (*bufsize) *= 2;
-    else
-      (*bufsize) += 1024;
-
-    if ((newbuffer = realloc(*buffer, *bufsize)) == NULL)
-    {
-      free(*buffer);
-
-      mxml_error("Unable to expand string buffer to %d bytes!", *bufsize);
-
-      return (-1);
-    }
-
-    *bufptr = newbuffer + (*bufptr - *buffer);
-    *buffer = newbuffer;
-  }
+  if (*bufptr >= (*buffer + *bufsize - 4) &&
+      mxml_expand_buffer(bufptr, buffer, bufsize, global))
+    return (-1);
 
   if (ch < 0x80)
   {
@@ -643,412 +1196,145 @@ mxml_add_char(int  ch,			/* I  - Character to add */
 
 
 /*
- * 'mxml_fd_getc()' - Read a character from a file descriptor.
+ * 'mxml_add_span()' - Add a run of plain text to a buffer, expanding as needed.
  */
 
-static int				/* O  - Character or EOF */
-mxml_fd_getc(void *p,			/* I  - File descriptor buffer */
-             int  *encoding)		/* IO - Encoding */
+static int				/* O  - 0 on success, -1 on error */
+mxml_add_span(void            *p,	/* I  - Pointer to data */
+              _mxml_span_cb_t span_cb,	/* I  - Span function */
+              int             encoding,	/* I  - Encoding */
+              char            **bufptr,	/* IO - Current position in buffer */
+              char            **buffer,	/* IO - Current buffer */
+              int             *bufsize,	/* IO - Current buffer size */
+              int             *line,	/* IO - Current line number */
+              _mxml_global_t  *global)	/* I  - Options */
 {
-  _mxml_fdbuf_t	*buf;			/* File descriptor buffer */
-  int		ch,			/* Current character */
-		temp;			/* Temporary character */
-
+  int	bytes;				/* Bytes copied */
 
- /*
-  * Grab the next character in the buffer...
-  */
-
-  buf = (_mxml_fdbuf_t *)p;
-
-  if (buf->current >= buf->end)
-    if (mxml_fd_read(buf) < 0)
-      return (EOF);
-
-  ch = *(buf->current)++;
 
-  switch (*encoding)
+  do
   {
-    case ENCODE_UTF8 :
-       /*
-	* Got a UTF-8 character; convert UTF-8 to Unicode and return...
-	*/
-
-	if (!(ch & 0x80))
-	{
-#if DEBUG > 1
-          printf("mxml_fd_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
-#endif /* DEBUG > 1 */
-
-	  if (mxml_bad_char(ch))
-	  {
-	    mxml_error("Bad control character 0x%02x not allowed by XML standard!",
-        	       ch);
-	    return (EOF);
-	  }
-
-	  return (ch);
-        }
-	else if (ch == 0xfe)
-	{
-	 /*
-	  * UTF-16 big-endian BOM?
-	  */
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  ch = *(buf->current)++;
-
-	  if (ch != 0xff)
-	    return (EOF);
-
-	  *encoding = ENCODE_UTF16BE;
-
-	  return (mxml_fd_getc(p, encoding));
-	}
-	else if (ch == 0xff)
-	{
-	 /*
-	  * UTF-16 little-endian BOM?
-	  */
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  ch = *(buf->current)++;
-
-	  if (ch != 0xfe)
-	    return (EOF);
-
-	  *encoding = ENCODE_UTF16LE;
-
-	  return (mxml_fd_getc(p, encoding));
-	}
-	else if ((ch & 0xe0) == 0xc0)
-	{
-	 /*
-	  * Two-byte value...
-	  */
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = ((ch & 0x1f) << 6) | (temp & 0x3f);
-
-	  if (ch < 0x80)
-	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
-	    return (EOF);
-	  }
-	}
-	else if ((ch & 0xf0) == 0xe0)
-	{
-	 /*
-	  * Three-byte value...
-	  */
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = ((ch & 0x0f) << 6) | (temp & 0x3f);
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = (ch << 6) | (temp & 0x3f);
-
-	  if (ch < 0x800)
-	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
-	    return (EOF);
-	  }
-
-         /*
-	  * Ignore (strip) Byte Order Mark (BOM)...
-	  */
-
-	  if (ch == 0xfeff)
-	    return (mxml_fd_getc(p, encoding));
-	}
-	else if ((ch & 0xf8) == 0xf0)
-	{
-	 /*
-	  * Four-byte value...
-	  */
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = ((ch & 0x07) << 6) | (temp & 0x3f);
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = (ch << 6) | (temp & 0x3f);
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  if ((temp & 0xc0) != 0x80)
-	    return (EOF);
-
-	  ch = (ch << 6) | (temp & 0x3f);
-
-	  if (ch < 0x10000)
-	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
-	    return (EOF);
-	  }
-	}
-	else
-	  return (EOF);
-	break;
-
-    case ENCODE_UTF16BE :
-       /*
-        * Read UTF-16 big-endian char...
-	*/
-
-	if (buf->current >= buf->end)
-	  if (mxml_fd_read(buf) < 0)
-	    return (EOF);
-
-	temp = *(buf->current)++;
-
-	ch = (ch << 8) | temp;
-
-	if (mxml_bad_char(ch))
-	{
-	  mxml_error("Bad control character 0x%02x not allowed by XML standard!",
-        	     ch);
-	  return (EOF);
-	}
-        else if (ch >= 0xd800 && ch <= 0xdbff)
-	{
-	 /*
-	  * Multi-word UTF-16 char...
-	  */
-
-          int lch;
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  lch = *(buf->current)++;
-
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
-
-	  temp = *(buf->current)++;
-
-	  lch = (lch << 8) | temp;
-
-          if (lch < 0xdc00 || lch >= 0xdfff)
-	    return (EOF);
-
-          ch = (((ch & 0x3ff) << 10) | (lch & 0x3ff)) + 0x10000;
-	}
-	break;
-
-    case ENCODE_UTF16LE :
-       /*
-        * Read UTF-16 little-endian char...
-	*/
-
-	if (buf->current >= buf->end)
-	  if (mxml_fd_read(buf) < 0)
-	    return (EOF);
-
-	temp = *(buf->current)++;
-
-	ch |= (temp << 8);
-
-        if (mxml_bad_char(ch))
-	{
-	  mxml_error("Bad control character 0x%02x not allowed by XML standard!",
-        	     ch);
-	  return (EOF);
-	}
-        else if (ch >= 0xd800 && ch <= 0xdbff)
-	{
-	 /*
-	  * Multi-word UTF-16 char...
-	  */
+    if (*bufptr >= (*buffer + *bufsize - 4) &&
+        mxml_expand_buffer(bufptr, buffer, bufsize, global))
+      return (-1);
 
-          int lch;
+    bytes   = (*span_cb)(p, encoding, *bufptr, (int)(*buffer + *bufsize - 4 - *bufptr), line);
+    *bufptr += bytes;
+  }
+  while (bytes > 0 && *bufptr >= (*buffer + *bufsize - 4));
 
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
+  return (0);
+}
 
-	  lch = *(buf->current)++;
 
-	  if (buf->current >= buf->end)
-	    if (mxml_fd_read(buf) < 0)
-	      return (EOF);
+/*
+ * 'mxml_alloc_flush()' - Grow an allocated string being written.
+ */
 
-	  temp = *(buf->current)++;
+static int				/* O - 0 on success, -1 on error */
+mxml_alloc_flush(_mxml_wbuf_t *buf)	/* I - Output buffer */
+{
+  size_t	size;			/* New size of string */
+  char		*start;			/* New string */
 
-	  lch |= (temp << 8);
 
-          if (lch < 0xdc00 || lch >= 0xdfff)
-	    return (EOF);
+  size = 2 * (size_t)(buf->end - buf->start + 1);
 
-          ch = (((ch & 0x3ff) << 10) | (lch & 0x3ff)) + 0x10000;
-	}
-	break;
-  }
+  if ((start = realloc(buf->start, size)) == NULL)
+    return (-1);
 
-#if DEBUG > 1
-  printf("mxml_fd_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
-#endif /* DEBUG > 1 */
+  buf->current = start + (buf->current - buf->start);
+  buf->start   = start;
+  buf->end     = start + size - 1;
 
-  return (ch);
+  return (0);
 }
 
 
 /*
- * 'mxml_fd_putc()' - Write a character to a file descriptor.
+ * 'mxml_elide_space()' - Remove whitespace before a new child element.
  */
 
-static int				/* O - 0 on success, -1 on error */
-mxml_fd_putc(int  ch,			/* I - Character */
-             void *p)			/* I - File descriptor buffer */
+static void
+mxml_elide_space(mxml_node_t *parent,	/* I  - Parent node */
+                 mxml_node_t **first)	/* IO - First node added */
 {
-  _mxml_fdbuf_t	*buf;			/* File descriptor buffer */
+  mxml_node_t	*node;			/* Last child */
+  const char	*ptr;			/* Pointer into text */
+  size_t	len = 0;		/* Length of text */
 
 
- /*
-  * Flush the write buffer as needed...
-  */
+  if (!parent || (node = parent->last_child) == NULL)
+    return;
 
-  buf = (_mxml_fdbuf_t *)p;
+  if (node->type == MXML_OPAQUE)
+  {
+    for (ptr = mxmlGetOpaqueView(node, &len); ptr && len && mxml_isspace(*ptr); ptr ++, len --);
 
-  if (buf->current >= buf->end)
-    if (mxml_fd_write(buf) < 0)
-      return (-1);
+    if (len)
+      return;
+  }
+  else if (node->type != MXML_TEXT || node->value.text.string[0])
+    return;
 
-  *(buf->current)++ = ch;
+  if (node->prev && node->prev->type != MXML_ELEMENT)
+    return;
 
- /*
-  * Return successfully...
-  */
+  if (*first == node)
+    *first = NULL;
 
-  return (0);
+  mxmlDelete(node);
 }
 
 
 /*
- * 'mxml_fd_read()' - Read a buffer of data from a file descriptor.
+ * 'mxml_expand_buffer()' - Double the size of a string buffer.
  */
 
-static int				/* O - 0 on success, -1 on error */
-mxml_fd_read(_mxml_fdbuf_t *buf)		/* I - File descriptor buffer */
+static int				/* O  - 0 on success, -1 on error */
+mxml_expand_buffer(char           **bufptr,	/* IO - Current position in buffer */
+                   char           **buffer,	/* IO - Current buffer */
+                   int            *bufsize,	/* IO - Current buffer size */
+                   _mxml_global_t *global)	/* I  - Options */
 {
-  int	bytes;				/* Bytes read... */
-
+  char	*newbuffer;			/* New buffer value */
 
- /*
-  * Range check input...
-  */
 
-  if (!buf)
-    return (-1);
+  if (*bufsize > INT_MAX / 2 || (newbuffer = realloc(*buffer, 2 * *bufsize)) == NULL)
+  {
+   /*
+    * The caller still owns and frees the old buffer...
+    */
 
- /*
-  * Read from the file descriptor...
-  */
+    _mxml_error(global, "Unable to expand string buffer to %d bytes!", *bufsize);
 
-  while ((bytes = (int)read(buf->fd, buf->buffer, sizeof(buf->buffer))) < 0)
-#ifdef EINTR
-    if (errno != EAGAIN && errno != EINTR)
-#else
-    if (errno != EAGAIN)
-#endif /* EINTR */
-      return (-1);
-
-  if (bytes == 0)
     return (-1);
+  }
 
- /*
-  * Update the pointers and return success...
-  */
-
-  buf->current = buf->buffer;
-  buf->end     = buf->buffer + bytes;
+  *bufptr  = newbuffer + (*bufptr - *buffer);
+  *buffer  = newbuffer;
+  *bufsize *= 2;
 
   return (0);
 }
 
 
 /*
- * 'mxml_fd_write()' - Write a buffer of data to a file descriptor.
+ * 'mxml_fd_flush()' - Write the output buffer to a file descriptor.
  */
 
 static int				/* O - 0 on success, -1 on error */
-mxml_fd_write(_mxml_fdbuf_t *buf)	/* I - File descriptor buffer */
+mxml_fd_flush(_mxml_wbuf_t *buf)	/* I - Output buffer */
 {
   int		bytes;			/* Bytes written */
-  unsigned char	*ptr;			/* Pointer into buffer */
-
-
- /*
-  * Range check...
-  */
-
-  if (!buf)
-    return (-1);
+  char		*ptr;			/* Pointer into buffer */
 
- /*
-  * Return 0 if there is nothing to write...
-  */
-
-  if (buf->current == buf->buffer)
-    return (0);
 
  /*
   * Loop until we have written everything...
   */
 
-  for (ptr = buf->buffer; ptr < buf->current; ptr += bytes)
+  for (ptr = buf->start; ptr < buf->current; ptr += bytes)
     if ((bytes = (int)write(buf->fd, ptr, buf->current - ptr)) < 0)
       return (-1);
 
@@ -1056,34 +1342,36 @@ mxml_fd_write(_mxml_fdbuf_t *buf)	/* I - File descriptor buffer */
   * All done, reset pointers and return success...
   */
 
-  buf->current = buf->buffer;
+  buf->current = buf->start;
 
   return (0);
 }
 
 
 /*
- * 'mxml_file_getc()' - Get a character from a file.
+ * 'mxml_fd_getc()' - Read a character from a file descriptor.
  */
 
 static int				/* O  - Character or EOF */
-mxml_file_getc(void *p,			/* I  - Pointer to file */
-               int  *encoding)		/* IO - Encoding */
+mxml_fd_getc(void *p,			/* I  - File descriptor buffer */
+             int  *encoding)		/* IO - Encoding */
 {
-  int	ch,				/* Character from file */
-	temp;				/* Temporary character */
-  FILE	*fp;				/* Pointer to file */
+  _mxml_fdbuf_t	*buf;			/* File descriptor buffer */
+  int		ch,			/* Current character */
+		temp;			/* Temporary character */
 
 
  /*
-  * Read a character from the file and see if it is EOF or ASCII...
+  * Grab the next character in the buffer...
   */
 
-  fp = (FILE *)p;
-  ch = getc(fp);
+  buf = (_mxml_fdbuf_t *)p;
 
-  if (ch == EOF)
-    return (EOF);
+  if (buf->current >= buf->end)
+    if (mxml_fd_read(buf) < 0)
+      return (EOF);
+
+  ch = *(buf->current)++;
 
   switch (*encoding)
   {
@@ -1094,17 +1382,17 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 
 	if (!(ch & 0x80))
 	{
+#if DEBUG > 1
+          printf("mxml_fd_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
+#endif /* DEBUG > 1 */
+
 	  if (mxml_bad_char(ch))
 	  {
-	    mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	    _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         	       ch);
 	    return (EOF);
 	  }
 
-#if DEBUG > 1
-          printf("mxml_file_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
-#endif /* DEBUG > 1 */
-
 	  return (ch);
         }
 	else if (ch == 0xfe)
@@ -1113,13 +1401,18 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * UTF-16 big-endian BOM?
 	  */
 
-          ch = getc(fp);
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  ch = *(buf->current)++;
+
 	  if (ch != 0xff)
 	    return (EOF);
 
 	  *encoding = ENCODE_UTF16BE;
 
-	  return (mxml_file_getc(p, encoding));
+	  return (mxml_fd_getc(p, encoding));
 	}
 	else if (ch == 0xff)
 	{
@@ -1127,13 +1420,18 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * UTF-16 little-endian BOM?
 	  */
 
-          ch = getc(fp);
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  ch = *(buf->current)++;
+
 	  if (ch != 0xfe)
 	    return (EOF);
 
 	  *encoding = ENCODE_UTF16LE;
 
-	  return (mxml_file_getc(p, encoding));
+	  return (mxml_fd_getc(p, encoding));
 	}
 	else if ((ch & 0xe0) == 0xc0)
 	{
@@ -1141,14 +1439,20 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * Two-byte value...
 	  */
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = ((ch & 0x1f) << 6) | (temp & 0x3f);
 
 	  if (ch < 0x80)
 	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	    _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	    return (EOF);
 	  }
 	}
@@ -1158,19 +1462,31 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * Three-byte value...
 	  */
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = ((ch & 0x0f) << 6) | (temp & 0x3f);
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = (ch << 6) | (temp & 0x3f);
 
 	  if (ch < 0x800)
 	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	    _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	    return (EOF);
 	  }
 
@@ -1179,7 +1495,7 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  */
 
 	  if (ch == 0xfeff)
-	    return (mxml_file_getc(p, encoding));
+	    return (mxml_fd_getc(p, encoding));
 	}
 	else if ((ch & 0xf8) == 0xf0)
 	{
@@ -1187,24 +1503,42 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * Four-byte value...
 	  */
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = ((ch & 0x07) << 6) | (temp & 0x3f);
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = (ch << 6) | (temp & 0x3f);
 
-	  if ((temp = getc(fp)) == EOF || (temp & 0xc0) != 0x80)
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  if ((temp & 0xc0) != 0x80)
 	    return (EOF);
 
 	  ch = (ch << 6) | (temp & 0x3f);
 
 	  if (ch < 0x10000)
 	  {
-	    mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	    _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	    return (EOF);
 	  }
 	}
@@ -1217,11 +1551,17 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
         * Read UTF-16 big-endian char...
 	*/
 
-	ch = (ch << 8) | getc(fp);
+	if (buf->current >= buf->end)
+	  if (mxml_fd_read(buf) < 0)
+	    return (EOF);
+
+	temp = *(buf->current)++;
+
+	ch = (ch << 8) | temp;
 
 	if (mxml_bad_char(ch))
 	{
-	  mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	  _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         	     ch);
 	  return (EOF);
 	}
@@ -1231,8 +1571,21 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * Multi-word UTF-16 char...
 	  */
 
-          int lch = getc(fp);
-          lch = (lch << 8) | getc(fp);
+          int lch;
+
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  lch = *(buf->current)++;
+
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  lch = (lch << 8) | temp;
 
           if (lch < 0xdc00 || lch >= 0xdfff)
 	    return (EOF);
@@ -1246,11 +1599,17 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
         * Read UTF-16 little-endian char...
 	*/
 
-	ch |= (getc(fp) << 8);
+	if (buf->current >= buf->end)
+	  if (mxml_fd_read(buf) < 0)
+	    return (EOF);
+
+	temp = *(buf->current)++;
+
+	ch |= (temp << 8);
 
         if (mxml_bad_char(ch))
 	{
-	  mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	  _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         	     ch);
 	  return (EOF);
 	}
@@ -1260,8 +1619,21 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 	  * Multi-word UTF-16 char...
 	  */
 
-          int lch = getc(fp);
-          lch |= (getc(fp) << 8);
+          int lch;
+
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  lch = *(buf->current)++;
+
+	  if (buf->current >= buf->end)
+	    if (mxml_fd_read(buf) < 0)
+	      return (EOF);
+
+	  temp = *(buf->current)++;
+
+	  lch |= (temp << 8);
 
           if (lch < 0xdc00 || lch >= 0xdfff)
 	    return (EOF);
@@ -1272,7 +1644,7 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
   }
 
 #if DEBUG > 1
-  printf("mxml_file_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
+  printf("mxml_fd_getc: %c (0x%04x)\n", ch < ' ' ? '.' : ch, ch);
 #endif /* DEBUG > 1 */
 
   return (ch);
@@ -1280,14 +1652,165 @@ mxml_file_getc(void *p,			/* I  - Pointer to file */
 
 
 /*
- * 'mxml_file_putc()' - Write a character to a file.
+ * 'mxml_fd_read()' - Read a buffer of data from a file descriptor or file.
  */
 
-static int				/* O - 0 on success, -1 on failure */
-mxml_file_putc(int  ch,			/* I - Character to write */
-               void *p)			/* I - Pointer to file */
+static int				/* O - 0 on success, -1 on error */
+mxml_fd_read(_mxml_fdbuf_t *buf)		/* I - File descriptor buffer */
+{
+  int	bytes;				/* Bytes read... */
+
+
+ /*
+  * Range check input...
+  */
+
+  if (!buf || buf->map)
+    return (-1);
+
+ /*
+  * Read from the file descriptor...
+  */
+
+  if (buf->fp)
+    bytes = (int)fread(buf->buffer, 1, sizeof(buf->buffer), buf->fp);
+  else
+  {
+    while ((bytes = (int)read(buf->fd, buf->buffer, sizeof(buf->buffer))) < 0)
+#ifdef EINTR
+      if (errno != EAGAIN && errno != EINTR)
+#else
+      if (errno != EAGAIN)
+#endif /* EINTR */
+	return (-1);
+  }
+
+  if (bytes == 0)
+    return (-1);
+
+ /*
+  * Update the pointers and return success...
+  */
+
+  buf->current = buf->buffer;
+  buf->end     = buf->buffer + bytes;
+
+  return (0);
+}
+
+
+/*
+ * 'mxml_fd_skip()' - Skip a long run of text in mapped data.
+ *
+ * The run starts with the character just read and ends before the next '<'.
+ * Runs that are too short or contain entities are left to the caller.
+ */
+
+static const char *			/* O - Start of text or @code NULL@ */
+mxml_fd_skip(void   *p,			/* I - File descriptor buffer */
+             int    encoding,		/* I - Encoding */
+             size_t min,		/* I - Minimum length of text */
+             size_t *len)		/* O - Length of text */
+{
+  _mxml_fdbuf_t		*buf = (_mxml_fdbuf_t *)p;
+					/* File descriptor buffer */
+  const unsigned char	*start,		/* Start of text */
+			*end;		/* '<' after text */
+
+
+  if (!buf->map || encoding != ENCODE_UTF8 || buf->current == buf->map)
+    return (NULL);
+
+  start = buf->current - 1;
+
+  if ((end = memchr(start, '<', (size_t)(buf->end - start))) == NULL ||
+      (size_t)(end - start) < min || memchr(start, '&', (size_t)(end - start)))
+    return (NULL);
+
+  buf->current = (unsigned char *)end;
+  *len         = (size_t)(end - start);
+
+  return ((const char *)start);
+}
+
+
+/*
+ * 'mxml_fd_span()' - Copy a run of plain text from a file descriptor buffer.
+ */
+
+static int				/* O  - Number of bytes copied */
+mxml_fd_span(void *p,			/* I  - File descriptor buffer */
+             int  encoding,		/* I  - Encoding */
+             char *dst,			/* I  - Destination */
+             int  max,			/* I  - Maximum number of bytes */
+             int  *line)		/* IO - Current line number */
+{
+  _mxml_fdbuf_t	*buf = (_mxml_fdbuf_t *)p;
+					/* File descriptor buffer */
+  int		bytes;			/* Bytes copied */
+
+
+  if (encoding != ENCODE_UTF8)
+    return (0);
+
+  if (max > (int)(buf->end - buf->current))
+    max = (int)(buf->end - buf->current);
+
+  bytes        = mxml_span(buf->current, max, dst, line);
+  buf->current += bytes;
+
+  return (bytes);
+}
+
+
+/*
+ * 'mxml_fd_view()' - Find text in mapped data.
+ *
+ * The text was read just before the current '<', so it is in place when the
+ * mapped bytes before that match it exactly.
+ */
+
+static const char *			/* O - Text in mapped data or @code NULL@ */
+mxml_fd_view(void       *p,		/* I - File descriptor buffer */
+             int        encoding,	/* I - Encoding */
+             const char *text,		/* I - Text that was read */
+             int        len)		/* I - Length of text */
+{
+  _mxml_fdbuf_t		*buf = (_mxml_fdbuf_t *)p;
+					/* File descriptor buffer */
+  const unsigned char	*start;		/* Start of text in mapping */
+
+
+  if (!buf->map || encoding != ENCODE_UTF8 || buf->current - buf->map < len + 1)
+    return (NULL);
+
+  start = buf->current - 1 - len;
+
+  if (start[len] != '<' || memcmp(start, text, (size_t)len))
+    return (NULL);
+
+  return ((const char *)start);
+}
+
+
+/*
+ * 'mxml_file_flush()' - Write the output buffer to a file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+mxml_file_flush(_mxml_wbuf_t *buf)	/* I - Output buffer */
 {
-  return (putc(ch, (FILE *)p) == EOF ? -1 : 0);
+  size_t	bytes;			/* Bytes to write */
+
+
+  bytes = (size_t)(buf->current - buf->start);
+
+  if (bytes > 0 && fwrite(buf->start, 1, bytes, buf->fp) != bytes)
+    return (-1);
+
+  buf->current = buf->start;
+
+  return (0);
 }
 
 
@@ -1301,7 +1824,8 @@ mxml_get_entity(mxml_node_t *parent,	/* I  - Parent node */
 		int         *encoding,	/* IO - Character encoding */
                 int         (*getc_cb)(void *, int *),
 					/* I  - Get character function */
-                int         *line)	/* IO - Current line number */
+                int         *line,	/* IO - Current line number */
+                _mxml_global_t *global)	/* I  - Options */
 {
   int	ch;				/* Current character */
   char	entity[64],			/* Entity string */
@@ -1318,7 +1842,7 @@ mxml_get_entity(mxml_node_t *parent,	/* I  - Parent node */
       *entptr++ = ch;
     else
     {
-      mxml_error("Entity name too long under parent <%s> on line %d.", parent ? parent->value.element.name : "null", *line);
+      _mxml_error(global, "Entity name too long under parent <%s> on line %d.", parent ? parent->value.element.name : "null", *line);
       break;
     }
   }
@@ -1327,7 +1851,7 @@ mxml_get_entity(mxml_node_t *parent,	/* I  - Parent node */
 
   if (ch != ';')
   {
-    mxml_error("Character entity '%s' not terminated under parent <%s> on line %d.", entity, parent ? parent->value.element.name : "null", *line);
+    _mxml_error(global, "Character entity '%s' not terminated under parent <%s> on line %d.", entity, parent ? parent->value.element.name : "null", *line);
 
     if (ch == '\n')
       (*line)++;
@@ -1342,12 +1866,12 @@ mxml_get_entity(mxml_node_t *parent,	/* I  - Parent node */
     else
       ch = (int)strtol(entity + 1, NULL, 10);
   }
-  else if ((ch = mxmlEntityGetValue(entity)) < 0)
-    mxml_error("Entity name '%s;' not supported under parent <%s> on line %d.", entity, parent ? parent->value.element.name : "null", *line);
+  else if ((ch = _mxml_entity_value(global, entity)) < 0)
+    _mxml_error(global, "Entity name '%s;' not supported under parent <%s> on line %d.", entity, parent ? parent->value.element.name : "null", *line);
 
   if (mxml_bad_char(ch))
   {
-    mxml_error("Bad control character 0x%02x under parent <%s> on line %d not allowed by XML standard.", ch, parent ? parent->value.element.name : "null", *line);
+    _mxml_error(global, "Bad control character 0x%02x under parent <%s> on line %d not allowed by XML standard.", ch, parent ? parent->value.element.name : "null", *line);
     return (EOF);
   }
 
@@ -1365,22 +1889,38 @@ mxml_load_data(
     void            *p,			/* I - Pointer to data */
     mxml_load_cb_t  cb,			/* I - Callback function or MXML_NO_CALLBACK */
     _mxml_getc_cb_t getc_cb,		/* I - Read function */
+    _mxml_span_cb_t span_cb,		/* I - Plain text run function */
+    _mxml_view_cb_t view_cb,		/* I - Mapped text function or NULL */
+    _mxml_skip_cb_t skip_cb,		/* I - Mapped text skip function or NULL */
     mxml_sax_cb_t   sax_cb,		/* I - SAX callback or MXML_NO_CALLBACK */
-    void            *sax_data)		/* I - SAX user data */
+    void            *sax_data,		/* I - SAX user data */
+    _mxml_loadstate_t *state,		/* IO - State of a push load or NULL */
+    _mxml_global_t  *global)		/* I - Options */
 {
   mxml_node_t	*node,			/* Current node */
 		*first,			/* First node added */
-		*parent;		/* Current parent node */
+		*parent,		/* Current parent node */
+		*feed;			/* Custom node being fed */
   int		line = 1,		/* Current line number */
 		ch,			/* Character from file */
-		whitespace;		/* Non-zero if whitespace seen */
+		whitespace,		/* Non-zero if whitespace seen */
+		elide,			/* Drop whitespace between elements? */
+		defer,			/* Leave long text in mapped data? */
+		flags,			/* Load flags */
+		arena;			/* Start a new arena? */
+  mxml_node_t	pending,		/* Stand-in parent that starts the arena */
+		*orphan;		/* Parent for nodes without one */
   char		*buffer,		/* String buffer */
-		*bufptr;		/* Pointer into buffer */
-  int		bufsize;		/* Size of buffer */
+		*bufptr,		/* Pointer into buffer */
+		*ptr,			/* Pointer into whitespace */
+		*feedbuf,		/* Custom value buffer */
+		*feedptr;		/* Pointer into custom value buffer */
+  const char	*view;			/* Text left in mapped data */
+  size_t	viewlen;		/* Length of skipped text */
+  int		bufsize,		/* Size of buffer */
+		feedsize;		/* Size of custom value buffer */
   mxml_type_t	type;			/* Current node type */
   int		encoding;		/* Character encoding */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
   static const char * const types[] =	/* Type strings... */
 		{
 		  "MXML_ELEMENT",	/* XML element with attributes */
@@ -1392,20 +1932,74 @@ mxml_load_data(
 		};
 
 
+  flags = state ? state->flags : global->load_flags;
+
+ /*
+  * SAX loads delete nodes as they go, so only whole documents use an arena...
+  */
+
+  arena = !top && !sax_cb && (flags & MXML_ARENA);
+
+  memset(&pending, 0, sizeof(pending));
+  pending.flags = _MXML_NODE_PENDING;
+  orphan        = arena ? &pending : NULL;
+
+  if (state && state->buffer)
+  {
+   /*
+    * Pick up a push load where the last chunk ended...
+    */
+
+    first      = state->first;
+    parent     = state->parent;
+    feed       = state->feed;
+    type       = state->type;
+    line       = state->line;
+    whitespace = state->whitespace;
+    elide      = state->elide;
+    encoding   = state->encoding;
+    buffer     = state->buffer;
+    bufptr     = state->bufptr;
+    feedbuf    = state->feedbuf;
+    feedptr    = state->feedptr;
+    bufsize    = state->bufsize;
+    feedsize   = state->feedsize;
+    defer      = 0;
+
+    pending.value.integer = state->arena_pending;
+
+    if ((ch = (*getc_cb)(p, &encoding)) == EOF)
+      goto end_of_data;
+
+    goto resume;
+  }
+
  /*
   * Read elements and other nodes from the file...
   */
 
   if ((buffer = malloc(64)) == NULL)
   {
-    mxml_error("Unable to allocate string buffer!");
+    _mxml_error(global, "Unable to allocate string buffer!");
     return (NULL);
   }
 
   bufsize    = 64;
   bufptr     = buffer;
+  feedbuf    = NULL;
+  feedptr    = NULL;
+  feedsize   = 1024;
+
+  if (global->custom_feed_cb && (feedbuf = feedptr = malloc(feedsize)) == NULL)
+  {
+    free(buffer);
+    _mxml_error(global, "Unable to allocate string buffer!");
+    return (NULL);
+  }
+
   parent     = top;
   first      = NULL;
+  feed       = NULL;
   whitespace = 0;
   encoding   = ENCODE_UTF8;
 
@@ -1419,17 +2013,71 @@ mxml_load_data(
   if ((ch = (*getc_cb)(p, &encoding)) == EOF)
   {
     free(buffer);
+    free(feedbuf);
     return (NULL);
   }
   else if (ch != '<' && !top)
   {
     free(buffer);
-    mxml_error("XML does not start with '<' (saw '%c').", ch);
+    free(feedbuf);
+    _mxml_error(global, "XML does not start with '<' (saw '%c').", ch);
     return (NULL);
   }
 
+  if (arena)
+    pending.value.integer = flags;
+
+  elide = !sax_cb && (flags & MXML_ELIDE_SPACE);
+  defer = skip_cb && (flags & MXML_DEFER_TEXT);
+
+  resume:
+
   do
   {
+    if (ch == '<' && feed)
+    {
+     /*
+      * Finish the custom value that was fed incrementally...
+      */
+
+      node = feed;
+      feed = NULL;
+
+      if ((feedptr > feedbuf && (*global->custom_feed_cb)(node, feedbuf, (int)(feedptr - feedbuf))) ||
+          (*global->custom_feed_cb)(node, feedbuf, 0))
+      {
+	_mxml_error(global, "Bad custom value in parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	goto error;
+      }
+
+      if (sax_cb)
+      {
+        (*sax_cb)(node, MXML_SAX_DATA, sax_data);
+
+        if (!mxmlRelease(node))
+          node = NULL;
+      }
+
+      feedptr = feedbuf;
+
+      if (!first && node)
+        first = node;
+    }
+
+    if (elide && ch == '<' && bufptr > buffer && type == MXML_OPAQUE &&
+        parent && parent->last_child &&
+        parent->last_child->type == MXML_ELEMENT)
+    {
+     /*
+      * Drop whitespace following a child element...
+      */
+
+      for (ptr = buffer; ptr < bufptr && mxml_isspace(*ptr); ptr ++);
+
+      if (ptr == bufptr)
+        bufptr = buffer;
+    }
+
     if ((ch == '<' ||
          (mxml_isspace(ch) && type != MXML_OPAQUE && type != MXML_CUSTOM)) &&
         bufptr > buffer)
@@ -1443,19 +2091,22 @@ mxml_load_data(
       switch (type)
       {
 	case MXML_INTEGER :
-            node = mxmlNewInteger(parent, (int)strtol(buffer, &bufptr, 0));
+            node = mxmlNewInteger(parent ? parent : orphan, (int)strtol(buffer, &bufptr, 0));
 	    break;
 
 	case MXML_OPAQUE :
-            node = mxmlNewOpaque(parent, buffer);
+            if (view_cb && (view = (*view_cb)(p, encoding, buffer, (int)(bufptr - buffer))) != NULL)
+              node = _mxml_new_view(parent ? parent : orphan, view, (size_t)(bufptr - buffer));
+            else
+              node = mxmlNewOpaque(parent ? parent : orphan, buffer);
 	    break;
 
 	case MXML_REAL :
-            node = mxmlNewReal(parent, strtod(buffer, &bufptr));
+            node = mxmlNewReal(parent ? parent : orphan, strtod(buffer, &bufptr));
 	    break;
 
 	case MXML_TEXT :
-            node = mxmlNewText(parent, whitespace, buffer);
+            node = mxmlNewText(parent ? parent : orphan, whitespace, buffer);
 	    break;
 
 	case MXML_CUSTOM :
@@ -1465,11 +2116,11 @@ mxml_load_data(
 	      * Use the callback to fill in the custom data...
 	      */
 
-              node = mxmlNewCustom(parent, NULL, NULL);
+              node = mxmlNewCustom(parent ? parent : orphan, NULL, NULL);
 
 	      if ((*global->custom_load_cb)(node, buffer))
 	      {
-	        mxml_error("Bad custom value '%s' in parent <%s> on line %d.", buffer, parent ? parent->value.element.name : "null", line);
+	        _mxml_error(global, "Bad custom value '%s' in parent <%s> on line %d.", buffer, parent ? parent->value.element.name : "null", line);
 		mxmlDelete(node);
 		node = NULL;
 	      }
@@ -1487,7 +2138,7 @@ mxml_load_data(
         * Bad integer/real number value...
 	*/
 
-        mxml_error("Bad %s value '%s' in parent <%s> on line %d.", type == MXML_INTEGER ? "integer" : "real", buffer, parent ? parent->value.element.name : "null", line);
+        _mxml_error(global, "Bad %s value '%s' in parent <%s> on line %d.", type == MXML_INTEGER ? "integer" : "real", buffer, parent ? parent->value.element.name : "null", line);
 	break;
       }
 
@@ -1500,7 +2151,7 @@ mxml_load_data(
 	* Print error and return...
 	*/
 
-	mxml_error("Unable to add value node of type %s to parent <%s> on line %d.", types[type], parent ? parent->value.element.name : "null", line);
+	_mxml_error(global, "Unable to add value node of type %s to parent <%s> on line %d.", types[type], parent ? parent->value.element.name : "null", line);
 	goto error;
       }
 
@@ -1528,7 +2179,8 @@ mxml_load_data(
 
     if (ch == '<' && whitespace && type == MXML_TEXT)
     {
-      if (parent)
+      if (parent && !(elide && parent->last_child &&
+                      parent->last_child->type == MXML_ELEMENT))
       {
 	node = mxmlNewText(parent, whitespace, "");
 
@@ -1561,20 +2213,20 @@ mxml_load_data(
 	  break;
 	else if (ch == '<')
 	{
-	  mxml_error("Bare < in element!");
+	  _mxml_error(global, "Bare < in element!");
 	  goto error;
 	}
 	else if (ch == '&')
 	{
-	  if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line)) == EOF)
+	  if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line, global)) == EOF)
 	    goto error;
 
-	  if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	  if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	    goto error;
 	}
 	else if (ch < '0' && ch != '!' && ch != '-' && ch != '.' && ch != '/')
 	  goto error;
-	else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	  goto error;
 	else if (((bufptr - buffer) == 1 && buffer[0] == '?') ||
 	         ((bufptr - buffer) == 3 && !strncmp(buffer, "!--", 3)) ||
@@ -1598,7 +2250,7 @@ mxml_load_data(
 	  if (ch == '>' && bufptr > (buffer + 4) &&
 	      bufptr[-3] != '-' && bufptr[-2] == '-' && bufptr[-1] == '-')
 	    break;
-	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	    goto error;
 
 	  if (ch == '\n')
@@ -1615,7 +2267,7 @@ mxml_load_data(
 	  * Print error and return...
 	  */
 
-	  mxml_error("Early EOF in comment node on line %d.", line);
+	  _mxml_error(global, "Early EOF in comment node on line %d.", line);
 	  goto error;
 	}
 
@@ -1632,17 +2284,20 @@ mxml_load_data(
 	  * There can only be one root element!
 	  */
 
-	  mxml_error("<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
+	  _mxml_error(global, "<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
           goto error;
 	}
 
-	if ((node = mxmlNewElement(parent, buffer)) == NULL)
+	if (elide)
+	  mxml_elide_space(parent, &first);
+
+	if ((node = mxmlNewElement(parent ? parent : orphan, buffer)) == NULL)
 	{
 	 /*
 	  * Just print error for now...
 	  */
 
-	  mxml_error("Unable to add comment node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  _mxml_error(global, "Unable to add comment node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
 	  break;
 	}
 
@@ -1674,7 +2329,7 @@ mxml_load_data(
 	    bufptr[-2] = '\0';
 	    break;
 	  }
-	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	    goto error;
 
 	  if (ch == '\n')
@@ -1691,7 +2346,7 @@ mxml_load_data(
 	  * Print error and return...
 	  */
 
-	  mxml_error("Early EOF in CDATA node on line %d.", line);
+	  _mxml_error(global, "Early EOF in CDATA node on line %d.", line);
 	  goto error;
 	}
 
@@ -1708,17 +2363,20 @@ mxml_load_data(
 	  * There can only be one root element!
 	  */
 
-	  mxml_error("<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
+	  _mxml_error(global, "<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
           goto error;
 	}
 
-	if ((node = mxmlNewElement(parent, buffer)) == NULL)
+	if (elide)
+	  mxml_elide_space(parent, &first);
+
+	if ((node = mxmlNewElement(parent ? parent : orphan, buffer)) == NULL)
 	{
 	 /*
 	  * Print error and return...
 	  */
 
-	  mxml_error("Unable to add CDATA node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  _mxml_error(global, "Unable to add CDATA node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
 	  goto error;
 	}
 
@@ -1743,7 +2401,7 @@ mxml_load_data(
 	{
 	  if (ch == '>' && bufptr > buffer && bufptr[-1] == '?')
 	    break;
-	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	  else if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	    goto error;
 
 	  if (ch == '\n')
@@ -1760,7 +2418,7 @@ mxml_load_data(
 	  * Print error and return...
 	  */
 
-	  mxml_error("Early EOF in processing instruction node on line %d.", line);
+	  _mxml_error(global, "Early EOF in processing instruction node on line %d.", line);
 	  goto error;
 	}
 
@@ -1776,17 +2434,20 @@ mxml_load_data(
 	  * There can only be one root element!
 	  */
 
-	  mxml_error("<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
+	  _mxml_error(global, "<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
           goto error;
 	}
 
-	if ((node = mxmlNewElement(parent, buffer)) == NULL)
+	if (elide)
+	  mxml_elide_space(parent, &first);
+
+	if ((node = mxmlNewElement(parent ? parent : orphan, buffer)) == NULL)
 	{
 	 /*
 	  * Print error and return...
 	  */
 
-	  mxml_error("Unable to add processing instruction node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  _mxml_error(global, "Unable to add processing instruction node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
 	  goto error;
 	}
 
@@ -1828,11 +2489,11 @@ mxml_load_data(
 	  {
             if (ch == '&')
             {
-	      if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line)) == EOF)
+	      if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line, global)) == EOF)
 		goto error;
             }
 
-	    if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+	    if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	      goto error;
 	  }
 
@@ -1851,7 +2512,7 @@ mxml_load_data(
 	  * Print error and return...
 	  */
 
-	  mxml_error("Early EOF in declaration node on line %d.", line);
+	  _mxml_error(global, "Early EOF in declaration node on line %d.", line);
 	  goto error;
 	}
 
@@ -1867,17 +2528,20 @@ mxml_load_data(
 	  * There can only be one root element!
 	  */
 
-	  mxml_error("<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
+	  _mxml_error(global, "<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
           goto error;
 	}
 
-	if ((node = mxmlNewElement(parent, buffer)) == NULL)
+	if (elide)
+	  mxml_elide_space(parent, &first);
+
+	if ((node = mxmlNewElement(parent ? parent : orphan, buffer)) == NULL)
 	{
 	 /*
 	  * Print error and return...
 	  */
 
-	  mxml_error("Unable to add declaration node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  _mxml_error(global, "Unable to add declaration node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
 	  goto error;
 	}
 
@@ -1917,7 +2581,7 @@ mxml_load_data(
 	  * Close tag doesn't match tree; print an error for now...
 	  */
 
-	  mxml_error("Mismatched close tag <%s> under parent <%s> on line %d.", buffer, parent ? parent->value.element.name : "(null)", line);
+	  _mxml_error(global, "Mismatched close tag <%s> under parent <%s> on line %d.", buffer, parent ? parent->value.element.name : "(null)", line);
           goto error;
 	}
 
@@ -1958,30 +2622,36 @@ mxml_load_data(
 	  * There can only be one root element!
 	  */
 
-	  mxml_error("<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
+	  _mxml_error(global, "<%s> cannot be a second root node after <%s> on line %d.", buffer, first->value.element.name, line);
           goto error;
 	}
 
-        if ((node = mxmlNewElement(parent, buffer)) == NULL)
+        if (elide)
+          mxml_elide_space(parent, &first);
+
+        if ((node = mxmlNewElement(parent ? parent : orphan, buffer)) == NULL)
 	{
 	 /*
 	  * Just print error for now...
 	  */
 
-	  mxml_error("Unable to add element node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  _mxml_error(global, "Unable to add element node to parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
 	  goto error;
 	}
 
         if (mxml_isspace(ch))
         {
-	  if ((ch = mxml_parse_element(node, p, &encoding, getc_cb, &line)) == EOF)
+	  if ((ch = mxml_parse_element(node, p, &encoding, getc_cb, &line, global)) == EOF)
+	  {
+	    mxmlDelete(node);
 	    goto error;
+	  }
         }
         else if (ch == '/')
 	{
 	  if ((ch = (*getc_cb)(p, &encoding)) != '>')
 	  {
-	    mxml_error("Expected > but got '%c' instead for element <%s/> on line %d.", ch, buffer, line);
+	    _mxml_error(global, "Expected > but got '%c' instead for element <%s/> on line %d.", ch, buffer, line);
             mxmlDelete(node);
             goto error;
 	  }
@@ -2022,35 +2692,137 @@ mxml_load_data(
 
       bufptr  = buffer;
     }
+    else if (type == MXML_CUSTOM && global->custom_feed_cb)
+    {
+     /*
+      * Pass character straight to the custom value...
+      */
+
+      if (ch == '&' && (ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line, global)) == EOF)
+	goto error;
+
+      if (!feed && (feed = mxmlNewCustom(parent ? parent : orphan, NULL, NULL)) == NULL)
+      {
+	_mxml_error(global, "Unable to add value node of type %s to parent <%s> on line %d.", types[type], parent ? parent->value.element.name : "null", line);
+	goto error;
+      }
+
+      if (feedptr >= (feedbuf + feedsize - 4))
+      {
+        if ((*global->custom_feed_cb)(feed, feedbuf, (int)(feedptr - feedbuf)))
+        {
+	  _mxml_error(global, "Bad custom value in parent <%s> on line %d.", parent ? parent->value.element.name : "null", line);
+	  goto error;
+        }
+
+        feedptr = feedbuf;
+      }
+
+      mxml_add_char(ch, &feedptr, &feedbuf, &feedsize, global);
+
+      feedptr += (*span_cb)(p, encoding, feedptr, (int)(feedbuf + feedsize - 4 - feedptr), &line);
+    }
+    else if (defer && (type == MXML_OPAQUE || type == MXML_IGNORE) &&
+             bufptr == buffer && mxml_plain_char(ch) &&
+             (view = (*skip_cb)(p, encoding, type == MXML_IGNORE ? 1 : _MXML_DEFER_MIN, &viewlen)) != NULL)
+    {
+     /*
+      * Leave a long run of text, or any ignored text, in the mapped data
+      * without checking it...
+      */
+
+      if (type == MXML_IGNORE)
+        continue;
+
+      if (elide && parent && parent->last_child &&
+          parent->last_child->type == MXML_ELEMENT)
+      {
+        for (ptr = (char *)view; ptr < view + viewlen && mxml_isspace(*ptr); ptr ++);
+
+        if (ptr == view + viewlen)
+          continue;
+      }
+
+      if ((node = _mxml_new_view(parent ? parent : orphan, view, viewlen)) == NULL)
+      {
+	_mxml_error(global, "Unable to add value node of type %s to parent <%s> on line %d.", types[type], parent ? parent->value.element.name : "null", line);
+	goto error;
+      }
+
+      if (sax_cb)
+      {
+        (*sax_cb)(node, MXML_SAX_DATA, sax_data);
+
+        if (!mxmlRelease(node))
+          node = NULL;
+      }
+
+      if (!first && node)
+        first = node;
+    }
     else if (ch == '&')
     {
      /*
       * Add character entity to current buffer...
       */
 
-      if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line)) == EOF)
+      if ((ch = mxml_get_entity(parent, p, &encoding, getc_cb, &line, global)) == EOF)
 	goto error;
 
-      if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+      if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
 	goto error;
     }
     else if (type == MXML_OPAQUE || type == MXML_CUSTOM || !mxml_isspace(ch))
     {
      /*
-      * Add character to current buffer...
+      * Add character to current buffer, along with any plain text after it...
       */
 
-      if (mxml_add_char(ch, &bufptr, &buffer, &bufsize))
+      if (mxml_add_char(ch, &bufptr, &buffer, &bufsize, global))
+	goto error;
+
+      if ((type == MXML_OPAQUE || type == MXML_CUSTOM) &&
+          mxml_add_span(p, span_cb, encoding, &bufptr, &buffer, &bufsize, &line, global))
 	goto error;
     }
   }
   while ((ch = (*getc_cb)(p, &encoding)) != EOF);
 
+  end_of_data:
+
+  if (state && state->starved)
+  {
+   /*
+    * Keep everything for the next chunk of a push load...
+    */
+
+    state->first         = first;
+    state->parent        = parent;
+    state->feed          = feed;
+    state->type          = type;
+    state->line          = line;
+    state->whitespace    = whitespace;
+    state->elide         = elide;
+    state->encoding      = encoding;
+    state->buffer        = buffer;
+    state->bufptr        = bufptr;
+    state->feedbuf       = feedbuf;
+    state->feedptr       = feedptr;
+    state->bufsize       = bufsize;
+    state->feedsize      = feedsize;
+    state->suspended     = 1;
+
+    state->arena_pending = pending.value.integer;
+
+    return (NULL);
+  }
+
  /*
-  * Free the string buffer - we don't need it anymore...
+  * Free the string buffers - we don't need them anymore...
   */
 
   free(buffer);
+  free(feedbuf);
 
  /*
   * Find the top element and return it...
@@ -2065,7 +2837,7 @@ mxml_load_data(
 
     if (node != parent)
     {
-      mxml_error("Missing close tag </%s> under parent <%s> on line %d.", node->value.element.name, node->parent ? node->parent->value.element.name : "(null)", line);
+      _mxml_error(global, "Missing close tag </%s> under parent <%s> on line %d.", node->value.element.name, node->parent ? node->parent->value.element.name : "(null)", line);
 
       mxmlDelete(first);
 
@@ -2087,6 +2859,7 @@ mxml_load_data(
   mxmlDelete(first);
 
   free(buffer);
+  free(feedbuf);
 
   return (NULL);
 }
@@ -2102,7 +2875,8 @@ mxml_parse_element(
     void            *p,			/* I  - Data to read from */
     int             *encoding,		/* IO - Encoding */
     _mxml_getc_cb_t getc_cb,		/* I  - Data callback */
-    int             *line)		/* IO - Current line number */
+    int             *line,		/* IO - Current line number */
+    _mxml_global_t  *global)		/* I  - Options */
 {
   int	ch,				/* Current character in file */
 	quote;				/* Quoting character */
@@ -2119,7 +2893,7 @@ mxml_parse_element(
 
   if ((name = malloc(64)) == NULL)
   {
-    mxml_error("Unable to allocate memory for name!");
+    _mxml_error(global, "Unable to allocate memory for name!");
     return (EOF);
   }
 
@@ -2128,7 +2902,7 @@ mxml_parse_element(
   if ((value = malloc(64)) == NULL)
   {
     free(name);
-    mxml_error("Unable to allocate memory for value!");
+    _mxml_error(global, "Unable to allocate memory for value!");
     return (EOF);
   }
 
@@ -2170,7 +2944,7 @@ mxml_parse_element(
 
       if (quote != '>')
       {
-        mxml_error("Expected '>' after '%c' for element %s, but got '%c' on line %d.", ch, node->value.element.name, quote, *line);
+        _mxml_error(global, "Expected '>' after '%c' for element %s, but got '%c' on line %d.", ch, node->value.element.name, quote, *line);
         goto error;
       }
 
@@ -2178,7 +2952,7 @@ mxml_parse_element(
     }
     else if (ch == '<')
     {
-      mxml_error("Bare < in element %s on line %d.", node->value.element.name, *line);
+      _mxml_error(global, "Bare < in element %s on line %d.", node->value.element.name, *line);
       goto error;
     }
     else if (ch == '>')
@@ -2203,13 +2977,13 @@ mxml_parse_element(
       {
         if (ch == '&')
         {
-	  if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line)) == EOF)
+	  if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line, global)) == EOF)
 	    goto error;
 	}
 	else if (ch == '\n')
 	  (*line)++;
 
-	if (mxml_add_char(ch, &ptr, &name, &namesize))
+	if (mxml_add_char(ch, &ptr, &name, &namesize, global))
 	  goto error;
 
 	if (ch == quote)
@@ -2235,11 +3009,11 @@ mxml_parse_element(
 	{
           if (ch == '&')
           {
-	    if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line)) == EOF)
+	    if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line, global)) == EOF)
 	      goto error;
           }
 
-	  if (mxml_add_char(ch, &ptr, &name, &namesize))
+	  if (mxml_add_char(ch, &ptr, &name, &namesize, global))
 	    goto error;
 	}
       }
@@ -2249,7 +3023,7 @@ mxml_parse_element(
 
     if (mxmlElementGetAttr(node, name))
     {
-      mxml_error("Duplicate attribute '%s' in element %s on line %d.", name, node->value.element.name, name, *line);
+      _mxml_error(global, "Duplicate attribute '%s' in element %s on line %d.", name, node->value.element.name, *line);
       goto error;
     }
 
@@ -2275,7 +3049,7 @@ mxml_parse_element(
 
       if (ch == EOF)
       {
-        mxml_error("Missing value for attribute '%s' in element %s on line %d.", name, node->value.element.name, *line);
+        _mxml_error(global, "Missing value for attribute '%s' in element %s on line %d.", name, node->value.element.name, *line);
         goto error;
       }
 
@@ -2298,13 +3072,13 @@ mxml_parse_element(
 	  {
 	    if (ch == '&')
 	    {
-	      if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line)) == EOF)
+	      if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line, global)) == EOF)
 	        goto error;
 	    }
 	    else if (ch == '\n')
 	      (*line)++;
 
-	    if (mxml_add_char(ch, &ptr, &value, &valsize))
+	    if (mxml_add_char(ch, &ptr, &value, &valsize, global))
 	      goto error;
 	  }
 	}
@@ -2333,11 +3107,11 @@ mxml_parse_element(
 	  {
 	    if (ch == '&')
 	    {
-	      if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line)) == EOF)
+	      if ((ch = mxml_get_entity(node, p, encoding, getc_cb, line, global)) == EOF)
 	        goto error;
 	    }
 
-	    if (mxml_add_char(ch, &ptr, &value, &valsize))
+	    if (mxml_add_char(ch, &ptr, &value, &valsize, global))
 	      goto error;
 	  }
 	}
@@ -2353,7 +3127,7 @@ mxml_parse_element(
     }
     else
     {
-      mxml_error("Missing value for attribute '%s' in element %s on line %d.", name, node->value.element.name, *line);
+      _mxml_error(global, "Missing value for attribute '%s' in element %s on line %d.", name, node->value.element.name, *line);
       goto error;
     }
 
@@ -2371,7 +3145,7 @@ mxml_parse_element(
 
       if (quote != '>')
       {
-        mxml_error("Expected '>' after '%c' for element %s, but got '%c' on line %d.", ch, node->value.element.name, quote, *line);
+        _mxml_error(global, "Expected '>' after '%c' for element %s, but got '%c' on line %d.", ch, node->value.element.name, quote, *line);
         ch = EOF;
       }
 
@@ -2403,19 +3177,330 @@ mxml_parse_element(
 }
 
 
+/*
+ * 'mxml_push_getc()' - Get a character from the data a push parser can load now.
+ */
+
+static int				/* O  - Character or EOF */
+mxml_push_getc(void *p,			/* I  - Parser */
+               int  *encoding)		/* IO - Encoding */
+{
+  mxml_parser_t	*parser = (mxml_parser_t *)p;
+					/* Parser */
+
+
+  if (parser->buf.current >= parser->buf.end && !parser->final)
+  {
+    parser->state.starved = 1;
+    return (EOF);
+  }
+
+  return (mxml_fd_getc(p, encoding));
+}
+
+
+/*
+ * 'mxml_push_load()' - Load the data a push parser has scanned.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+mxml_push_load(mxml_parser_t *parser)	/* I - Parser */
+{
+  mxml_node_t	*node;			/* Loaded tree */
+  size_t	bytes;			/* Bytes loaded */
+
+
+  parser->buf.current     = parser->data;
+  parser->buf.end         = parser->data + (parser->final ? parser->used : parser->safe);
+  parser->state.starved   = 0;
+  parser->state.suspended = 0;
+
+  node = mxml_load_data(parser->top, parser, parser->cb, mxml_push_getc, mxml_fd_span, NULL, NULL, parser->sax_cb, parser->sax_data, &parser->state, parser->buf.global);
+
+  if (!parser->state.suspended)
+  {
+    parser->done   = 1;
+    parser->result = node;
+
+    return (node ? 0 : -1);
+  }
+
+ /*
+  * Keep the rest of the data for the next chunk...
+  */
+
+  bytes = (size_t)(parser->buf.current - parser->data);
+
+  memmove(parser->data, parser->data + bytes, parser->used - bytes);
+
+  parser->used    -= bytes;
+  parser->scanned -= bytes;
+  parser->safe    -= bytes;
+
+  return (0);
+}
+
+
+/*
+ * 'mxml_push_scan()' - Find how much of a push parser's data can be loaded.
+ *
+ * The load reads tags, entities and characters with nested loops that cannot
+ * stop in the middle, so it may only be given data up to the end of the last
+ * complete one.  This follows the syntax as far as needed to find that point;
+ * after anything @code mxml_load_data()@ reports as an error the rest is held
+ * until the data is finished.
+ */
+
+static void
+mxml_push_scan(mxml_parser_t *parser)	/* I - Parser */
+{
+  unsigned char	*ptr,			/* Pointer into data */
+		*end;			/* End of data */
+  int		ch;			/* Current byte */
+
+
+  for (ptr = parser->data + parser->scanned, end = parser->data + parser->used;
+       ptr < end && parser->scan != _MXML_SCAN_HOLD;
+       ptr ++)
+  {
+    ch = *ptr;
+
+    if (ch == 0xfe || ch == 0xff)
+    {
+     /*
+      * Byte order marks switch to UTF-16, which is only loaded as a whole...
+      */
+
+      parser->scan = _MXML_SCAN_HOLD;
+    }
+
+    switch (parser->scan)
+    {
+      case _MXML_SCAN_TEXT :
+          if (parser->need)
+          {
+           /*
+	    * A zero width no-break space is read together with the next
+	    * character...
+	    */
+
+            if (--parser->need == 0 && (ch != 0xbf || ptr[-1] != 0xbb || ptr[-2] != 0xef))
+              parser->safe = (size_t)(ptr + 1 - parser->data);
+          }
+          else if (ch == '<')
+          {
+            parser->scan  = _MXML_SCAN_NAME;
+            parser->count = 0;
+          }
+          else if (ch == '&')
+            parser->scan = _MXML_SCAN_ENTITY;
+          else if ((ch & 0xe0) == 0xc0)
+            parser->need = 1;
+          else if ((ch & 0xf0) == 0xe0)
+            parser->need = 2;
+          else if ((ch & 0xf8) == 0xf0)
+            parser->need = 3;
+          else
+            parser->safe = (size_t)(ptr + 1 - parser->data);
+          break;
+
+      case _MXML_SCAN_ENTITY :
+          if (ch > 126 || (!isalnum(ch) && ch != '#'))
+          {
+            parser->scan = _MXML_SCAN_TEXT;
+            parser->safe = (size_t)(ptr + 1 - parser->data);
+          }
+          break;
+
+      case _MXML_SCAN_NAME :
+          if (mxml_isspace(ch) || ch == '>' || (ch == '/' && parser->count > 0))
+          {
+            if (ch == '>')
+              parser->scan = _MXML_SCAN_END;
+            else if (parser->count > 0 && (parser->name[0] == '!' || parser->name[0] == '/'))
+              parser->scan = _MXML_SCAN_TAG;
+            else if (ch == '/')
+              parser->scan = _MXML_SCAN_SLASH;
+            else
+              parser->scan = _MXML_SCAN_SPACE;
+          }
+          else if (ch == '<' || ch == '&' ||
+                   (ch < '0' && ch != '!' && ch != '-' && ch != '.' && ch != '/'))
+            parser->scan = _MXML_SCAN_HOLD;
+          else
+          {
+            if (parser->count < (int)sizeof(parser->name))
+              parser->name[parser->count] = (char)ch;
+
+            parser->count ++;
+
+            if (parser->count == 1 && ch == '?')
+              parser->scan = _MXML_SCAN_PI;
+            else if (parser->count == 3 && !memcmp(parser->name, "!--", 3))
+              parser->scan = _MXML_SCAN_COMMENT;
+            else if (parser->count == 8 && !memcmp(parser->name, "![CDATA[", 8))
+              parser->scan = _MXML_SCAN_CDATA;
+          }
+          break;
+
+      case _MXML_SCAN_TAG :
+          if (ch == '>')
+            parser->scan = _MXML_SCAN_END;
+          break;
+
+      case _MXML_SCAN_SPACE :
+          if (ch == '/' || ch == '?')
+            parser->scan = _MXML_SCAN_SLASH;
+          else if (ch == '>')
+            parser->scan = _MXML_SCAN_END;
+          else if (ch == '<' || ch == '\"' || ch == '\'')
+            parser->scan = _MXML_SCAN_HOLD;
+          else if (!mxml_isspace(ch))
+            parser->scan = _MXML_SCAN_ATTR;
+          break;
+
+      case _MXML_SCAN_ATTR :
+          if (ch == '=')
+            parser->scan = _MXML_SCAN_VALUE;
+          else if (mxml_isspace(ch))
+            parser->scan = _MXML_SCAN_EQUALS;
+          else if (ch == '/' || ch == '>' || ch == '?')
+            parser->scan = _MXML_SCAN_HOLD;
+          break;
+
+      case _MXML_SCAN_EQUALS :
+          if (ch == '=')
+            parser->scan = _MXML_SCAN_VALUE;
+          else if (!mxml_isspace(ch))
+            parser->scan = _MXML_SCAN_HOLD;
+          break;
+
+      case _MXML_SCAN_VALUE :
+          if (ch == '\"' || ch == '\'')
+          {
+            parser->scan  = _MXML_SCAN_QUOTED;
+            parser->quote = ch;
+          }
+          else if (!mxml_isspace(ch))
+            parser->scan = _MXML_SCAN_UNQUOTED;
+          break;
+
+      case _MXML_SCAN_QUOTED :
+          if (ch == parser->quote)
+            parser->scan = _MXML_SCAN_SPACE;
+          break;
+
+      case _MXML_SCAN_UNQUOTED :
+          if (mxml_isspace(ch) || ch == '=')
+            parser->scan = _MXML_SCAN_SPACE;
+          else if (ch == '/')
+            parser->scan = _MXML_SCAN_SLASH;
+          else if (ch == '>')
+            parser->scan = _MXML_SCAN_END;
+          break;
+
+      case _MXML_SCAN_SLASH :
+          parser->scan = _MXML_SCAN_END;
+          break;
+
+      case _MXML_SCAN_COMMENT :
+          if (ch == '>' && parser->count > 4 && parser->last[0] != '-' &&
+              parser->last[1] == '-' && parser->last[2] == '-')
+            parser->scan = _MXML_SCAN_END;
+          else
+            parser->count ++;
+          break;
+
+      case _MXML_SCAN_CDATA :
+          if (ch == '>' && parser->last[1] == ']' && parser->last[2] == ']')
+            parser->scan = _MXML_SCAN_END;
+          break;
+
+      case _MXML_SCAN_PI :
+          if (ch == '>' && parser->last[2] == '?')
+            parser->scan = _MXML_SCAN_END;
+          break;
+    }
+
+    if (parser->scan == _MXML_SCAN_END)
+    {
+     /*
+      * The tag is complete, so everything up to here can be loaded...
+      */
+
+      parser->scan = _MXML_SCAN_TEXT;
+      parser->safe = (size_t)(ptr + 1 - parser->data);
+    }
+
+   /*
+    * Remember the last bytes for the ends of comments, CDATA and processing
+    * instructions...
+    */
+
+    parser->last[0] = parser->last[1];
+    parser->last[1] = parser->last[2];
+    parser->last[2] = (char)ch;
+  }
+
+  parser->scanned = (size_t)(ptr - parser->data);
+}
+
+
+/*
+ * 'mxml_span()' - Copy plain text up to the next markup, entity or non-ASCII character.
+ */
+
+static int				/* O  - Number of bytes copied */
+mxml_span(const unsigned char *src,	/* I  - Source */
+          int                 max,	/* I  - Maximum number of bytes */
+          char                *dst,	/* I  - Destination */
+          int                 *line)	/* IO - Current line number */
+{
+  int	bytes;				/* Bytes copied */
+
+
+  for (bytes = 0; bytes < max && mxml_plain_char(src[bytes]); bytes ++)
+  {
+    if ((dst[bytes] = (char)src[bytes]) == '\n')
+      (*line) ++;
+  }
+
+  return (bytes);
+}
+
+
+/*
+ * 'mxml_string_flush()' - Count the bytes that did not fit in a string.
+ *
+ * Once the string is full, the rest of the output goes to the overflow
+ * buffer, which is reused each time it fills.
+ */
+
+static int				/* O - 0 on success */
+mxml_string_flush(_mxml_wbuf_t *buf)	/* I - Output buffer */
+{
+  buf->bytes   += (size_t)(buf->current - buf->start);
+  buf->start   = buf->overflow;
+  buf->current = buf->overflow;
+  buf->end     = buf->overflow + _MXML_WRITE_SIZE;
+
+  return (0);
+}
+
+
 /*
  * 'mxml_string_getc()' - Get a character from a string.
  */
 
 static int				/* O  - Character or EOF */
-mxml_string_getc(void *p,		/* I  - Pointer to file */
+mxml_string_getc(void *p,		/* I  - String buffer */
                  int  *encoding)	/* IO - Encoding */
 {
   int		ch;			/* Character */
-  const char	**s;			/* Pointer to string pointer */
-
+  _mxml_strbuf_t *buf = (_mxml_strbuf_t *)p;
+					/* String buffer */
+  const char	**s = &buf->s;		/* Pointer to string pointer */
 
-  s = (const char **)p;
 
   if ((ch = (*s)[0] & 255) != 0 || *encoding == ENCODE_UTF16LE)
   {
@@ -2436,7 +3521,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
 	    if (mxml_bad_char(ch))
 	    {
-	      mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	      _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         		 ch);
 	      return (EOF);
 	    }
@@ -2486,7 +3571,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
 	    if (ch < 0x80)
 	    {
-	      mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	      _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	      return (EOF);
 	    }
 
@@ -2512,7 +3597,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
 	    if (ch < 0x800)
 	    {
-	      mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	      _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	      return (EOF);
 	    }
 
@@ -2547,7 +3632,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
 	    if (ch < 0x10000)
 	    {
-	      mxml_error("Invalid UTF-8 sequence for character 0x%04x!", ch);
+	      _mxml_error(buf->global, "Invalid UTF-8 sequence for character 0x%04x!", ch);
 	      return (EOF);
 	    }
 
@@ -2570,7 +3655,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
           if (mxml_bad_char(ch))
 	  {
-	    mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	    _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         	       ch);
 	    return (EOF);
 	  }
@@ -2618,7 +3703,7 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
           if (mxml_bad_char(ch))
 	  {
-	    mxml_error("Bad control character 0x%02x not allowed by XML standard!",
+	    _mxml_error(buf->global, "Bad control character 0x%02x not allowed by XML standard!",
         	       ch);
 	    return (EOF);
 	  }
@@ -2656,22 +3741,59 @@ mxml_string_getc(void *p,		/* I  - Pointer to file */
 
 
 /*
- * 'mxml_string_putc()' - Write a character to a string.
+ * 'mxml_string_span()' - Copy a run of plain text from a string.
+ *
+ * The nul terminator is not plain text, so the run never reads past it.
+ */
+
+static int				/* O  - Number of bytes copied */
+mxml_string_span(void *p,		/* I  - String buffer */
+                 int  encoding,		/* I  - Encoding */
+                 char *dst,		/* I  - Destination */
+                 int  max,		/* I  - Maximum number of bytes */
+                 int  *line)		/* IO - Current line number */
+{
+  const char	**s = &((_mxml_strbuf_t *)p)->s;
+					/* Pointer to string pointer */
+  int		bytes;			/* Bytes copied */
+
+
+  if (encoding != ENCODE_UTF8)
+    return (0);
+
+  bytes = mxml_span((const unsigned char *)*s, max, dst, line);
+  *s    += bytes;
+
+  return (bytes);
+}
+
+
+/*
+ * 'mxml_write_bytes()' - Write a run of bytes.
  */
 
 static int				/* O - 0 on success, -1 on failure */
-mxml_string_putc(int  ch,		/* I - Character to write */
-                 void *p)		/* I - Pointer to string pointers */
+mxml_write_bytes(_mxml_wbuf_t *buf,	/* I - Output buffer */
+                 const char   *s,	/* I - Bytes to write */
+		 size_t       len)	/* I - Number of bytes */
 {
-  char	**pp;				/* Pointer to string pointers */
+  size_t	bytes;			/* Bytes to copy */
+
 
+  while (len > 0)
+  {
+    if (buf->current >= buf->end && (*buf->flush_cb)(buf) < 0)
+      return (-1);
 
-  pp = (char **)p;
+    if ((bytes = (size_t)(buf->end - buf->current)) > len)
+      bytes = len;
 
-  if (pp[0] < pp[1])
-    pp[0][0] = ch;
+    memcpy(buf->current, s, bytes);
 
-  pp[0] ++;
+    buf->current += bytes;
+    s            += bytes;
+    len          -= bytes;
+  }
 
   return (0);
 }
@@ -2682,10 +3804,8 @@ mxml_string_putc(int  ch,		/* I - Character to write */
  */
 
 static int				/* O - 0 on success, -1 on failure */
-mxml_write_name(const char *s,		/* I - Name to write */
-                void       *p,		/* I - Write pointer */
-		int        (*putc_cb)(int, void *))
-					/* I - Write callback */
+mxml_write_name(const char   *s,	/* I - Name to write */
+                _mxml_wbuf_t *buf)	/* I - Output buffer */
 {
   char		quote;			/* Quote character */
   const char	*name;			/* Entity name */
@@ -2697,7 +3817,7 @@ mxml_write_name(const char *s,		/* I - Name to write */
     * Write a quoted name string...
     */
 
-    if ((*putc_cb)(*s, p) < 0)
+    if (mxml_write_char(buf, *s) < 0)
       return (-1);
 
     quote = *s++;
@@ -2706,21 +3826,12 @@ mxml_write_name(const char *s,		/* I - Name to write */
     {
       if ((name = mxmlEntityGetName(*s)) != NULL)
       {
-	if ((*putc_cb)('&', p) < 0)
-          return (-1);
-
-        while (*name)
-	{
-	  if ((*putc_cb)(*name, p) < 0)
-            return (-1);
-
-          name ++;
-	}
-
-	if ((*putc_cb)(';', p) < 0)
+	if (mxml_write_char(buf, '&') < 0 ||
+	    mxml_write_bytes(buf, name, strlen(name)) < 0 ||
+	    mxml_write_char(buf, ';') < 0)
           return (-1);
       }
-      else if ((*putc_cb)(*s, p) < 0)
+      else if (mxml_write_char(buf, *s) < 0)
 	return (-1);
 
       s ++;
@@ -2730,7 +3841,7 @@ mxml_write_name(const char *s,		/* I - Name to write */
     * Write the end quote...
     */
 
-    if ((*putc_cb)(quote, p) < 0)
+    if (mxml_write_char(buf, quote) < 0)
       return (-1);
   }
   else
@@ -2739,13 +3850,8 @@ mxml_write_name(const char *s,		/* I - Name to write */
     * Write a non-quoted name string...
     */
 
-    while (*s)
-    {
-      if ((*putc_cb)(*s, p) < 0)
-	return (-1);
-
-      s ++;
-    }
+    if (mxml_write_bytes(buf, s, strlen(s)) < 0)
+      return (-1);
   }
 
   return (0);
@@ -2758,15 +3864,15 @@ mxml_write_name(const char *s,		/* I - Name to write */
 
 static int				/* O - Column or -1 on error */
 mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
-                void            *p,	/* I - File to write to */
+                _mxml_wbuf_t    *buf,	/* I - Output buffer */
 	        mxml_save_cb_t  cb,	/* I - Whitespace callback */
 		int             col,	/* I - Current column */
-		_mxml_putc_cb_t putc_cb,/* I - Output callback */
 		_mxml_global_t  *global)/* I - Global data */
 {
   mxml_node_t	*current,		/* Current node */
 		*next;			/* Next node */
   int		i,			/* Looping var */
+		len,			/* Length of string written */
 		width;			/* Width of attr + value */
   _mxml_attr_t	*attr;			/* Current attribute */
   char		s[255];			/* Temporary string */
@@ -2785,9 +3891,9 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
     switch (current->type)
     {
       case MXML_ELEMENT :
-	  col = mxml_write_ws(current, p, cb, MXML_WS_BEFORE_OPEN, col, putc_cb);
+	  col = mxml_write_ws(current, buf, cb, MXML_WS_BEFORE_OPEN, col);
 
-	  if ((*putc_cb)('<', p) < 0)
+	  if (mxml_write_char(buf, '<') < 0)
 	    return (-1);
 	  if (current->value.element.name[0] == '?' ||
 	      !strncmp(current->value.element.name, "!--", 3))
@@ -2797,11 +3903,9 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	    * entities.
 	    */
 
-	    const char	*ptr;		/* Pointer into name */
-
-	    for (ptr = current->value.element.name; *ptr; ptr ++)
-	      if ((*putc_cb)(*ptr, p) < 0)
-		return (-1);
+	    if (mxml_write_bytes(buf, current->value.element.name,
+	                         strlen(current->value.element.name)) < 0)
+	      return (-1);
 	  }
 	  else if (!strncmp(current->value.element.name, "![CDATA[", 8))
 	  {
@@ -2810,18 +3914,12 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	    * "]]" terminator added at the end.
 	    */
 
-	    const char	*ptr;		/* Pointer into name */
-
-	    for (ptr = current->value.element.name; *ptr; ptr ++)
-	      if ((*putc_cb)(*ptr, p) < 0)
-		return (-1);
-
-            if ((*putc_cb)(']', p) < 0)
-              return (-1);
-            if ((*putc_cb)(']', p) < 0)
-              return (-1);
+	    if (mxml_write_bytes(buf, current->value.element.name,
+	                         strlen(current->value.element.name)) < 0 ||
+	        mxml_write_bytes(buf, "]]", 2) < 0)
+	      return (-1);
 	  }
-	  else if (mxml_write_name(current->value.element.name, p, putc_cb) < 0)
+	  else if (mxml_write_name(current->value.element.name, buf) < 0)
 	    return (-1);
 
 	  col += strlen(current->value.element.name) + 1;
@@ -2837,31 +3935,27 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 
 	    if (global->wrap > 0 && (col + width) > global->wrap)
 	    {
-	      if ((*putc_cb)('\n', p) < 0)
+	      if (mxml_write_char(buf, '\n') < 0)
 		return (-1);
 
 	      col = 0;
 	    }
 	    else
 	    {
-	      if ((*putc_cb)(' ', p) < 0)
+	      if (mxml_write_char(buf, ' ') < 0)
 		return (-1);
 
 	      col ++;
 	    }
 
-	    if (mxml_write_name(attr->name, p, putc_cb) < 0)
+	    if (mxml_write_name(attr->name, buf) < 0)
 	      return (-1);
 
 	    if (attr->value)
 	    {
-	      if ((*putc_cb)('=', p) < 0)
-		return (-1);
-	      if ((*putc_cb)('\"', p) < 0)
-		return (-1);
-	      if (mxml_write_string(attr->value, p, putc_cb) < 0)
-		return (-1);
-	      if ((*putc_cb)('\"', p) < 0)
+	      if (mxml_write_bytes(buf, "=\"", 2) < 0 ||
+	          mxml_write_string(attr->value, buf) < 0 ||
+		  mxml_write_char(buf, '\"') < 0)
 		return (-1);
 	    }
 
@@ -2874,12 +3968,12 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	    * Write children...
 	    */
 
-	    if ((*putc_cb)('>', p) < 0)
+	    if (mxml_write_char(buf, '>') < 0)
 	      return (-1);
 	    else
 	      col ++;
 
-	    col = mxml_write_ws(current, p, cb, MXML_WS_AFTER_OPEN, col, putc_cb);
+	    col = mxml_write_ws(current, buf, cb, MXML_WS_AFTER_OPEN, col);
 	  }
 	  else if (current->value.element.name[0] == '!' ||
 		   current->value.element.name[0] == '?')
@@ -2888,25 +3982,21 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	    * The ? and ! elements are special-cases...
 	    */
 
-	    if ((*putc_cb)('>', p) < 0)
+	    if (mxml_write_char(buf, '>') < 0)
 	      return (-1);
 	    else
 	      col ++;
 
-	    col = mxml_write_ws(current, p, cb, MXML_WS_AFTER_OPEN, col, putc_cb);
+	    col = mxml_write_ws(current, buf, cb, MXML_WS_AFTER_OPEN, col);
 	  }
 	  else
 	  {
-	    if ((*putc_cb)(' ', p) < 0)
-	      return (-1);
-	    if ((*putc_cb)('/', p) < 0)
-	      return (-1);
-	    if ((*putc_cb)('>', p) < 0)
+	    if (mxml_write_bytes(buf, " />", 3) < 0)
 	      return (-1);
 
 	    col += 3;
 
-	    col = mxml_write_ws(current, p, cb, MXML_WS_AFTER_OPEN, col, putc_cb);
+	    col = mxml_write_ws(current, buf, cb, MXML_WS_AFTER_OPEN, col);
 	  }
 	  break;
 
@@ -2915,29 +4005,30 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	  {
 	    if (global->wrap > 0 && col > global->wrap)
 	    {
-	      if ((*putc_cb)('\n', p) < 0)
+	      if (mxml_write_char(buf, '\n') < 0)
 		return (-1);
 
 	      col = 0;
 	    }
-	    else if ((*putc_cb)(' ', p) < 0)
+	    else if (mxml_write_char(buf, ' ') < 0)
 	      return (-1);
 	    else
 	      col ++;
 	  }
 
 	  snprintf(s, sizeof(s), "%d", current->value.integer);
-	  if (mxml_write_string(s, p, putc_cb) < 0)
+	  if ((len = mxml_write_string(s, buf)) < 0)
 	    return (-1);
 
-	  col += strlen(s);
+	  col += len;
 	  break;
 
       case MXML_OPAQUE :
-	  if (mxml_write_string(current->value.opaque, p, putc_cb) < 0)
+	  if (!_mxml_node_unview(current) ||
+	      (len = mxml_write_string(current->value.opaque, buf)) < 0)
 	    return (-1);
 
-	  col += strlen(current->value.opaque);
+	  col += len;
 	  break;
 
       case MXML_REAL :
@@ -2945,22 +4036,22 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	  {
 	    if (global->wrap > 0 && col > global->wrap)
 	    {
-	      if ((*putc_cb)('\n', p) < 0)
+	      if (mxml_write_char(buf, '\n') < 0)
 		return (-1);
 
 	      col = 0;
 	    }
-	    else if ((*putc_cb)(' ', p) < 0)
+	    else if (mxml_write_char(buf, ' ') < 0)
 	      return (-1);
 	    else
 	      col ++;
 	  }
 
 	  snprintf(s, sizeof(s), "%f", current->value.real);
-	  if (mxml_write_string(s, p, putc_cb) < 0)
+	  if ((len = mxml_write_string(s, buf)) < 0)
 	    return (-1);
 
-	  col += strlen(s);
+	  col += len;
 	  break;
 
       case MXML_TEXT :
@@ -2968,21 +4059,21 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	  {
 	    if (global->wrap > 0 && col > global->wrap)
 	    {
-	      if ((*putc_cb)('\n', p) < 0)
+	      if (mxml_write_char(buf, '\n') < 0)
 		return (-1);
 
 	      col = 0;
 	    }
-	    else if ((*putc_cb)(' ', p) < 0)
+	    else if (mxml_write_char(buf, ' ') < 0)
 	      return (-1);
 	    else
 	      col ++;
 	  }
 
-	  if (mxml_write_string(current->value.text.string, p, putc_cb) < 0)
+	  if ((len = mxml_write_string(current->value.text.string, buf)) < 0)
 	    return (-1);
 
-	  col += strlen(current->value.text.string);
+	  col += len;
 	  break;
 
       case MXML_CUSTOM :
@@ -2995,7 +4086,7 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	    if ((data = (*global->custom_save_cb)(current)) == NULL)
 	      return (-1);
 
-	    if (mxml_write_string(data, p, putc_cb) < 0)
+	    if (mxml_write_string(data, buf) < 0)
 	      return (-1);
 
 	    if ((newline = strrchr(data, '\n')) == NULL)
@@ -3045,20 +4136,16 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
 	  if (current->value.element.name[0] != '!' &&
 	      current->value.element.name[0] != '?')
 	  {
-	    col = mxml_write_ws(current, p, cb, MXML_WS_BEFORE_CLOSE, col, putc_cb);
+	    col = mxml_write_ws(current, buf, cb, MXML_WS_BEFORE_CLOSE, col);
 
-	    if ((*putc_cb)('<', p) < 0)
-	      return (-1);
-	    if ((*putc_cb)('/', p) < 0)
-	      return (-1);
-	    if (mxml_write_string(current->value.element.name, p, putc_cb) < 0)
-	      return (-1);
-	    if ((*putc_cb)('>', p) < 0)
+	    if (mxml_write_bytes(buf, "</", 2) < 0 ||
+	        (len = mxml_write_string(current->value.element.name, buf)) < 0 ||
+	        mxml_write_char(buf, '>') < 0)
 	      return (-1);
 
-	    col += strlen(current->value.element.name) + 3;
+	    col += len + 3;
 
-	    col = mxml_write_ws(current, p, cb, MXML_WS_AFTER_CLOSE, col, putc_cb);
+	    col = mxml_write_ws(current, buf, cb, MXML_WS_AFTER_CLOSE, col);
 	  }
 
 	  if (current == node)
@@ -3076,39 +4163,46 @@ mxml_write_node(mxml_node_t     *node,	/* I - Node to write */
  * 'mxml_write_string()' - Write a string, escaping & and < as needed.
  */
 
-static int				/* O - 0 on success, -1 on failure */
+static int				/* O - Length of string or -1 on failure */
 mxml_write_string(
-    const char      *s,			/* I - String to write */
-    void            *p,			/* I - Write pointer */
-    _mxml_putc_cb_t putc_cb)		/* I - Write callback */
+    const char   *s,			/* I - String to write */
+    _mxml_wbuf_t *buf)			/* I - Output buffer */
 {
+  const char	*start;			/* Start of string */
   const char	*name;			/* Entity name, if any */
+  size_t	len;			/* Length of run */
 
 
-  while (*s)
+  for (start = s;; s ++)
   {
-    if ((name = mxmlEntityGetName(*s)) != NULL)
+   /*
+    * Copy the run of characters up to the next one that mxmlEntityGetName
+    * has a name for...
+    */
+
+    if ((len = strcspn(s, "&<>\"")) > 0)
     {
-      if ((*putc_cb)('&', p) < 0)
+      if (mxml_write_bytes(buf, s, len) < 0)
         return (-1);
 
-      while (*name)
-      {
-	if ((*putc_cb)(*name, p) < 0)
-          return (-1);
-        name ++;
-      }
+      s += len;
+    }
+
+    if (!*s)
+      break;
 
-      if ((*putc_cb)(';', p) < 0)
+    if ((name = mxmlEntityGetName(*s)) != NULL)
+    {
+      if (mxml_write_char(buf, '&') < 0 ||
+          mxml_write_bytes(buf, name, strlen(name)) < 0 ||
+          mxml_write_char(buf, ';') < 0)
         return (-1);
     }
-    else if ((*putc_cb)(*s, p) < 0)
+    else if (mxml_write_char(buf, *s) < 0)
       return (-1);
-
-    s ++;
   }
 
-  return (0);
+  return ((int)(s - start));
 }
 
 
@@ -3118,22 +4212,22 @@ mxml_write_string(
 
 static int				/* O - New column */
 mxml_write_ws(mxml_node_t     *node,	/* I - Current node */
-              void            *p,	/* I - Write pointer */
+              _mxml_wbuf_t    *buf,	/* I - Output buffer */
               mxml_save_cb_t  cb,	/* I - Callback function */
 	      int             ws,	/* I - Where value */
-	      int             col,	/* I - Current column */
-              _mxml_putc_cb_t putc_cb)	/* I - Write callback */
+	      int             col)	/* I - Current column */
 {
   const char	*s;			/* Whitespace string */
 
 
   if (cb && (s = (*cb)(node, ws)) != NULL)
   {
-    while (*s)
+    if (mxml_write_bytes(buf, s, strlen(s)) < 0)
+      return (-1);
+
+    for (; *s; s ++)
     {
-      if ((*putc_cb)(*s, p) < 0)
-	return (-1);
-      else if (*s == '\n')
+      if (*s == '\n')
 	col = 0;
       else if (*s == '\t')
       {
@@ -3142,10 +4236,10 @@ mxml_write_ws(mxml_node_t     *node,	/* I - Current node */
       }
       else
 	col ++;
-
-      s ++;
     }
   }
 
   return (col);
 }
+
+
@@ -242,16 +242,55 @@ mxmlGetOpaque(mxml_node_t *node)	/* I - Node to get */
   */
 
   if (node->type == MXML_OPAQUE)
-    return (node->value.opaque);
+    return (_mxml_node_unview(node));
   else if (node->type == MXML_ELEMENT &&
            node->child &&
 	   node->child->type == MXML_OPAQUE)
-    return (node->child->value.opaque);
+    return (_mxml_node_unview(node->child));
   else
     return (NULL);
 }
 
 
+/*
+ * 'mxmlGetOpaqueView()' - Get an opaque value for a node or its first child without copying it.
+ *
+ * Unlike @link mxmlGetOpaque@, text loaded by @link mxmlLoadMapped@ is
+ * returned in place and is not nul-terminated; it is always followed by the
+ * '<' of the next tag.  Other opaque values are returned as stored.
+ * @code NULL@ is returned if the node (or its first child) is not an opaque
+ * value node.
+ */
+
+const char *				/* O - Opaque text or @code NULL@ */
+mxmlGetOpaqueView(mxml_node_t *node,	/* I - Node to get */
+                  size_t      *length)	/* O - Length of text */
+{
+ /*
+  * Range check input...
+  */
+
+  if (!node || !length)
+    return (NULL);
+
+  if (node->type == MXML_ELEMENT && node->child)
+    node = node->child;
+
+  if (node->type != MXML_OPAQUE || !node->value.opaque)
+    return (NULL);
+
+  if (node->flags & _MXML_NODE_VIEW)
+  {
+    *length = node->value.view.length;
+    return (node->value.view.data);
+  }
+
+  *length = strlen(node->value.opaque);
+
+  return (node->value.opaque);
+}
+
+
 /*
  * 'mxmlGetParent()' - Get the parent node.
  *
@@ -437,7 +476,7 @@ mxmlGetUserData(mxml_node_t *node)	/* I - Node to get */
   * Range check input...
   */
 
-  if (!node)
+  if (!node || (node->flags & _MXML_NODE_COMPACT))
     return (NULL);
 
  /*
@@ -18,16 +18,55 @@
 
 
 /*
- * Sort functions...
+ * Initial number of buckets in a hashed index...
  */
 
+#define _MXML_INDEX_BUCKETS	64
+
+
+/*
+ * Sort and hash functions...
+ */
+
+static int	index_add(mxml_index_t *ind, mxml_node_t *node);
 static int	index_compare(mxml_index_t *ind, mxml_node_t *first,
 		              mxml_node_t *second);
 static int	index_find(mxml_index_t *ind, const char *element,
 		           const char *value, mxml_node_t *node);
+static int	index_grow(mxml_index_t *ind);
+static unsigned	index_hash(const char *s);
+static mxml_node_t *index_hash_find(mxml_index_t *ind, const char *element,
+		                    const char *value);
+static void	index_link(mxml_index_t *ind, int i);
+static int	index_rehash(mxml_index_t *ind, int num_buckets);
 static void	index_sort(mxml_index_t *ind, int left, int right);
 
 
+/*
+ * 'mxmlIndexAdd()' - Add a node to an index.
+ *
+ * The node must be an element and, if the index has an attribute, have that
+ * attribute.  A hashed index appends the node in constant expected time; a
+ * sorted index inserts it in sort order, which moves the nodes after it.
+ * Start again with @link mxmlIndexReset@ before enumerating or finding.
+ */
+
+int					/* O - 0 on success, -1 on error */
+mxmlIndexAdd(mxml_index_t *ind,		/* I - Index */
+             mxml_node_t  *node)	/* I - Node to add */
+{
+ /*
+  * Range check input...
+  */
+
+  if (!ind || !node || node->type != MXML_ELEMENT ||
+      (ind->attr && !mxmlElementGetAttr(node, ind->attr)))
+    return (-1);
+
+  return (index_add(ind, node));
+}
+
+
 /*
  * 'mxmlIndexDelete()' - Delete an index.
  */
@@ -52,6 +91,8 @@ mxmlIndexDelete(mxml_index_t *ind)	/* I - Index to delete */
   if (ind->alloc_nodes)
     free(ind->nodes);
 
+  free(ind->buckets);
+  free(ind->entries);
   free(ind);
 }
 
@@ -61,7 +102,7 @@ mxmlIndexDelete(mxml_index_t *ind)	/* I - Index to delete */
  *
  * You should call @link mxmlIndexReset@ prior to using this function to get
  * the first node in the index.  Nodes are returned in the sorted order of the
- * index.
+ * index, or in the order they were added to a hashed index.
  */
 
 mxml_node_t *				/* O - Next node or @code NULL@ if there is none */
@@ -147,6 +188,13 @@ mxmlIndexFind(mxml_index_t *ind,	/* I - Index to search */
     return (NULL);
   }
 
+ /*
+  * Hashed indexes look the key up directly...
+  */
+
+  if (ind->num_buckets)
+    return (index_hash_find(ind, element, value));
+
  /*
   * If cur_node == 0, then find the first matching node...
   */
@@ -308,8 +356,7 @@ mxmlIndexNew(mxml_node_t *node,		/* I - XML node tree */
              const char  *attr)		/* I - Attribute to index or @code NULL@ for none */
 {
   mxml_index_t	*ind;			/* New index */
-  mxml_node_t	*current,		/* Current node in index */
-  		**temp;			/* Temporary node pointer array */
+  mxml_node_t	*current;		/* Current node in index */
 
 
  /*
@@ -345,29 +392,14 @@ mxmlIndexNew(mxml_node_t *node,		/* I - XML node tree */
 
   while (current)
   {
-    if (ind->num_nodes >= ind->alloc_nodes)
+    if (ind->num_nodes >= ind->alloc_nodes && index_grow(ind))
     {
-      if (!ind->alloc_nodes)
-        temp = malloc(64 * sizeof(mxml_node_t *));
-      else
-        temp = realloc(ind->nodes, (ind->alloc_nodes + 64) * sizeof(mxml_node_t *));
-
-      if (!temp)
-      {
-       /*
-        * Unable to allocate memory for the index, so abort...
-	*/
-
-        mxml_error("Unable to allocate %d bytes for index: %s",
-	           (ind->alloc_nodes + 64) * sizeof(mxml_node_t *),
-		   strerror(errno));
-
-        mxmlIndexDelete(ind);
-	return (NULL);
-      }
+     /*
+      * Unable to allocate memory for the index, so abort...
+      */
 
-      ind->nodes       = temp;
-      ind->alloc_nodes += 64;
+      mxmlIndexDelete(ind);
+      return (NULL);
     }
 
     ind->nodes[ind->num_nodes ++] = current;
@@ -452,6 +484,75 @@ mxmlIndexNew(mxml_node_t *node,		/* I - XML node tree */
 }
 
 
+/*
+ * 'mxmlIndexNewHash()' - Create a new hashed index.
+ *
+ * The index holds the same nodes as one made by @link mxmlIndexNew@, but
+ * hashes them by the value of "attr", or by element name if "attr" is
+ * @code NULL@, instead of sorting them.  Finding a value (or an element name
+ * when there is no attribute) takes constant expected time, matches are
+ * returned in the order the nodes were added, and @link mxmlIndexAdd@ can
+ * add more nodes cheaply.  "node" may be @code NULL@ to start with an empty
+ * index.  Finding an element name alone in an attribute index checks every
+ * node.
+ */
+
+mxml_index_t *				/* O - New index */
+mxmlIndexNewHash(mxml_node_t *node,	/* I - XML node tree or @code NULL@ */
+                 const char  *element,	/* I - Element to index or @code NULL@ for all */
+                 const char  *attr)	/* I - Attribute to index or @code NULL@ for none */
+{
+  mxml_index_t	*ind;			/* New index */
+  mxml_node_t	*current;		/* Current node in index */
+
+
+ /*
+  * Create a new index...
+  */
+
+  if ((ind = calloc(1, sizeof(mxml_index_t))) == NULL)
+  {
+    mxml_error("Unable to allocate %d bytes for index - %s",
+               (int)sizeof(mxml_index_t), strerror(errno));
+    return (NULL);
+  }
+
+  ind->next_match = -1;
+
+  if ((attr && (ind->attr = strdup(attr)) == NULL) ||
+      index_rehash(ind, _MXML_INDEX_BUCKETS))
+  {
+    mxmlIndexDelete(ind);
+    return (NULL);
+  }
+
+  if (!node)
+    return (ind);
+
+ /*
+  * Add the matching nodes in document order...
+  */
+
+  if (!element && !attr)
+    current = node;
+  else
+    current = mxmlFindElement(node, node, element, attr, NULL, MXML_DESCEND);
+
+  while (current)
+  {
+    if (current->type == MXML_ELEMENT && index_add(ind, current))
+    {
+      mxmlIndexDelete(ind);
+      return (NULL);
+    }
+
+    current = mxmlFindElement(current, node, element, attr, NULL, MXML_DESCEND);
+  }
+
+  return (ind);
+}
+
+
 /*
  * 'mxmlIndexReset()' - Reset the enumeration/find pointer in the index and
  *                      return the first node in the index.
@@ -491,6 +592,63 @@ mxmlIndexReset(mxml_index_t *ind)	/* I - Index to reset */
 }
 
 
+/*
+ * 'index_add()' - Add a node to an index.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+index_add(mxml_index_t *ind,		/* I - Index */
+          mxml_node_t  *node)		/* I - Node to add */
+{
+  int	first,				/* First node in search */
+	last,				/* Last node in search */
+	current;			/* Current node in search */
+
+
+  if (ind->num_nodes >= ind->alloc_nodes && index_grow(ind))
+    return (-1);
+
+  if (ind->num_buckets)
+  {
+   /*
+    * Append to the node's bucket, growing the table as the index fills...
+    */
+
+    ind->nodes[ind->num_nodes]        = node;
+    ind->entries[ind->num_nodes].hash = index_hash(ind->attr ? mxmlElementGetAttr(node, ind->attr) : node->value.element.name);
+
+    index_link(ind, ind->num_nodes ++);
+
+    if (ind->num_nodes > ind->num_buckets)
+      index_rehash(ind, ind->num_buckets * 2);
+
+    return (0);
+  }
+
+ /*
+  * Insert after any equal nodes in a sorted index...
+  */
+
+  for (first = 0, last = ind->num_nodes; first < last;)
+  {
+    current = (first + last) / 2;
+
+    if (index_compare(ind, node, ind->nodes[current]) < 0)
+      last = current;
+    else
+      first = current + 1;
+  }
+
+  memmove(ind->nodes + first + 1, ind->nodes + first,
+          (ind->num_nodes - first) * sizeof(mxml_node_t *));
+
+  ind->nodes[first] = node;
+  ind->num_nodes ++;
+
+  return (0);
+}
+
+
 /*
  * 'index_compare()' - Compare two nodes.
  */
@@ -571,6 +729,176 @@ index_find(mxml_index_t *ind,		/* I - Index */
 }
 
 
+/*
+ * 'index_grow()' - Make room for more nodes in an index.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+index_grow(mxml_index_t *ind)		/* I - Index */
+{
+  int		alloc_nodes;		/* New number of nodes */
+  mxml_node_t	**nodes;		/* New node array */
+  _mxml_ientry_t *entries;		/* New hash entries */
+
+
+  alloc_nodes = ind->alloc_nodes ? 2 * ind->alloc_nodes : 64;
+
+  if (ind->num_buckets)
+  {
+    if ((entries = realloc(ind->entries, alloc_nodes * sizeof(_mxml_ientry_t))) == NULL)
+    {
+      mxml_error("Unable to allocate %d bytes for index: %s",
+                 (int)(alloc_nodes * sizeof(_mxml_ientry_t)), strerror(errno));
+      return (-1);
+    }
+
+    ind->entries = entries;
+  }
+
+  if ((nodes = realloc(ind->nodes, alloc_nodes * sizeof(mxml_node_t *))) == NULL)
+  {
+    mxml_error("Unable to allocate %d bytes for index: %s",
+               (int)(alloc_nodes * sizeof(mxml_node_t *)), strerror(errno));
+    return (-1);
+  }
+
+  ind->nodes       = nodes;
+  ind->alloc_nodes = alloc_nodes;
+
+  return (0);
+}
+
+
+/*
+ * 'index_hash()' - Hash a key string.
+ */
+
+static unsigned				/* O - Hash value */
+index_hash(const char *s)		/* I - Key */
+{
+  unsigned	hash = 2166136261u;	/* FNV-1a hash */
+
+
+  while (*s)
+    hash = (hash ^ (unsigned char)*s++) * 16777619u;
+
+  return (hash);
+}
+
+
+/*
+ * 'index_hash_find()' - Find the next matching node in a hashed index.
+ */
+
+static mxml_node_t *			/* O - Node or @code NULL@ if none found */
+index_hash_find(mxml_index_t *ind,	/* I - Index to search */
+                const char   *element,	/* I - Element name to find, if any */
+                const char   *value)	/* I - Attribute value, if any */
+{
+  const char	*key = ind->attr ? value : element;
+					/* Hashed key */
+  unsigned	hash;			/* Hash of key */
+  int		current;		/* Current entry */
+
+
+  if (!key)
+  {
+   /*
+    * Only the element name is known, so check each node...
+    */
+
+    for (; ind->cur_node < ind->num_nodes; ind->cur_node ++)
+      if (!index_find(ind, element, NULL, ind->nodes[ind->cur_node]))
+        return (ind->nodes[ind->cur_node ++]);
+
+    return (NULL);
+  }
+
+  hash = index_hash(key);
+
+  if (ind->cur_node == 0)
+    current = ind->buckets[hash & (ind->num_buckets - 1)].first;
+  else
+    current = ind->next_match;
+
+  for (; current >= 0; current = ind->entries[current].next)
+  {
+    if (ind->entries[current].hash == hash &&
+        !index_find(ind, element, value, ind->nodes[current]))
+    {
+      ind->cur_node   = current + 1;
+      ind->next_match = ind->entries[current].next;
+
+      return (ind->nodes[current]);
+    }
+  }
+
+  ind->cur_node   = ind->num_nodes;
+  ind->next_match = -1;
+
+  return (NULL);
+}
+
+
+/*
+ * 'index_link()' - Append a hashed entry to its bucket.
+ */
+
+static void
+index_link(mxml_index_t *ind,		/* I - Index */
+           int          i)		/* I - Entry */
+{
+  _mxml_ibucket_t	*bucket = ind->buckets + (ind->entries[i].hash & (ind->num_buckets - 1));
+					/* Bucket for entry */
+
+
+  ind->entries[i].next = -1;
+
+  if (bucket->last >= 0)
+    ind->entries[bucket->last].next = i;
+  else
+    bucket->first = i;
+
+  bucket->last = i;
+}
+
+
+/*
+ * 'index_rehash()' - Rebuild the buckets of a hashed index.
+ *
+ * The old buckets are kept if the new ones cannot be allocated.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+index_rehash(mxml_index_t *ind,		/* I - Index */
+             int          num_buckets)	/* I - Number of buckets, a power of 2 */
+{
+  _mxml_ibucket_t	*buckets;	/* New buckets */
+  int			i;		/* Looping var */
+
+
+  if ((buckets = malloc(num_buckets * sizeof(_mxml_ibucket_t))) == NULL)
+  {
+    mxml_error("Unable to allocate %d bytes for index: %s",
+               (int)(num_buckets * sizeof(_mxml_ibucket_t)), strerror(errno));
+    return (-1);
+  }
+
+  for (i = 0; i < num_buckets; i ++)
+    buckets[i].first = buckets[i].last = -1;
+
+  free(ind->buckets);
+
+  ind->buckets     = buckets;
+  ind->num_buckets = num_buckets;
+
+  for (i = 0; i < ind->num_nodes; i ++)
+    index_link(ind, i);
+
+  return (0);
+}
+
+
 /*
  * 'index_sort()' - Sort the nodes in the index...
  *
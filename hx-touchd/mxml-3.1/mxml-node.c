@@ -54,6 +54,20 @@ mxmlAdd(mxml_node_t *parent,		/* I - Parent node */
   if (!parent || !node)
     return;
 
+ /*
+  * Arena documents are freed without walking them unless other nodes
+  * (or subtrees that may contain them) are added...
+  */
+
+  if ((parent->flags & _MXML_NODE_ARENA) &&
+      (!(node->flags & _MXML_NODE_ARENA) || node->child))
+  {
+    _mxml_arena_t *arena = _mxml_arena_get(parent);
+
+    if (arena)
+      arena->foreign = 1;
+  }
+
 #if DEBUG > 1
   fprintf(stderr, "    BEFORE: node->parent=%p\n", node->parent);
   if (parent)
@@ -194,6 +208,16 @@ mxmlDelete(mxml_node_t *node)		/* I - Node to delete */
 
   mxmlRemove(node);
 
+ /*
+  * An arena document holding only its own nodes is freed in one go...
+  */
+
+  if ((node->flags & _MXML_NODE_ROOT) && !_mxml_arena_get(node)->foreign)
+  {
+    _mxml_arena_delete(node);
+    return;
+  }
+
  /*
   * Delete children...
   */
@@ -263,6 +287,9 @@ mxmlGetRefCount(mxml_node_t *node)	/* I - Node */
   * Return the reference count...
   */
 
+  if (node->flags & _MXML_NODE_COMPACT)
+    return (1);
+
   return (node->ref_count);
 }
 
@@ -303,7 +330,7 @@ mxmlNewCDATA(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@ */
   */
 
   if ((node = mxml_new(parent, MXML_ELEMENT)) != NULL)
-    node->value.element.name = _mxml_strdupf("![CDATA[%s", data);
+    node->value.element.name = _mxml_node_adopt(node, _mxml_strdupf("![CDATA[%s", data));
 
   return (node);
 }
@@ -380,7 +407,7 @@ mxmlNewElement(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@
   */
 
   if ((node = mxml_new(parent, MXML_ELEMENT)) != NULL)
-    node->value.element.name = strdup(name);
+    node->value.element.name = _mxml_node_intern(node, name);
 
   return (node);
 }
@@ -449,7 +476,7 @@ mxmlNewOpaque(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@ *
   */
 
   if ((node = mxml_new(parent, MXML_OPAQUE)) != NULL)
-    node->value.opaque = strdup(opaque);
+    node->value.opaque = _mxml_node_strdup(node, opaque);
 
   return (node);
 }
@@ -492,7 +519,7 @@ mxmlNewOpaquef(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@
   {
     va_start(ap, format);
 
-    node->value.opaque = _mxml_vstrdupf(format, ap);
+    node->value.opaque = _mxml_node_adopt(node, _mxml_vstrdupf(format, ap));
 
     va_end(ap);
   }
@@ -568,7 +595,7 @@ mxmlNewText(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@ */
   if ((node = mxml_new(parent, MXML_TEXT)) != NULL)
   {
     node->value.text.whitespace = whitespace;
-    node->value.text.string     = strdup(string);
+    node->value.text.string     = _mxml_node_strdup(node, string);
   }
 
   return (node);
@@ -616,7 +643,7 @@ mxmlNewTextf(mxml_node_t *parent,	/* I - Parent node or @code MXML_NO_PARENT@ */
     va_start(ap, format);
 
     node->value.text.whitespace = whitespace;
-    node->value.text.string     = _mxml_vstrdupf(format, ap);
+    node->value.text.string     = _mxml_node_adopt(node, _mxml_vstrdupf(format, ap));
 
     va_end(ap);
   }
@@ -728,7 +755,7 @@ mxmlRelease(mxml_node_t *node)		/* I - Node */
 {
   if (node)
   {
-    if ((-- node->ref_count) <= 0)
+    if ((node->flags & _MXML_NODE_COMPACT) || (-- node->ref_count) <= 0)
     {
       mxmlDelete(node);
       return (0);
@@ -750,13 +777,38 @@ mxmlRelease(mxml_node_t *node)		/* I - Node */
 int					/* O - New reference count */
 mxmlRetain(mxml_node_t *node)		/* I - Node */
 {
-  if (node)
+  if (node && (node->flags & _MXML_NODE_COMPACT))
+    return (1);
+  else if (node)
     return (++ node->ref_count);
   else
     return (-1);
 }
 
 
+/*
+ * '_mxml_new_view()' - Create an opaque node that refers to mapped text.
+ */
+
+mxml_node_t *				/* O - New node */
+_mxml_new_view(mxml_node_t *parent,	/* I - Parent node */
+               const char  *data,	/* I - Text in the mapped document */
+               size_t      length)	/* I - Length of text */
+{
+  mxml_node_t	*node;			/* New node */
+
+
+  if ((node = mxml_new(parent, MXML_OPAQUE)) != NULL)
+  {
+    node->flags             |= _MXML_NODE_VIEW;
+    node->value.view.data   = (char *)data;
+    node->value.view.length = length;
+  }
+
+  return (node);
+}
+
+
 /*
  * 'mxml_free()' - Free the memory used by a node.
  *
@@ -769,6 +821,26 @@ mxml_free(mxml_node_t *node)		/* I - Node */
   int	i;				/* Looping var */
 
 
+ /*
+  * Arena memory stays until the arena is deleted, but custom data goes now...
+  */
+
+  if (node->flags & _MXML_NODE_ARENA)
+  {
+    if (node->type == MXML_CUSTOM)
+    {
+      if (node->value.custom.data && node->value.custom.destroy)
+        (*(node->value.custom.destroy))(node->value.custom.data);
+
+      node->value.custom.data = NULL;
+    }
+
+    if (node->flags & _MXML_NODE_ROOT)
+      _mxml_arena_delete(node);
+
+    return;
+  }
+
   switch (node->type)
   {
     case MXML_ELEMENT :
@@ -792,7 +864,7 @@ mxml_free(mxml_node_t *node)		/* I - Node */
        /* Nothing to do */
         break;
     case MXML_OPAQUE :
-        if (node->value.opaque)
+        if (node->value.opaque && !(node->flags & _MXML_NODE_VIEW))
 	  free(node->value.opaque);
         break;
     case MXML_REAL :
@@ -828,6 +900,8 @@ mxml_new(mxml_node_t *parent,		/* I - Parent node */
          mxml_type_t type)		/* I - Node type */
 {
   mxml_node_t	*node;			/* New node */
+  _mxml_arena_t	*arena = NULL;		/* Arena to allocate from */
+  int		flags = 0;		/* Flags for a new arena */
 
 
 #if DEBUG > 1
@@ -835,10 +909,32 @@ mxml_new(mxml_node_t *parent,		/* I - Parent node */
 #endif /* DEBUG > 1 */
 
  /*
-  * Allocate memory for the node...
+  * Allocate memory for the node; children of arena nodes share their arena.
+  * Loads pass a pending parent in place of no parent, whose value holds the
+  * flags for the arena that the document's first node starts...
   */
 
-  if ((node = calloc(1, sizeof(mxml_node_t))) == NULL)
+  if (parent && (parent->flags & _MXML_NODE_PENDING))
+  {
+    flags                 = parent->value.integer;
+    parent->value.integer = 0;
+    parent                = NULL;
+  }
+
+  if (parent && (parent->flags & _MXML_NODE_ARENA))
+    arena = _mxml_arena_get(parent);
+
+  if (arena)
+    node = _mxml_arena_node(arena);
+  else if (flags)
+  {
+    node  = _mxml_arena_new(flags);
+    arena = node ? _mxml_arena_get(node) : NULL;
+  }
+  else
+    node = calloc(1, sizeof(mxml_node_t));
+
+  if (!node)
   {
 #if DEBUG > 1
     fputs("    returning NULL\n", stderr);
@@ -855,8 +951,13 @@ mxml_new(mxml_node_t *parent,		/* I - Parent node */
   * Set the node type...
   */
 
-  node->type      = type;
-  node->ref_count = 1;
+  node->type = type;
+
+  if (!(node->flags & _MXML_NODE_COMPACT))
+    node->ref_count = 1;
+
+  if (arena && type == MXML_CUSTOM && _mxml_arena_custom(arena, node))
+    return (NULL);
 
  /*
   * Add to the parent if present...
@@ -0,0 +1,204 @@
+/*
+ * Load and save options for Mini-XML, a small XML file parsing library.
+ *
+ * https://www.msweet.org/mxml
+ *
+ * Copyright © 2003-2019 by Michael R Sweet.
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "config.h"
+#include "mxml-private.h"
+
+
+/*
+ * 'mxmlOptionsAddEntityCallback()' - Add a callback to convert entities to Unicode.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+mxmlOptionsAddEntityCallback(
+    mxml_options_t   *options,		/* I - Options */
+    mxml_entity_cb_t cb)		/* I - Callback function to add */
+{
+  if (options->num_entity_cbs < (int)(sizeof(options->entity_cbs) / sizeof(options->entity_cbs[0])))
+  {
+    options->entity_cbs[options->num_entity_cbs] = cb;
+    options->num_entity_cbs ++;
+
+    return (0);
+  }
+  else
+  {
+    _mxml_error(options, "Unable to add entity callback!");
+
+    return (-1);
+  }
+}
+
+
+/*
+ * 'mxmlOptionsDelete()' - Free load and save options.
+ */
+
+void
+mxmlOptionsDelete(
+    mxml_options_t *options)		/* I - Options */
+{
+  free(options);
+}
+
+
+/*
+ * 'mxmlOptionsNew()' - Create load and save options.
+ *
+ * The new options have the library defaults, not the settings made for the
+ * calling thread: no error or custom data callbacks, the standard entities,
+ * normal loading and a wrap margin of 72 columns.  They are passed to the
+ * "Ex" load and save functions, which then ignore the thread's settings, so
+ * documents can be loaded on several threads at once with different options.
+ * Options may be shared between threads but must not be changed while in use.
+ */
+
+mxml_options_t *			/* O - Options or @code NULL@ on error */
+mxmlOptionsNew(void)
+{
+  mxml_options_t	*options;	/* New options */
+
+
+  if ((options = calloc(1, sizeof(mxml_options_t))) == NULL)
+  {
+    mxml_error("Unable to allocate memory for options!");
+    return (NULL);
+  }
+
+  _mxml_options_init(options);
+
+  return (options);
+}
+
+
+/*
+ * 'mxmlOptionsRemoveEntityCallback()' - Remove an entity callback.
+ */
+
+void
+mxmlOptionsRemoveEntityCallback(
+    mxml_options_t   *options,		/* I - Options */
+    mxml_entity_cb_t cb)		/* I - Callback function to remove */
+{
+  int		i;			/* Looping var */
+
+
+  for (i = 0; i < options->num_entity_cbs; i ++)
+    if (cb == options->entity_cbs[i])
+    {
+     /*
+      * Remove the callback...
+      */
+
+      options->num_entity_cbs --;
+
+      if (i < options->num_entity_cbs)
+        memmove(options->entity_cbs + i, options->entity_cbs + i + 1,
+	        (options->num_entity_cbs - i) * sizeof(options->entity_cbs[0]));
+
+      return;
+    }
+}
+
+
+/*
+ * 'mxmlOptionsSetCustomFeedHandler()' - Set the incremental load function for custom data.
+ *
+ * See @link mxmlSetCustomFeedHandler@.
+ */
+
+void
+mxmlOptionsSetCustomFeedHandler(
+    mxml_options_t        *options,	/* I - Options */
+    mxml_custom_feed_cb_t feed)		/* I - Feed function */
+{
+  options->custom_feed_cb = feed;
+}
+
+
+/*
+ * 'mxmlOptionsSetCustomHandlers()' - Set the handling functions for custom data.
+ *
+ * See @link mxmlSetCustomHandlers@.
+ */
+
+void
+mxmlOptionsSetCustomHandlers(
+    mxml_options_t        *options,	/* I - Options */
+    mxml_custom_load_cb_t load,		/* I - Load function */
+    mxml_custom_save_cb_t save)		/* I - Save function */
+{
+  options->custom_load_cb = load;
+  options->custom_save_cb = save;
+}
+
+
+/*
+ * 'mxmlOptionsSetErrorCallback()' - Set the error message callback.
+ */
+
+void
+mxmlOptionsSetErrorCallback(
+    mxml_options_t  *options,		/* I - Options */
+    mxml_error_cb_t cb)			/* I - Error callback function */
+{
+  options->error_cb = cb;
+}
+
+
+/*
+ * 'mxmlOptionsSetLoadFlags()' - Set how the nodes of loaded documents are allocated.
+ *
+ * See @link mxmlSetLoadFlags@.
+ */
+
+void
+mxmlOptionsSetLoadFlags(
+    mxml_options_t *options,		/* I - Options */
+    int            flags)		/* I - @code MXML_ARENA@, @code MXML_COMPACT@, @code MXML_INTERN@, @code MXML_ELIDE_SPACE@, @code MXML_DEFER_TEXT@ or 0 */
+{
+  if (flags & (MXML_COMPACT | MXML_INTERN))
+    flags |= MXML_ARENA;
+
+  options->load_flags = flags;
+}
+
+
+/*
+ * 'mxmlOptionsSetWrapMargin()' - Set the wrap margin when saving XML data.
+ *
+ * Wrapping is disabled when "column" is 0.
+ */
+
+void
+mxmlOptionsSetWrapMargin(
+    mxml_options_t *options,		/* I - Options */
+    int            column)		/* I - Column for wrapping, 0 to disable wrapping */
+{
+  options->wrap = column;
+}
+
+
+/*
+ * '_mxml_options_init()' - Set the default options.
+ */
+
+void
+_mxml_options_init(_mxml_global_t *global)/* I - Options to initialize */
+{
+  global->num_entity_cbs = 1;
+  global->entity_cbs[0]  = _mxml_entity_cb;
+  global->wrap           = 72;
+}
@@ -44,44 +44,44 @@
 
 
 /*
- * 'mxml_error()' - Display an error message.
+ * Local functions...
+ */
+
+static void	mxml_verror(_mxml_global_t *global, const char *format, va_list ap);
+
+
+/*
+ * '_mxml_error()' - Display an error message using the given options.
  */
 
 void
-mxml_error(const char *format,		/* I - Printf-style format string */
-           ...)				/* I - Additional arguments as needed */
+_mxml_error(_mxml_global_t *global,	/* I - Options */
+            const char     *format,	/* I - Printf-style format string */
+            ...)			/* I - Additional arguments as needed */
 {
   va_list	ap;			/* Pointer to arguments */
-  char		s[1024];		/* Message string */
-  _mxml_global_t *global = _mxml_global();
-					/* Global data */
 
 
- /*
-  * Range check input...
-  */
+  va_start(ap, format);
+  mxml_verror(global, format, ap);
+  va_end(ap);
+}
 
-  if (!format)
-    return;
 
- /*
-  * Format the error message string...
-  */
+/*
+ * 'mxml_error()' - Display an error message.
+ */
 
-  va_start(ap, format);
+void
+mxml_error(const char *format,		/* I - Printf-style format string */
+           ...)				/* I - Additional arguments as needed */
+{
+  va_list	ap;			/* Pointer to arguments */
 
-  vsnprintf(s, sizeof(s), format, ap);
 
+  va_start(ap, format);
+  mxml_verror(_mxml_global(), format, ap);
   va_end(ap);
-
- /*
-  * And then display the error message...
-  */
-
-  if (global->error_cb)
-    (*global->error_cb)(s);
-  else
-    fprintf(stderr, "mxml: %s\n", s);
 }
 
 
@@ -137,6 +137,42 @@ mxml_real_cb(mxml_node_t *node)		/* I - Current node */
 }
 
 
+/*
+ * 'mxml_verror()' - Display an error message.
+ */
+
+static void
+mxml_verror(_mxml_global_t *global,	/* I - Options */
+            const char     *format,	/* I - Printf-style format string */
+            va_list        ap)		/* I - Additional arguments */
+{
+  char		s[1024];		/* Message string */
+
+
+ /*
+  * Range check input...
+  */
+
+  if (!format)
+    return;
+
+ /*
+  * Format the error message string...
+  */
+
+  vsnprintf(s, sizeof(s), format, ap);
+
+ /*
+  * And then display the error message...
+  */
+
+  if (global->error_cb)
+    (*global->error_cb)(s);
+  else
+    fprintf(stderr, "mxml: %s\n", s);
+}
+
+
 #ifdef HAVE_PTHREAD_H			/**** POSIX threading ****/
 #  include <pthread.h>
 
@@ -196,9 +232,7 @@ _mxml_global(void)
     global = (_mxml_global_t *)calloc(1, sizeof(_mxml_global_t));
     pthread_setspecific(_mxml_key, global);
 
-    global->num_entity_cbs = 1;
-    global->entity_cbs[0]  = _mxml_entity_cb;
-    global->wrap           = 72;
+    _mxml_options_init(global);
   }
 
   return (global);
@@ -278,9 +312,7 @@ _mxml_global(void)
   {
     global = (_mxml_global_t *)calloc(1, sizeof(_mxml_global_t));
 
-    global->num_entity_cbs = 1;
-    global->entity_cbs[0]  = _mxml_entity_cb;
-    global->wrap           = 72;
+    _mxml_options_init(global);
 
     TlsSetValue(_mxml_tls_index, (LPVOID)global);
   }
@@ -304,7 +336,9 @@ _mxml_global(void)
     { _mxml_entity_cb },		/* entity_cbs */
     72,					/* wrap */
     NULL,				/* custom_load_cb */
-    NULL				/* custom_save_cb */
+    NULL,				/* custom_save_cb */
+    NULL,				/* custom_feed_cb */
+    0					/* load_flags */
   };
 
 
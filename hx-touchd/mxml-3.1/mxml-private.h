@@ -46,6 +46,12 @@ typedef struct _mxml_custom_s		/**** An XML custom value. ****/
   mxml_custom_destroy_cb_t destroy;	/* Pointer to destructor function */
 } _mxml_custom_t;
 
+typedef struct _mxml_view_s		/**** Opaque text in a mapped document ****/
+{
+  char			*data;		/* Start of text, not nul-terminated */
+  size_t		length;		/* Length of text */
+} _mxml_view_t;
+
 typedef union _mxml_value_u		/**** An XML node value. ****/
 {
   _mxml_element_t	element;	/* Element */
@@ -54,21 +60,53 @@ typedef union _mxml_value_u		/**** An XML node value. ****/
   double		real;		/* Real number */
   _mxml_text_t		text;		/* Text fragment */
   _mxml_custom_t	custom;		/* Custom data @since Mini-XML 2.1@ */
+  _mxml_view_t		view;		/* Opaque text left in place */
 } _mxml_value_t;
 
 struct _mxml_node_s			/**** An XML node. ****/
 {
   mxml_type_t		type;		/* Node type */
+  int			flags;		/* Allocation flags (_MXML_NODE_xxx) */
   struct _mxml_node_s	*next;		/* Next node under same parent */
   struct _mxml_node_s	*prev;		/* Previous node under same parent */
   struct _mxml_node_s	*parent;	/* Parent node */
   struct _mxml_node_s	*child;		/* First child node */
   struct _mxml_node_s	*last_child;	/* Last child node */
   _mxml_value_t		value;		/* Node value */
-  int			ref_count;	/* Use count */
-  void			*user_data;	/* User data */
+  int			ref_count;	/* Use count, not in compact nodes */
+  void			*user_data;	/* User data, not in compact nodes */
 };
 
+#define _MXML_NODE_ARENA	1	/* Node and its strings are arena memory */
+#define _MXML_NODE_COMPACT	2	/* Node ends before ref_count */
+#define _MXML_NODE_ROOT		4	/* Node owns the arena placed before it */
+#define _MXML_NODE_VIEW		8	/* Opaque value is a view of mapped data */
+#define _MXML_NODE_PENDING	16	/* Stand-in parent of a load's top-level nodes */
+
+typedef struct _mxml_arena_s		/**** Per-document node allocator ****/
+{
+  struct _mxml_block_s	*blocks;	/* Blocks, newest first */
+  char			*ptr,		/* Free space in newest block */
+			*end;		/* End of newest block */
+  size_t		next_size;	/* Size of the next block */
+  struct _mxml_aref_s	*customs;	/* Custom nodes to destroy */
+  struct _mxml_name_s	**names;	/* Interned element names */
+  int			flags;		/* MXML_ARENA/MXML_COMPACT */
+  int			foreign;	/* Non-arena nodes were added */
+} _mxml_arena_t;
+
+typedef struct _mxml_ibucket_s		/**** Hashed index bucket ****/
+{
+  int			first,		/* First node in bucket or -1 */
+			last;		/* Last node in bucket or -1 */
+} _mxml_ibucket_t;
+
+typedef struct _mxml_ientry_s		/**** Hashed index entry ****/
+{
+  unsigned		hash;		/* Hash of node's key */
+  int			next;		/* Next node in bucket or -1 */
+} _mxml_ientry_t;
+
 struct _mxml_index_s			 /**** An XML node index. ****/
 {
   char			*attr;		/* Attribute used for indexing or NULL */
@@ -76,10 +114,13 @@ struct _mxml_index_s			 /**** An XML node index. ****/
   int			alloc_nodes;	/* Allocated nodes in index */
   int			cur_node;	/* Current node */
   mxml_node_t		**nodes;	/* Node array */
+  int			num_buckets;	/* Number of hash buckets, 0 if sorted */
+  _mxml_ibucket_t	*buckets;	/* Hash buckets */
+  _mxml_ientry_t	*entries;	/* Hash entries, parallel to nodes */
+  int			next_match;	/* Next entry to check when finding */
 };
 
-typedef struct _mxml_global_s		/**** Global, per-thread data ****/
-
+typedef struct _mxml_options_s		/**** Load/save options, also kept per-thread ****/
 {
   void	(*error_cb)(const char *);
   int	num_entity_cbs;
@@ -87,6 +128,8 @@ typedef struct _mxml_global_s		/**** Global, per-thread data ****/
   int	wrap;
   mxml_custom_load_cb_t	custom_load_cb;
   mxml_custom_save_cb_t	custom_save_cb;
+  mxml_custom_feed_cb_t	custom_feed_cb;
+  int	load_flags;
 } _mxml_global_t;
 
 
@@ -94,5 +137,24 @@ typedef struct _mxml_global_s		/**** Global, per-thread data ****/
  * Functions...
  */
 
+extern void		*_mxml_arena_alloc(_mxml_arena_t *arena, size_t size);
+extern int		_mxml_arena_custom(_mxml_arena_t *arena, mxml_node_t *node);
+extern void		_mxml_arena_delete(mxml_node_t *root);
+extern _mxml_arena_t	*_mxml_arena_get(mxml_node_t *node);
+extern mxml_node_t	*_mxml_arena_new(int flags);
+extern mxml_node_t	*_mxml_arena_node(_mxml_arena_t *arena);
 extern _mxml_global_t	*_mxml_global(void);
 extern int		_mxml_entity_cb(const char *name);
+extern int		_mxml_entity_value(_mxml_global_t *global, const char *name);
+extern void		_mxml_error(_mxml_global_t *global, const char *format, ...)
+#    ifdef __GNUC__
+__attribute__ ((__format__ (__printf__, 2, 3)))
+#    endif /* __GNUC__ */
+;
+extern char		*_mxml_node_adopt(mxml_node_t *node, char *s);
+extern char		*_mxml_node_intern(mxml_node_t *node, const char *s);
+extern char		*_mxml_node_strdup(mxml_node_t *node, const char *s);
+extern void		_mxml_node_strfree(mxml_node_t *node, char *s);
+extern char		*_mxml_node_unview(mxml_node_t *node);
+extern mxml_node_t	*_mxml_new_view(mxml_node_t *parent, const char *data, size_t length);
+extern void		_mxml_options_init(_mxml_global_t *global);
@@ -53,10 +53,10 @@ mxmlSetCDATA(mxml_node_t *node,		/* I - Node to set */
   * Allocate the new value, free any old element value, and set the new value...
   */
 
-  s = _mxml_strdupf("![CDATA[%s", data);
+  s = _mxml_node_adopt(node, _mxml_strdupf("![CDATA[%s", data));
 
   if (node->value.element.name)
-    free(node->value.element.name);
+    _mxml_node_strfree(node, node->value.element.name);
 
   node->value.element.name = s;
 
@@ -134,9 +134,9 @@ mxmlSetElement(mxml_node_t *node,	/* I - Node to set */
   */
 
   if (node->value.element.name)
-    free(node->value.element.name);
+    _mxml_node_strfree(node, node->value.element.name);
 
-  node->value.element.name = strdup(name);
+  node->value.element.name = _mxml_node_intern(node, name);
 
   return (0);
 }
@@ -202,9 +202,10 @@ mxmlSetOpaque(mxml_node_t *node,	/* I - Node to set */
   */
 
   if (node->value.opaque)
-    free(node->value.opaque);
+    _mxml_node_strfree(node, node->value.opaque);
 
-  node->value.opaque = strdup(opaque);
+  node->value.opaque = _mxml_node_strdup(node, opaque);
+  node->flags        &= ~_MXML_NODE_VIEW;
 
   return (0);
 }
@@ -243,13 +244,14 @@ mxmlSetOpaquef(mxml_node_t *node,	/* I - Node to set */
   */
 
   va_start(ap, format);
-  s = _mxml_vstrdupf(format, ap);
+  s = _mxml_node_adopt(node, _mxml_vstrdupf(format, ap));
   va_end(ap);
 
   if (node->value.opaque)
-    free(node->value.opaque);
+    _mxml_node_strfree(node, node->value.opaque);
 
   node->value.opaque = s;
+  node->flags        &= ~_MXML_NODE_VIEW;
 
   return (0);
 }
@@ -319,10 +321,10 @@ mxmlSetText(mxml_node_t *node,		/* I - Node to set */
   */
 
   if (node->value.text.string)
-    free(node->value.text.string);
+    _mxml_node_strfree(node, node->value.text.string);
 
   node->value.text.whitespace = whitespace;
-  node->value.text.string     = strdup(string);
+  node->value.text.string     = _mxml_node_strdup(node, string);
 
   return (0);
 }
@@ -360,11 +362,11 @@ mxmlSetTextf(mxml_node_t *node,		/* I - Node to set */
   */
 
   va_start(ap, format);
-  s = _mxml_vstrdupf(format, ap);
+  s = _mxml_node_adopt(node, _mxml_vstrdupf(format, ap));
   va_end(ap);
 
   if (node->value.text.string)
-    free(node->value.text.string);
+    _mxml_node_strfree(node, node->value.text.string);
 
   node->value.text.whitespace = whitespace;
   node->value.text.string     = s;
@@ -387,7 +389,7 @@ mxmlSetUserData(mxml_node_t *node,	/* I - Node to set */
   * Range check input...
   */
 
-  if (!node)
+  if (!node || (node->flags & _MXML_NODE_COMPACT))
     return (-1);
 
  /*
@@ -62,6 +62,14 @@
 #  define MXML_ADD_AFTER	1	/* Add node after specified node */
 #  define MXML_ADD_TO_PARENT	NULL	/* Add node relative to parent */
 
+#  define MXML_ARENA		1	/* Allocate loaded documents from an arena */
+#  define MXML_COMPACT		2	/* Arena nodes without ref count/user data */
+#  define MXML_INTERN		4	/* Share element names within a document */
+#  define MXML_ELIDE_SPACE	8	/* Drop whitespace between elements */
+#  define MXML_COMPACT_DOM	(MXML_COMPACT | MXML_INTERN | MXML_ELIDE_SPACE)
+					/* Smallest DOM for data documents */
+#  define MXML_DEFER_TEXT	16	/* Leave long mapped text unparsed */
+
 
 /*
  * Data types...
@@ -99,12 +107,21 @@ typedef struct _mxml_node_s mxml_node_t;	/**** An XML node. ****/
 typedef struct _mxml_index_s mxml_index_t;
 					/**** An XML node index. ****/
 
+typedef struct _mxml_parser_s mxml_parser_t;
+					/**** An XML push parser. ****/
+
+typedef struct _mxml_options_s mxml_options_t;
+					/**** Load and save options. ****/
+
 typedef int (*mxml_custom_load_cb_t)(mxml_node_t *, const char *);
 					/**** Custom data load callback function ****/
 
 typedef char *(*mxml_custom_save_cb_t)(mxml_node_t *);
 					/**** Custom data save callback function ****/
 
+typedef int (*mxml_custom_feed_cb_t)(mxml_node_t *, const char *, int);
+					/**** Custom data incremental load callback function ****/
+
 typedef int (*mxml_entity_cb_t)(const char *);
 					/**** Entity callback function */
 
@@ -162,6 +179,7 @@ extern int		mxmlGetInteger(mxml_node_t *node);
 extern mxml_node_t	*mxmlGetLastChild(mxml_node_t *node);
 extern mxml_node_t	*mxmlGetNextSibling(mxml_node_t *node);
 extern const char	*mxmlGetOpaque(mxml_node_t *node);
+extern const char	*mxmlGetOpaqueView(mxml_node_t *node, size_t *length);
 extern mxml_node_t	*mxmlGetParent(mxml_node_t *node);
 extern mxml_node_t	*mxmlGetPrevSibling(mxml_node_t *node);
 extern double		mxmlGetReal(mxml_node_t *node);
@@ -169,6 +187,7 @@ extern int		mxmlGetRefCount(mxml_node_t *node);
 extern const char	*mxmlGetText(mxml_node_t *node, int *whitespace);
 extern mxml_type_t	mxmlGetType(mxml_node_t *node);
 extern void		*mxmlGetUserData(mxml_node_t *node);
+extern int		mxmlIndexAdd(mxml_index_t *ind, mxml_node_t *node);
 extern void		mxmlIndexDelete(mxml_index_t *ind);
 extern mxml_node_t	*mxmlIndexEnum(mxml_index_t *ind);
 extern mxml_node_t	*mxmlIndexFind(mxml_index_t *ind,
@@ -177,13 +196,36 @@ extern mxml_node_t	*mxmlIndexFind(mxml_index_t *ind,
 extern int		mxmlIndexGetCount(mxml_index_t *ind);
 extern mxml_index_t	*mxmlIndexNew(mxml_node_t *node, const char *element,
 			              const char *attr);
+extern mxml_index_t	*mxmlIndexNewHash(mxml_node_t *node,
+			                  const char *element,
+			                  const char *attr);
 extern mxml_node_t	*mxmlIndexReset(mxml_index_t *ind);
 extern mxml_node_t	*mxmlLoadFd(mxml_node_t *top, int fd,
 			            mxml_type_t (*cb)(mxml_node_t *));
+extern mxml_node_t	*mxmlLoadFdEx(mxml_node_t *top, int fd,
+			              mxml_type_t (*cb)(mxml_node_t *),
+			              mxml_sax_cb_t sax, void *sax_data,
+			              mxml_options_t *options);
 extern mxml_node_t	*mxmlLoadFile(mxml_node_t *top, FILE *fp,
 			              mxml_type_t (*cb)(mxml_node_t *));
+extern mxml_node_t	*mxmlLoadFileEx(mxml_node_t *top, FILE *fp,
+			                mxml_type_t (*cb)(mxml_node_t *),
+			                mxml_sax_cb_t sax, void *sax_data,
+			                mxml_options_t *options);
+extern mxml_node_t	*mxmlLoadMapped(mxml_node_t *top, const void *data,
+			                size_t length,
+			                mxml_type_t (*cb)(mxml_node_t *));
+extern mxml_node_t	*mxmlLoadMappedEx(mxml_node_t *top, const void *data,
+			                  size_t length,
+			                  mxml_type_t (*cb)(mxml_node_t *),
+			                  mxml_sax_cb_t sax, void *sax_data,
+			                  mxml_options_t *options);
 extern mxml_node_t	*mxmlLoadString(mxml_node_t *top, const char *s,
 			                mxml_type_t (*cb)(mxml_node_t *));
+extern mxml_node_t	*mxmlLoadStringEx(mxml_node_t *top, const char *s,
+			                  mxml_type_t (*cb)(mxml_node_t *),
+			                  mxml_sax_cb_t sax, void *sax_data,
+			                  mxml_options_t *options);
 extern mxml_node_t	*mxmlNewCDATA(mxml_node_t *parent, const char *string);
 extern mxml_node_t	*mxmlNewCustom(mxml_node_t *parent, void *data,
 			               mxml_custom_destroy_cb_t destroy);
@@ -203,34 +245,76 @@ __attribute__ ((__format__ (__printf__, 3, 4)))
 #    endif /* __GNUC__ */
 ;
 extern mxml_node_t	*mxmlNewXML(const char *version);
+extern int		mxmlOptionsAddEntityCallback(mxml_options_t *options,
+			                             mxml_entity_cb_t cb);
+extern void		mxmlOptionsDelete(mxml_options_t *options);
+extern mxml_options_t	*mxmlOptionsNew(void);
+extern void		mxmlOptionsRemoveEntityCallback(mxml_options_t *options,
+			                                mxml_entity_cb_t cb);
+extern void		mxmlOptionsSetCustomFeedHandler(mxml_options_t *options,
+			                                mxml_custom_feed_cb_t feed);
+extern void		mxmlOptionsSetCustomHandlers(mxml_options_t *options,
+			                             mxml_custom_load_cb_t load,
+			                             mxml_custom_save_cb_t save);
+extern void		mxmlOptionsSetErrorCallback(mxml_options_t *options,
+			                            mxml_error_cb_t cb);
+extern void		mxmlOptionsSetLoadFlags(mxml_options_t *options,
+			                        int flags);
+extern void		mxmlOptionsSetWrapMargin(mxml_options_t *options,
+			                         int column);
+extern void		mxmlParserDelete(mxml_parser_t *parser);
+extern int		mxmlParserFeed(mxml_parser_t *parser, const void *data,
+			               size_t length);
+extern mxml_node_t	*mxmlParserFinish(mxml_parser_t *parser);
+extern mxml_parser_t	*mxmlParserNew(mxml_node_t *top, mxml_load_cb_t cb,
+			              mxml_sax_cb_t sax_cb, void *sax_data);
+extern mxml_parser_t	*mxmlParserNewEx(mxml_node_t *top, mxml_load_cb_t cb,
+			                mxml_sax_cb_t sax_cb, void *sax_data,
+			                mxml_options_t *options);
 extern int		mxmlRelease(mxml_node_t *node);
 extern void		mxmlRemove(mxml_node_t *node);
 extern int		mxmlRetain(mxml_node_t *node);
 extern char		*mxmlSaveAllocString(mxml_node_t *node,
 			        	     mxml_save_cb_t cb);
+extern char		*mxmlSaveAllocStringEx(mxml_node_t *node,
+			        	       mxml_save_cb_t cb,
+			        	       mxml_options_t *options);
 extern int		mxmlSaveFd(mxml_node_t *node, int fd,
 			           mxml_save_cb_t cb);
+extern int		mxmlSaveFdEx(mxml_node_t *node, int fd,
+			             mxml_save_cb_t cb, mxml_options_t *options);
 extern int		mxmlSaveFile(mxml_node_t *node, FILE *fp,
 			             mxml_save_cb_t cb);
+extern int		mxmlSaveFileEx(mxml_node_t *node, FILE *fp,
+			               mxml_save_cb_t cb, mxml_options_t *options);
 extern int		mxmlSaveString(mxml_node_t *node, char *buffer,
 			               int bufsize, mxml_save_cb_t cb);
+extern int		mxmlSaveStringEx(mxml_node_t *node, char *buffer,
+			                 int bufsize, mxml_save_cb_t cb,
+			                 mxml_options_t *options);
 extern mxml_node_t	*mxmlSAXLoadFd(mxml_node_t *top, int fd,
 			               mxml_type_t (*cb)(mxml_node_t *),
 			               mxml_sax_cb_t sax, void *sax_data);
 extern mxml_node_t	*mxmlSAXLoadFile(mxml_node_t *top, FILE *fp,
 			                 mxml_type_t (*cb)(mxml_node_t *),
 			                 mxml_sax_cb_t sax, void *sax_data);
+extern mxml_node_t	*mxmlSAXLoadMapped(mxml_node_t *top, const void *data,
+			                   size_t length,
+			                   mxml_type_t (*cb)(mxml_node_t *),
+			                   mxml_sax_cb_t sax, void *sax_data);
 extern mxml_node_t	*mxmlSAXLoadString(mxml_node_t *top, const char *s,
 			                   mxml_type_t (*cb)(mxml_node_t *),
 			                   mxml_sax_cb_t sax, void *sax_data);
 extern int		mxmlSetCDATA(mxml_node_t *node, const char *data);
 extern int		mxmlSetCustom(mxml_node_t *node, void *data,
 			              mxml_custom_destroy_cb_t destroy);
+extern void		mxmlSetCustomFeedHandler(mxml_custom_feed_cb_t feed);
 extern void		mxmlSetCustomHandlers(mxml_custom_load_cb_t load,
 			                      mxml_custom_save_cb_t save);
 extern int		mxmlSetElement(mxml_node_t *node, const char *name);
 extern void		mxmlSetErrorCallback(mxml_error_cb_t cb);
 extern int		mxmlSetInteger(mxml_node_t *node, int integer);
+extern void		mxmlSetLoadFlags(int flags);
 extern int		mxmlSetOpaque(mxml_node_t *node, const char *opaque);
 extern int		mxmlSetOpaquef(mxml_node_t *node, const char *format, ...)
 #    ifdef __GNUC__